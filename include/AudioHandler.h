@@ -4,10 +4,18 @@
 #include <stdio.h>
 #include <time.h>
 #include <math.h>
+#include <stdint.h>
 #include <list>
+#include <vector>
+#include <queue>
+#include <functional>
 #include "libplayerc++/playerc++.h"
 #include <boost/thread/mutex.hpp>
 #include <boost/thread/thread.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/shared_ptr.hpp>
+#include "SimulationClock.h"
+#include "PoseCache.h"
 
 class EPuck;
 
@@ -64,6 +72,8 @@ public:
 
 
 	/** AudioBin stores information about a tone in the environment. Each object represents a frequency band containing tones being played.
+	 * The tones are kept as a structure of arrays (tx, ty, end) so that working out what a robot can hear is a scan over
+	 * contiguous memory. The arrays keep their capacity when tones expire, so once a bin has warmed up, adding tones does not allocate.
 	 * */
 	class AudioBin
 	{
@@ -80,42 +90,43 @@ public:
 			//double wattsAtSource;
 			/**Time that the tone will stop playing*/
 			double end;
-			/**Audio tones are stored as a linked list in an audio bin, previous and next are ways of navigating the linked list*/
-			audio_tone_t *next;
-			/**Audio tones are stored as a linked list in an audio bin, previous and next are ways of navigating the linked list*/
-			audio_tone_t *previous;
 		}audio_tone_t;
 
+		/**The number of tones a bin has space for before it first needs to grow its arrays*/
+		static const int initialToneCapacity = 16;
+
 		/**frequency bin lower bound*/
 		double lowerFrequencyBound;
-		/**Linked list of tones currently in this bin*/
-		audio_tone_t *tones;
+		/**The x coords of the sources of the tones in this bin*/
+		std::vector<double> tx;
+		/**The y coords of the sources of the tones in this bin*/
+		std::vector<double> ty;
+		/**The times that the tones in this bin will stop playing*/
+		std::vector<double> end;
 
 		/**The number of tones stored in this bin*/
 		int numberTones;
 
-		/**AudioBins are stored as a linked list by the handler so need to be able to navigate LL.*/
-		AudioBin *next;
-		/**AudioBins are stored as a linked list by the handler so need to be able to navigate LL.*/
-		AudioBin *previous;
-
-		AudioBin(double lowerFreq, AudioBin *prev, AudioBin *nxt);
+		AudioBin(void);
 		virtual ~AudioBin();
 
-		int getNumberTones(void);
+		int getNumberTones(void) const;
 		int updateList(double currentTime);
 		void addTone(double x, double y, double endtime);
-		int calculateRawToneDataForPosition(double x, double y, double yaw, audio_message_t* output, int maxToFill);
+		audio_tone_t getTone(int index) const;
+		int calculateRawToneDataForPosition(double x, double y, double yaw, audio_message_t* output, int maxToFill) const;
+		void calculateRawToneDataForPositions(int numberListeners, const double *xr, const double *yr, const double *yaw,
+				double *xdiff, double *ydiff, double *distance, std::vector<audio_message_t> *outputs) const;
+		void calculateRawToneDataForTone(int index, double xr, double yr, double yaw, audio_message_t* output) const;
 
+		static double getSoundIntensity(double levelAtSource, double distance);
 
 	private:
-		int removeTone(audio_tone_t *del);
-		double getSoundIntensity(double levelAtSource, double distance);
-		int convertDifferentialCoordsIntoBearing(double xdiff, double ydiff, double recieverYaw);
+		int convertDifferentialCoordsIntoBearing(double xdiff, double ydiff, double recieverYaw) const;
 
 		//==== USEFUL STUFF ====
 
-		int radiansToDegrees(double rads);
+		int radiansToDegrees(double rads) const;
 		double degreesToRadians(int degrees);
 		double roundToNearest(double input, double resolution);
 	};
@@ -133,7 +144,16 @@ public:
 	void playTone(int freq, double duration, char* name);
 	int getNumberOfTones(void);
 	int getTones(char* robotName, audio_message_t *store, int numberAllocatedSlots);
+	int getTones(char* robotName, std::vector<audio_message_t> &store);
+	int getTonesForPositions(int numberListeners, const double *x, const double *y, const double *yaw, std::vector<audio_message_t> *stores);
+	int getTonesForRobots(int numberRobots, char **robotNames, std::vector<audio_message_t> *stores);
+	unsigned long getEnvironmentVersion(void);
+
+	void setHearingRange(double range);
+	void setHearingThreshold(double wattsAtSource, double threshold);
+	double getHearingRange(void);
 
+	void removeFinishedTones(void);
 
 
 	/** Test function to print all of the sound environment data to stdout.
@@ -149,16 +169,92 @@ protected:
 	//boost::mutex getIOMutex(void){return toneIOMutex;}
 private:
 	//member variables
-	//linked list of AudioBins for the frequencies currently being played.
-	AudioBin *environment;
+	/**Table of AudioBins, one per FFT block, indexed by bin number. Bins with no tones in them are simply empty.*/
+	AudioBin environment[fftBlockSize/2];
 
+	/**The number of bins in the environment that currently contain tones.*/
 	int numberOfBins;
 	boost::thread updateAudioBinListThread;
 
+	/**An entry in the expiry queue. Says which bin has a tone that finishes playing at a given time.*/
+	typedef struct tone_expiry
+	{
+		/**Time that the tone will stop playing*/
+		double end;
+		/**Index of the bin in the environment table holding the tone*/
+		int bin;
+
+		bool operator>(tone_expiry const& other) const
+		{
+			return (end > other.end);
+		}
+	}tone_expiry_t;
+
+	/**Min-heap of tone end times, so the update thread knows when the next tone will finish without looking at every bin.*/
+	std::priority_queue<tone_expiry_t, std::vector<tone_expiry_t>, std::greater<tone_expiry_t> > expiryQueue;
+	/**Signalled by playTone when the earliest end time in expiryQueue changes.*/
+	boost::condition_variable expiryQueueChanged;
+
+	/**An entry in the tone location grid of a bin. Says which cell of the grid a tone's source is in.*/
+	typedef struct grid_entry
+	{
+		/**The grid cell, see AudioHandler#getGridCell*/
+		int64_t cell;
+		/**Index of the tone in the bin*/
+		int tone;
+
+		bool operator<(grid_entry const& other) const
+		{
+			if(cell != other.cell) return (cell < other.cell);
+			return (tone < other.tone);
+		}
+	}grid_entry_t;
+
+	/**
+	 * An immutable copy of one bin of the environment. It is shared by every snapshot published while the bin doesn't change,
+	 * so playing a tone only copies the bin the tone is in.
+	 * */
+	typedef struct bin_snapshot
+	{
+		/**Copy of the bin*/
+		AudioBin bin;
+		/**The tones in the bin, sorted by the grid cell their source is in. The cells are hearingRange wide, so a listener
+		 * only needs to look at the cell it is in and the 8 around it. Empty if hearingRange is 0.*/
+		std::vector<grid_entry_t> grid;
+	}bin_snapshot_t;
+
+	/**
+	 * An immutable copy of the audio environment. Whenever playTone or the update thread change the environment they
+	 * build a new snapshot and swap it in atomically, so functions that only read the environment can work from the
+	 * latest snapshot without locking toneIOMutex. Old snapshots are freed when the last reader lets go of them.
+	 * */
+	typedef struct audio_snapshot
+	{
+		/**Increases by one every time a new snapshot is published*/
+		unsigned long version;
+		/**The total number of tones in all the bins*/
+		int numberOfTones;
+		/**The bins which had tones in them when the snapshot was made, in order of frequency*/
+		std::vector< boost::shared_ptr<const bin_snapshot_t> > bins;
+		/**How far away a tone can be heard from. 0 if all tones can be heard everywhere.*/
+		double hearingRange;
+	}audio_snapshot_t;
+
+	/**The latest copy of each bin in the environment table, which the next snapshot will use. NULL for bins with no tones.*/
+	boost::shared_ptr<const bin_snapshot_t> binSnapshots[fftBlockSize/2];
+
+	/**The latest snapshot of the environment. Only access using boost::atomic_load and boost::atomic_store.*/
+	boost::shared_ptr<const audio_snapshot_t> snapshot;
+	/**Version number of the latest snapshot.*/
+	unsigned long environmentVersion;
+	/**How far away a tone can be heard from, in metres. 0 means there is no limit.*/
+	double hearingRange;
 
 	//player stuff
 	PlayerCc::SimulationProxy	*simProxy;
 	PlayerCc::PlayerClient *simClient;
+	SimulationClock *clock;
+	PoseCache *poses;
 	char aRobotName[32];
 
 	//singleton reference to only instance of audiohandler.
@@ -166,7 +262,15 @@ private:
 
 
 
-	int removeBin(AudioBin *del);
+	int getBinIndex(int freq);
+
+	void updateBinSnapshot(int bin, bool toneAdded);
+	void publishSnapshot(void);
+	bool removeExpiredTones(double currentTime);
+	boost::shared_ptr<const audio_snapshot_t> getSnapshot(void);
+	int fillTonesForPosition(const audio_snapshot_t *current, double x, double y, double yaw, audio_message_t *store, int numberAllocatedSlots);
+	static int64_t getGridCell(double x, double y, double cellSize);
+	static int64_t getGridCell(int cellX, int cellY);
 
 	void updateAudioBinListThreaded(void);
 
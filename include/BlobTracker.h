@@ -0,0 +1,115 @@
+#ifndef BLOBTRACKER_H_
+#define BLOBTRACKER_H_
+
+#include <vector>
+#include "EPuck.h"
+
+/**
+ * BlobTracker follows the blobs a robot's camera sees from one frame to the next, and gives each one a track ID that stays the
+ * same for as long as the blob is in view. The blobfinder numbers blobs by where they are in the current frame's list, so
+ * Blob#id can belong to a different object each frame and can't be used for this.
+ *
+ * Each frame every track's position is predicted from its velocity, and each blob is matched to the nearest predicted track of
+ * the same colour, cheapest pair first (greedy matching). The cost of a pair is the distance between the centres plus the
+ * difference in the size of the bounding boxes, and pairs whose centres are more than maxDistance pixels apart are never
+ * matched. A blob with no track starts a new track. A track that isn't seen is kept, moving at its last velocity, for up to
+ * maxMissedFrames frames in case the blob was just missed by the blobfinder for a frame or two.
+ *
+ * The tracks are put in a hash grid of cells maxDistance across, so a blob only has to be compared with the tracks in the 9
+ * cells around it. Updating the tracks takes time in proportion to the number of blobs and doesn't allocate memory once the
+ * tracker has seen its biggest frame.
+ *
+ * Each robot should have its own tracker. A tracker isn't thread safe, so it should be used by one thread.
+ *
+ * An example of tracking the blobs a robot can see:<br>
+ * <code>BlobTracker tracker;<br>
+ * tracker.update(robot);<br>
+ * const std::vector<BlobTracker::Track> &tracks = tracker.getTracks();</code>
+ * @see EPuck#getBlobs
+ * */
+class BlobTracker
+{
+public:
+	/**
+	 * A blob that has been followed over a number of frames.
+	 * */
+	class Track
+	{
+	public:
+		/**The track's ID. IDs are never reused by a tracker.*/
+		int id;
+		/**The blob as it was last seen*/
+		EPuck::Blob blob;
+		/**Velocity of the blob's centre across the image, in pixels per second (or per unit of the time given to update)*/
+		double vx, vy;
+		/**The time the blob was last seen*/
+		double lastSeen;
+		/**Number of frames the blob has been seen in*/
+		int age;
+		/**Number of frames in a row the blob hasn't been seen. 0 if it was seen in the last frame.*/
+		int missedFrames;
+	};
+
+	/**Default for how far, in pixels, a blob can be from where its track was predicted to be.*/
+	static const double DEFAULT_MAX_DISTANCE = 40;
+	/**Default for how many frames in a row a track can go unseen before it is dropped.*/
+	static const int DEFAULT_MAX_MISSED_FRAMES = 3;
+	/**How much of the change in velocity measured each frame is used. 1 uses just the latest frame, lower values smooth out noise.*/
+	static const double VELOCITY_SMOOTHING = 0.5;
+	/**Number of cells in the hash grid the tracks are put in. A power of 2.*/
+	static const int NUMBER_OF_BUCKETS = 256;
+
+	BlobTracker(void);
+	BlobTracker(double maxDistance, int maxMissedFrames);
+	virtual ~BlobTracker();
+
+	int update(EPuck *robot);
+	int update(const std::vector<EPuck::Blob> &blobs, double time);
+	void reset(void);
+
+	const std::vector<Track>& getTracks(void);
+	int getNumberOfTracks(void);
+	int getTrackId(int blobIndex);
+
+private:
+	/**A track and blob close enough to be matched*/
+	typedef struct track_match
+	{
+		double cost;
+		int track;
+		int blob;
+
+		bool operator<(track_match const& other) const
+		{
+			return cost < other.cost;
+		}
+	}track_match_t;
+
+	double maxDistance;
+	int maxMissedFrames;
+
+	std::vector<Track> tracks;
+	int nextId;
+	/**Sequence of the last sensor frame update(EPuck*) used, so the same frame isn't used twice*/
+	unsigned long lastSequence;
+
+	/**The ID of the track each blob in the last update was given, in the same order as the blobs.*/
+	std::vector<int> blobTrackIds;
+
+	//kept between updates so they don't have to be allocated each frame
+	std::vector<EPuck::Blob> frameBlobs;
+	std::vector<double> predictedX, predictedY;
+	/**The tracks in each hash grid cell are bucketTracks[bucketStart[cell]] to bucketTracks[bucketStart[cell+1]-1]*/
+	std::vector<int> bucketStart;
+	std::vector<int> bucketTracks;
+	std::vector<track_match_t> matches;
+	std::vector<int> trackMatch;
+
+	void initialise(double distance, int missedFrames);
+	void fillBuckets(double time);
+	void findMatches(const std::vector<EPuck::Blob> &blobs);
+	int getBucket(int cellX, int cellY);
+	int getCell(double coordinate);
+};
+
+#endif /* BLOBTRACKER_H_ */
@@ -0,0 +1,66 @@
+#ifndef CONNECTIONMANAGER_H_
+#define CONNECTIONMANAGER_H_
+
+#include <stdio.h>
+#include <map>
+#include "libplayerc++/playerc++.h"
+#include <boost/thread/mutex.hpp>
+
+/**
+ * ConnectionManager shares connections to the Player server between all the robots in the program.
+ * Without it every EPuckSim opened its own PlayerClient to its robot port and another to the simulation port, so 50 robots
+ * meant 100 TCP connections and 50 copies of the same SimulationProxy.
+ *
+ * A PlayerClient connects to one port, so there is one client per port and any robots whose proxies are served on that
+ * port (ie they are given different indexes in the .cfg file) share it. All the simulation traffic goes through a single
+ * SimulationProxy per simulation port, which is also the one used by the AudioHandler, SimulationClock and PoseCache.
+ *
+ * libplayerc++ locks the client inside each proxy call when it is built with boost threads, so a shared client can be used
+ * from several threads at once.
+ *
+ * The ConnectionManager code is not intended to be user facing, the user interacts with it using the EPuck API.
+ *
+ * ConnectionManager uses the Singleton design pattern, like AudioHandler. Constructor is called using the GetConnectionManager() method.
+ * @see EPuckSim
+ * */
+class ConnectionManager
+{
+public:
+	static ConnectionManager* GetConnectionManager(void);
+	virtual ~ConnectionManager();
+
+	PlayerCc::PlayerClient* getClient(int port);
+	void releaseClient(PlayerCc::PlayerClient *client);
+
+	PlayerCc::SimulationProxy* getSimulationProxy(int simulationPort);
+	PlayerCc::PlayerClient* getSimulationClient(int simulationPort);
+
+	int getNumberOfClients(void);
+
+protected:
+	//protected so it can be a singleton
+	ConnectionManager(void);
+
+private:
+	/**A PlayerClient and the number of robots using it.*/
+	typedef struct player_connection
+	{
+		PlayerCc::PlayerClient *client;
+		int users;
+	}player_connection_t;
+
+	/**The open clients, keyed by port.*/
+	std::map<int, player_connection_t> clients;
+	/**The shared SimulationProxy for each simulation port. These are never closed because the audio, clock and pose code keep using them.*/
+	std::map<int, PlayerCc::SimulationProxy*> simulationProxies;
+	/**Protects clients and simulationProxies.*/
+	boost::mutex connectionMutex;
+
+	//singleton reference to only instance of the connection manager.
+	static ConnectionManager* _instance;
+	static boost::mutex instanceMutex;
+
+	PlayerCc::PlayerClient* openClient(int port);
+};
+
+#endif /* CONNECTIONMANAGER_H_ */
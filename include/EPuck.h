@@ -55,6 +55,37 @@ public:
 		int bottom;
 	};
 
+	/**
+	 * Picks which blobs {@link EPuck#getBlobs getBlobs} gives you. The default filter lets every blob through.
+	 * As in <code>robot->getBlobs(blobs, EPuck::BlobFilter(0xff0000, 20))</code> for red blobs of at least 20 pixels.
+	 * @see EPuck#getBlobs
+	 * */
+	class BlobFilter
+	{
+	public:
+		/**Colour the blobs must be, in the same format as Blob#colour. The alpha component is ignored.*/
+		uint32_t colour;
+		/**If false blobs of any colour are let through and colour is ignored.*/
+		bool matchColour;
+		/**Smallest area a blob can have, in pixels.*/
+		int minimumArea;
+
+		/**Makes a filter that lets every blob through.*/
+		BlobFilter(void) : colour(0), matchColour(false), minimumArea(0) {}
+
+		/**Makes a filter that only lets through blobs of one colour that are at least minimumArea pixels.*/
+		BlobFilter(uint32_t colour, int minimumArea = 0) : colour(colour), matchColour(true), minimumArea(minimumArea) {}
+
+		/**
+		 * @returns true if the blob gets through the filter.
+		 * */
+		bool accepts(const Blob &blob) const
+		{
+			if(blob.area < minimumArea) return false;
+			return !matchColour || ((blob.colour ^ colour) & 0x00FFFFFF) == 0;
+		}
+	};
+
 	/**
 	 * Stores information about the tones in a single frequency band that can be heard by the robot.
 	 * This is the information that the robot will be able to detect and is all robot-centric.
@@ -83,6 +114,70 @@ public:
 	};
 
 
+	/**
+	 * Everything the robot's sensors saw at one time, as a single snapshot. Frames are published each time the robot's
+	 * sensors are read and are never changed afterwards, so a controller can keep a frame and use it while the robot
+	 * goes on reading its sensors. Get the latest one with {@link EPuck#getSensorFrame getSensorFrame}.
+	 * @see EPuck#getSensorFrame
+	 * */
+	class SensorFrame
+	{
+	public:
+		/**Most IR readings a frame can hold*/
+		static const int MAX_IRS = 8;
+		/**Most blobs a frame can hold. If the camera sees more than this the rest are left out, see totalBlobs.*/
+		static const int MAX_BLOBS = 64;
+
+		/**Number of frames the robot has published before this one. 0 if no frame has been published yet. A controller can compare this with the last frame it used to tell if there is a new one.*/
+		unsigned long sequence;
+		/**The robot's time when the sensors were read, in the units of {@link EPuck#getTime getTime}*/
+		double time;
+		/**The battery voltage*/
+		double batteryVolts;
+		/**Number of IR readings in irReadings*/
+		int numberOfIRs;
+		/**The IR ranges in metres*/
+		double irReadings[MAX_IRS];
+		/**Size of the camera image in pixels, or -1 if not known*/
+		int cameraWidth, cameraHeight;
+		/**Number of blobs in blobs*/
+		int numberBlobs;
+		/**Number of blobs the camera saw. If this is more than numberBlobs the frame was full and the rest were left out.*/
+		int totalBlobs;
+		/**The blobs the camera could see*/
+		Blob blobs[MAX_BLOBS];
+
+		/**
+		 * Tells you if this frame is too old to use.
+		 * @param now the robot's time now, from {@link EPuck#getTime getTime}
+		 * @param maxAge the oldest a frame can be and still be used, in the same units as getTime
+		 * @returns true if no frame has been published yet or the frame is older than maxAge.
+		 * */
+		bool isStale(double now, double maxAge) const
+		{
+			return sequence == 0 || now - time > maxAge;
+		}
+
+		/**
+		 * Copies the blobs in this frame that get through a filter.
+		 * @param out where the blobs are copied. It is emptied first, but keeps its memory so it can be used again each tick.
+		 * @param filter which blobs to copy.
+		 * @returns the number of blobs copied.
+		 * */
+		int getBlobs(std::vector<Blob> &out, const BlobFilter &filter) const
+		{
+			int i;
+
+			out.clear();
+			for(i=0; i<numberBlobs; i++)
+			{
+				if(filter.accepts(blobs[i])) out.push_back(blobs[i]);
+			}
+			return out.size();
+		}
+	};
+
+
 	//==========================================================
 	//				CONSTANTS
 	//==========================================================
@@ -169,6 +264,23 @@ public:
 	 * */
 	virtual double getBatteryVolts(void) = 0;
 
+	/**
+	 * Copies the latest snapshot of the robot's sensors into frame. This doesn't ask Player for anything and doesn't wait for
+	 * the thread that reads the sensors, so it is safe to call from any thread as often as you like. A new frame is published
+	 * each time the sensors are read.
+	 * @param frame where the snapshot is copied.
+	 * @see SensorFrame
+	 * */
+	virtual void getSensorFrame(SensorFrame &frame) = 0;
+
+	/**
+	 * BLOCKS until there is a sensor frame newer than the one given, then copies it into frame. Use this to run a controller
+	 * each time the robot has new sensor readings, without polling.
+	 * @param frame the last frame the caller had, which is replaced with the new one. Give it sequence 0 to get the first frame.
+	 * @see SensorFrame
+	 * */
+	virtual void waitForSensorFrame(SensorFrame &frame) = 0;
+
 	//==================== IR methods =========================================
 	/**
 	Gives the IR readings as an array of length returned by {@link #getNumberOfIRs getNumberOfIRs} class.
@@ -216,6 +328,19 @@ public:
 	 * */
 	virtual Blob getBlob(int index) = 0;
 
+	/**
+	 * Gets all the blobs the camera can see at once, from the latest {@link EPuck#getSensorFrame sensor frame}, so they all come
+	 * from the same camera image. This is quicker than calling getBlob for each blob, especially if the same vector is used each
+	 * time so it doesn't have to allocate any memory.
+	 * @param blobs where the blobs are put. Anything already in it is removed.
+	 * @param filter which blobs to get, eg only red ones. Leave this out to get them all.
+	 * @returns the number of blobs put in blobs.
+	 * @warning a frame holds at most SensorFrame::MAX_BLOBS blobs, so only the first that many the camera saw are looked at.
+	 * If a frame's totalBlobs is more than its numberBlobs the rest were left out.
+	 * @see BlobFilter
+	 * */
+	virtual int getBlobs(std::vector<Blob> &blobs, const BlobFilter &filter = BlobFilter()) = 0;
+
 	//==================== motor control methods ================================
 
 	/**
@@ -277,6 +402,12 @@ public:
 	 * */
 	virtual void stopFlashLEDs(void) = 0;
 
+	/**
+	 * Sends any motor or LED commands the robot is holding back. SwarmScheduler calls this after each controller step.
+	 * Robots that always send their commands straight away don't need to do anything.
+	 * */
+	virtual void flushCommands(void){};
+
 	//======================== audio methods =================================
 
 	/**
@@ -303,6 +434,16 @@ public:
 	 * */
 	virtual std::vector<Tone> listenForTones(void) = 0;
 
+	/**
+	 * Listens for any sounds in the audio environment and copies them into the vector provided.
+	 * The vector is cleared first and keeps its capacity, so if the same vector is passed in every time the robot listens
+	 * then no memory needs to be allocated once it has grown big enough.
+	 * @param tones where the tones the robot can hear are stored.
+	 * @returns the number of tones the robot can hear, -1 if unsuccessful.
+	 * @see #listenForTones(void)
+	 * */
+	virtual int listenForTones(std::vector<Tone> &tones) = 0;
+
 
 };
 
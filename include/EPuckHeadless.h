@@ -0,0 +1,98 @@
+#ifndef EPUCKHEADLESS_H
+#define EPUCKHEADLESS_H
+
+#include <vector>
+#include <boost/thread/tss.hpp>
+
+#include "AudioHandler.h"
+#include "HeadlessWorld.h"
+#include "EPuck.h"
+#include "SensorFrameBuffer.h"
+
+
+/**
+Controls an e-puck in a HeadlessWorld, a simulation that runs inside the program instead of in Player/Stage.
+This is for running experiments much faster than real time: nothing happens until the world is stepped, so a typical program
+gives every robot its commands, calls HeadlessWorld::step() and repeats.
+
+An example of making an EPuck object to control a robot in a headless copy of the boids world:<br>
+<code>HeadlessWorld world("worlds/boids.world");<br>
+EPuck *robot = new EPuckHeadless(&world, "robot1");</code>
+
+Sensor readings are taken when readSensors() is called, like the other EPuck classes, so call it after each step.
+Unlike EPuckSim the camera width and height are always returned, even if there are no blobs.
+setDifferentialMotors() turns wheel speeds into forward and turn speeds the same way as EPuckSim, with the robot moving
+at the inner wheel's speed rather than the average of the two.
+@see HeadlessWorld
+@see EPuck
+@see EPuckSim
+ */
+class EPuckHeadless : public EPuck
+{
+public:
+	/**The name given to this robot in the world file.*/
+	char name[32];
+
+protected:
+	/**The world the robot is in*/
+	HeadlessWorld *world;
+	/**The robot's index in the world*/
+	int index;
+
+	/**each thread's copy of the IR readings, filled from the latest frame by getIRReadings()*/
+	boost::thread_specific_ptr< std::vector<double> > irBuffer;
+	/**the blobs the camera could see, as of the last readSensors()*/
+	std::vector<Blob> blobs;
+	/**snapshots of the sensors, published by readSensors()*/
+	SensorFrameBuffer frameBuffer;
+
+	//audio stuff
+	AudioHandler *handler;
+	bool audioInitialised;
+
+public:
+
+	EPuckHeadless(HeadlessWorld *headlessWorld, char* robotName);
+	~EPuckHeadless(void);
+
+	void readSensors(void);
+	double getTime(void);
+	/**Waits the provided number of milliseconds of simulated time and BLOCKS while doing so. Something else must be stepping the world.*/
+	void waitMilliseconds(int timeMs);
+	double getBatteryVolts(void);
+	void getSensorFrame(SensorFrame &frame);
+	/**Waits for a newer frame than the one given. Frames are only published when readSensors() is called, so something else must be calling it.*/
+	void waitForSensorFrame(SensorFrame &frame);
+
+	void getPosition(double& x, double& y, double& yaw);
+	void setPosition(double x, double y, double yaw);
+
+	/**The IR readings from the last readSensors(). The array belongs to the calling thread, as in EPuckSim.*/
+	double* getIRReadings(void);
+	double getIRReading(int index);
+	int getNumberOfIRs(void);
+
+	int getCameraWidth(void);
+	int getCameraHeight(void);
+	int getNumberBlobs(void);
+	Blob getBlob(int index);
+	int getBlobs(std::vector<Blob> &blobs, const BlobFilter &filter = BlobFilter());
+
+	void setMotors(double forward, double turnrate);
+	void setDifferentialMotors(double left, double right);
+
+	void setAllLEDsOn(void);
+	void setAllLEDsOff(void);
+	void toggleAllLEDs(void);
+	void setLED(int index, int state);
+	void flashLEDs(double frequency);
+	void stopFlashLEDs(void);
+
+	int initaliseAudio(void);
+	AudioHandler* getAudioHandler(void);
+	int playTone(int frequency, double duration);
+	std::vector<Tone> listenForTones(void);
+	int listenForTones(std::vector<Tone> &tones);
+};
+
+#endif
@@ -1,9 +1,13 @@
 #ifndef EPUCKREAL_H
 #define EPUCKREAL_H
 
-#include <pthread.h>
+#include <vector>
+#include <boost/thread/thread.hpp>
+#include <boost/thread/tss.hpp>
 #include "libplayerc++/playerc++.h"
 #include "EPuck.h"
+#include "TimerWheel.h"
+#include "SensorFrameBuffer.h"
 
 
 /**
@@ -30,10 +34,14 @@ private:
 	PlayerCc::BlobfinderProxy	*blobProxy;		//camera
 	PlayerCc::PowerProxy		*powerProxy;	//battery
 
-	double irReadings[8];
+	/**each thread's copy of the IR readings, filled from the latest frame by getIRReadings()*/
+	boost::thread_specific_ptr< std::vector<double> > irBuffer;
+	/**snapshots of the sensors, published by readSensors()*/
+	SensorFrameBuffer frameBuffer;
 	//LED stuff
 	bool allLEDsOn;
-	double LEDFlashFrequency;
+	/**the TimerWheel task flashing the LEDs, or -1 if they aren't flashing*/
+	int flashTask;
 	double startTime;
 
 
@@ -69,15 +77,33 @@ public:
 	 * */
 	double getBatteryVolts(void);
 
+	/**
+	 * Copies the latest snapshot of the robot's sensors, which is published each time the sensors are read.
+	 * Doesn't lock or ask Player for anything.
+	 * @param frame where the snapshot is copied.
+	 * @see EPuck#SensorFrame
+	 * */
+	void getSensorFrame(SensorFrame &frame);
+
+	/**
+	 * BLOCKS until there is a sensor frame newer than the one given, then copies it into frame.
+	 * @param frame the last frame the caller had, which is replaced with the new one.
+	 * @see EPuck#SensorFrame
+	 * */
+	void waitForSensorFrame(SensorFrame &frame);
+
 	//==================== IR methods =========================================
 	/**
 		Gives the IR readings as an array of length returned by {@link #getNumberOfIRs getNumberOfIRs} class.
+		These are the readings from the last time the sensors were read. The array belongs to the calling thread and is only
+		overwritten when that thread calls getIRReadings() on this robot again, so it is safe to use while another thread
+		reads the sensors.
 		@return The returned ranges for each IR sensor, these are normalised to be given in metres.
 	 */
 	double* getIRReadings(void);
 
 	/**
-		Gives the IR reading of a particular IR sensor.
+		Gives the IR reading of a particular IR sensor, from the last time the sensors were read.
 		@param index The index of the sensor you want to measure. This will be a number between 0 and value returned by {@link #getNumberOfIRs getNumberOfIRs} - 1.
 		@return The range returned by the specified IR sensor, normalised to be given in metres.
 	 */
@@ -116,6 +142,16 @@ public:
 	 * */
 	EPuck::Blob getBlob(int index);
 
+	/**
+	 * Gets the blobs in the latest sensor frame that get through a filter, all from the same camera image. Only the first
+	 * SensorFrame::MAX_BLOBS blobs the camera saw are in the frame.
+	 * @param blobs where the blobs are put. Anything already in it is removed.
+	 * @param filter which blobs to get. Leave this out to get them all.
+	 * @returns the number of blobs put in blobs.
+	 * @see EPuck#getBlobs
+	 * */
+	int getBlobs(std::vector<Blob> &blobs, const BlobFilter &filter = BlobFilter());
+
 	//==================== motor control methods ================================
 
 	/**
@@ -203,6 +239,14 @@ public:
 	 * */
 	std::vector<Tone> listenForTones(void);
 
+	/**
+	 * Listens for any sounds in the audio environment and copies them into the vector provided.
+	 * Audio is not supported on the real robots yet, so the vector will be left empty.
+	 * @param tones where the tones the robot can hear are stored.
+	 * @returns the number of tones the robot can hear, -1 if unsuccessful.
+	 * */
+	int listenForTones(std::vector<Tone> &tones);
+
 
 #if DEBUGGING == 1
 	void printLocation_TEST(void);
@@ -212,30 +256,20 @@ public:
 
 protected:
 
-	pthread_t readSensorsThread;
+	/**How long the sensor thread waits for data before checking if it has been stopped, in milliseconds.*/
+	static const int SENSOR_PEEK_TIMEOUT = 100;
+	boost::thread readSensorsThread;
 
 	/**
-	Reads the robot's sensors but is threadable.
+	Reads the robot's sensors each time Player sends new data. Run in readSensorsThread.
 	*/
 	void readSensorsThreaded(void);
-	static void *startReadSensorThread(void *obj)
-	{
-		//All we do here is call the readSensorsThreaded() function
-		reinterpret_cast<EPuckReal *>(obj)->readSensorsThreaded();
-		return NULL;
-	}
 
-	pthread_t flashLEDsThread;
 	/**
-	Reads the robot's sensors but is threadable.
+	Converts a blob from the blobfinder proxy into a Blob.
 	*/
-	void flashLEDsThreaded(void);
-	static void *startFlashLEDsThread(void *obj)
-	{
-		//All we do here is call the readSensorsThreaded() function
-		reinterpret_cast<EPuckReal *>(obj)->flashLEDsThreaded();
-		return NULL;
-	}
+	static Blob convertBlob(const player_blobfinder_blob_t &blob);
+
 
 
 private:
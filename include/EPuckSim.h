@@ -6,9 +6,15 @@
 #include <time.h>*/
 #include <boost/thread/thread.hpp>
 #include <boost/thread/mutex.hpp>
+#include <boost/thread/tss.hpp>
 
 #include "libplayerc++/playerc++.h"
 #include "AudioHandler.h"
+#include "SimulationClock.h"
+#include "PoseCache.h"
+#include "ConnectionManager.h"
+#include "TimerWheel.h"
+#include "SensorFrameBuffer.h"
 #include "EPuck.h"
 
 
@@ -44,6 +50,8 @@ public:
 
 	/**The Player/Stage port that this robot uses to get simulation information*/
 	int port;
+	/**The index of this robot's proxies on its port. Robots served on the same port share one connection.*/
+	int index;
 	/**The name given to this robot in the player/Stage configuration file and world file.*/
 	char name[32];
 
@@ -57,19 +65,40 @@ protected:
 	PlayerCc::RangerProxy		*rangerProxy;	//rangers
 	PlayerCc::BlobfinderProxy	*blobProxy;		//camera
 	PlayerCc::SimulationProxy	*simProxy;		//leds
+	SimulationClock				*clock;			//simulated time
+	PoseCache					*poses;			//robot positions
 
-	/**array containing the IR readings from the EPuck*/
-	double irReadings[8];
+	/**each thread's copy of the IR readings, filled from the latest frame by getIRReadings()*/
+	boost::thread_specific_ptr< std::vector<double> > irBuffer;
+	/**snapshots of the sensors, published by readSensors()*/
+	SensorFrameBuffer frameBuffer;
 	//LED stuff
 	bool allLEDsOn;
-	//double LEDFlashFrequency;
+	/**the TimerWheel task flashing the LEDs, or -1 if they aren't flashing*/
+	int flashTask;
+
+	//actuator command cache. allLEDsOn is the LED state the user asked for.
+	/**the motor speeds the user asked for*/
+	double commandForward, commandTurnrate;
+	/**the motor speeds and LED state last sent to the simulation*/
+	double sentForward, sentTurnrate;
+	bool sentLEDsOn;
+	/**false until the motors or LEDs have been sent once, so the first command always goes*/
+	bool motorsSent, ledsSent;
+	bool coalesceCommands;
+	/**number of actuator calls the user has made, and number of requests actually sent to the simulation*/
+	int commandsRequested, commandsSent;
+	/**protects the commands the user asked for, allLEDsOn (which the flashing LEDs change from the TimerWheel thread),
+	coalesceCommands and commandsRequested. Never held while talking to Player.*/
+	boost::mutex commandMutex;
+	/**held while the commands are sent so only one thread sends at a time. Protects the sent values and commandsSent.*/
+	boost::mutex sendMutex;
 
 	//audio stuff
 	AudioHandler *handler;
 	bool audioInitialised;
 	//Tone *toneArray;
 	//int numberOfTones;
-	boost::mutex listeningMutex;	//listening deletes toneArray and if 2 funcs access it at once segfaults happen.
 
 	//robot also supports power, aio and blinkenlight proxies
 	//as far as I can tell, stage does not support these
@@ -79,6 +108,7 @@ public:
 	EPuckSim(char* robotName);
 	EPuckSim(char* robotName, int robotPort);
 	EPuckSim(char* robotName, int robotPort, int simulationPort);
+	EPuckSim(char* robotName, int robotPort, int simulationPort, int robotIndex);
 	~EPuckSim(void);
 
 	/**
@@ -104,7 +134,7 @@ public:
 	 * */
 	double getTime(void);
 
-	/**Waits the provided number of milliseconds and BLOCKS while doing so*/
+	/**Waits the provided number of milliseconds of simulated time and BLOCKS while doing so*/
 	void waitMilliseconds(int timeMs);
 
 
@@ -133,15 +163,44 @@ public:
 	void setPosition(double x, double y, double yaw);
 
 
+	/**
+	 * Copies the latest snapshot of the robot's sensors, which is published each time the sensors are read.
+	 * Doesn't lock or ask Player for anything.
+	 * @param frame where the snapshot is copied.
+	 * @see EPuck#SensorFrame
+	 * */
+	void getSensorFrame(SensorFrame &frame);
+
+	/**
+	 * BLOCKS until there is a sensor frame newer than the one given, then copies it into frame.
+	 * @param frame the last frame the caller had, which is replaced with the new one.
+	 * @see EPuck#SensorFrame
+	 * */
+	void waitForSensorFrame(SensorFrame &frame);
+
+	/**
+	 * Starts a thread that reads the robot's sensors whenever Player sends new data, so that there is always a fresh
+	 * {@link EPuck#SensorFrame SensorFrame} without calling readSensors(). The thread sleeps until data arrives.
+	 * */
+	void startSensorThread(void);
+
+	/**
+	 * Stops the thread started by startSensorThread().
+	 * */
+	void stopSensorThread(void);
+
 	//==================== IR methods =========================================
 	/**
 		Gives the IR readings as an array of length returned by {@link #getNumberOfIRs getNumberOfIRs} class.
+		These are the readings from the last time the sensors were read. The array belongs to the calling thread and is only
+		overwritten when that thread calls getIRReadings() on this robot again, so it is safe to use while another thread
+		reads the sensors.
 		@return The returned ranges for each IR sensor, these are normalised to be given in metres.
 	 */
 	double* getIRReadings(void);
 
 	/**
-		Gives the IR reading of a particular IR sensor.
+		Gives the IR reading of a particular IR sensor, from the last time the sensors were read.
 		@param index The index of the sensor you want to measure. This will be a number between 0 and value returned by {@link #getNumberOfIRs getNumberOfIRs} - 1.
 		@return The range returned by the specified IR sensor, normalised to be given in metres.
 	 */
@@ -180,6 +239,16 @@ public:
 	 * */
 	EPuck::Blob getBlob(int index);
 
+	/**
+	 * Gets the blobs in the latest sensor frame that get through a filter, all from the same camera image. Only the first
+	 * SensorFrame::MAX_BLOBS blobs the camera saw are in the frame.
+	 * @param blobs where the blobs are put. Anything already in it is removed.
+	 * @param filter which blobs to get. Leave this out to get them all.
+	 * @returns the number of blobs put in blobs.
+	 * @see EPuck#getBlobs
+	 * */
+	int getBlobs(std::vector<Blob> &blobs, const BlobFilter &filter = BlobFilter());
+
 	//==================== motor control methods ================================
 
 	/**
@@ -231,7 +300,8 @@ public:
 	void setLED(int index, int state);
 
 	/**
-	 * Flashes the LEDs at the requested frequency.
+	 * Flashes the LEDs at the requested frequency. Each change is sent to the simulation by the next readSensors() or
+	 * flushCommands().
 	 * @param frequency the frequency in Hz at which the LEDs should flash.
 	 * */
 	void flashLEDs(double frequency);
@@ -241,6 +311,31 @@ public:
 	 * */
 	void stopFlashLEDs(void);
 
+	//==================== actuator command cache ==================================
+
+	/**
+	 * Sets whether motor and LED commands are coalesced. The motor speeds and LED state are only ever sent to the simulation
+	 * when they have changed. With coalescing off (the default) each change is sent straight away, by the thread that made it.
+	 * With coalescing on they are held until flushCommands() or readSensors() is called, so if they are set several times
+	 * in between only the last setting is sent. SwarmScheduler calls flushCommands() after each controller step, so each
+	 * robot sends at most one set of commands per tick.
+	 * @param coalesce true to coalesce commands, false to send them straight away.
+	 * */
+	void setCommandCoalescing(bool coalesce);
+
+	/**
+	 * Sends any motor or LED commands that are being held back by coalescing now, from the calling thread.
+	 * */
+	void flushCommands(void);
+
+	/**
+	 * Gets how many motor and LED commands have been sent to the simulation, and how many calls to the actuator functions
+	 * didn't need one because nothing had changed or a later call replaced them.
+	 * @param sent where the number of commands sent is stored
+	 * @param suppressed where the number of commands that weren't sent is stored
+	 * */
+	void getCommandCounts(int &sent, int &suppressed);
+
 	//======================== audio methods =================================
 
 	/**
@@ -270,6 +365,26 @@ public:
 	 * */
 	std::vector<Tone> listenForTones(void);
 
+	/**
+	 * Listens for any sounds in the audio environment and copies them into the vector provided.
+	 * The vector is cleared first and keeps its capacity, so if the same vector is passed in every time the robot listens
+	 * then no memory needs to be allocated once it has grown big enough.
+	 * @param tones where the tones the robot can hear are stored.
+	 * @returns the number of tones the robot can hear, -1 if audio is not initialised.
+	 * */
+	int listenForTones(std::vector<Tone> &tones);
+
+	/**
+	 * Listens for sounds for a whole group of robots at once. The audio environment is only locked and scanned once,
+	 * so this is much faster than calling listenForTones on each robot in turn when there are lots of robots.
+	 * All the robots must have had their audio initialised. Robots without audio get an empty vector.
+	 * @param numberRobots the number of robots in the robots array
+	 * @param robots the robots that are listening
+	 * @param tones array of numberRobots vectors. tones[i] is cleared and filled with the tones robots[i] can hear.
+	 * @see #listenForTones
+	 * */
+	static void listenForTones(int numberRobots, EPuckSim **robots, std::vector<Tone> *tones);
+
 
 #if DEBUGGING == 1
 	void printLocation_TEST(void);
@@ -284,16 +399,22 @@ protected:
 	 * @param port the number of the EPuck in the simulation. Eg 6665, 6666, 6667 etc.
 	 * @param name the name of the robot model in the simulation eg robot1, robot2 etc. Maximum 64 chars.
 	 * @param simulationPort the port on which the simulation is running. Get this from the .cfg file of your simulation.
+	 * @param robotIndex the index of the robot's proxies on its port, 0 unless several robots are served on the same port.
 	 * */
-	void initialise(int robotPort, char* robotName, int simulationPort);
+	void initialise(int robotPort, char* robotName, int simulationPort, int robotIndex);
 
 
 
+	/**How long the sensor thread waits for data before checking if it has been stopped, in milliseconds.*/
+	static const int SENSOR_PEEK_TIMEOUT = 100;
 	boost::thread readSensorsThread;
 	void readSensorsThreaded(void);
+	static Blob convertBlob(const player_blobfinder_blob_t &blob);
+
+	bool commandChanged(void);
+	void sendCommands(void);
+	void toggleLEDsThreaded(void);
 
-	boost::thread flashLEDsThread;
-	void flashLEDsThreaded(int ledFlashFrequency);
 
 
 
@@ -0,0 +1,173 @@
+#ifndef HEADLESSWORLD_H_
+#define HEADLESSWORLD_H_
+
+#include <stdio.h>
+#include <math.h>
+#include <string>
+#include <stdint.h>
+#include <vector>
+#include <boost/thread/mutex.hpp>
+#include "EPuck.h"
+#include "AudioHandler.h"
+#include "SimulationClock.h"
+#include "PoseCache.h"
+
+/**
+ * HeadlessWorld is a simple kinematic simulation of e-pucks that runs inside the program instead of in Player/Stage.
+ * There is no GUI and no network traffic, the world only moves on when step() is called, so it can be run thousands of
+ * times faster than real time for big parameter sweeps. Robots in it are controlled with EPuckHeadless.
+ *
+ * It reads the same worldfiles as Stage, but only understands the parts that matter to the e-pucks:<p>
+ * <ul>
+ * <li>"floorplan" models, which load a bitmap of the arena. Dark pixels are obstacles and the bitmap is stretched to the model's size.</li>
+ * <li>"epuck" models, which are the robots. Their name and pose are read.</li>
+ * <li>"interval_sim", the length of each simulation step in milliseconds. Default is 100ms like Stage.</li>
+ * </ul>
+ * Everything else (includes, defines, window etc) is ignored.
+ *
+ * The robots are modelled as discs with differential drive, 8 IR rangers laid out as in the lpuck driver and a blobfinder which sees
+ * the other robots when their LEDs are on, like the red blobfinder in epuck.inc. Each IR ranger is a single ray.
+ * Robots that would hit a wall or another robot don't move that step.
+ *
+ * So that big swarms can be simulated quickly the floorplan is preprocessed into a distance transform, which gives the
+ * distance from each cell to the nearest wall. Rays use it to jump through open space instead of checking every cell,
+ * and the robots are kept in a grid so that each one only checks the robots near it.
+ *
+ * The world drives the SimulationClock and PoseCache, so the AudioHandler works the same as it does with Stage.
+ * Because these are shared by the whole program a program can only run one HeadlessWorld, and can't also use EPuckSim.
+ * @see EPuckHeadless
+ * */
+class HeadlessWorld
+{
+public:
+	/**Length of a simulation step in seconds, unless the worldfile gives interval_sim.*/
+	static const double DEFAULT_INTERVAL = 0.1;
+	/**Number of IR rangers on each robot*/
+	static const int NUMBER_OF_IRS = 8;
+	/**Width of the camera image in pixels*/
+	static const int CAMERA_WIDTH = 640;
+	/**Height of the camera image in pixels*/
+	static const int CAMERA_HEIGHT = 480;
+
+	HeadlessWorld(void);
+	HeadlessWorld(const char* worldfile);
+	virtual ~HeadlessWorld();
+
+	void step(void);
+	void step(int numberSteps);
+	double getTime(void);
+	double getInterval(void);
+	void setInterval(double seconds);
+
+	int addRobot(const char* name, double x, double y, double yaw);
+	int findRobot(const char* name);
+	int getNumberOfRobots(void);
+
+	void setSpeed(int robot, double forward, double turnrate);
+	void getPose(int robot, double &x, double &y, double &yaw);
+	void setPose(int robot, double x, double y, double yaw);
+	bool isStalled(int robot);
+
+	void setLEDs(int robot, bool on);
+	bool getLEDs(int robot);
+	void flashLEDs(int robot, double frequency);
+
+	void getIRReadings(int robot, double *ranges);
+	void getAllIRReadings(std::vector<double> &ranges);
+	int getBlobs(int robot, std::vector<EPuck::Blob> &blobs);
+
+	AudioHandler* getAudioHandler(char* name);
+
+	bool isOccupied(double x, double y);
+
+private:
+	/**A robot in the world*/
+	typedef struct headless_robot
+	{
+		/**name of the model in the worldfile*/
+		char name[32];
+		/**pose of the centre of the robot, in metres and radians*/
+		double x, y, yaw;
+		/**speed the robot has been told to go at, in metres/sec and radians/sec*/
+		double forward, turnrate;
+		/**whether the LEDs are on, which makes the robot visible to blobfinders*/
+		bool ledsOn;
+		/**how often the LEDs toggle, in seconds. 0 if they aren't flashing.*/
+		double flashPeriod;
+		/**simulated time at which the LEDs next toggle*/
+		double nextFlash;
+		/**true if the robot couldn't move last step*/
+		bool stalled;
+	}headless_robot_t;
+
+	/**A sensor's position on the robot, relative to the centre of the robot*/
+	typedef struct sensor_pose
+	{
+		double x, y, yaw;
+	}sensor_pose_t;
+
+	//world state
+	std::vector<headless_robot_t> robots;
+	double currentTime;
+	double interval;
+	/**Protects robots, currentTime and interval.*/
+	boost::mutex worldMutex;
+
+	//occupancy grid loaded from the floorplan bitmap. Row 0 is at the bottom (lowest y) of the map.
+	std::vector<unsigned char> occupancy;
+	/**Distance in metres from the centre of each cell to the centre of the nearest occupied cell.*/
+	std::vector<float> wallDistance;
+	int mapWidth, mapHeight;
+	double mapLeft, mapBottom;
+	double cellWidth, cellHeight;
+	/**Length of the diagonal of a cell. A ray can safely jump the wall distance less this.*/
+	double cellDiagonal;
+
+	//robots bucketed by grid cell, rebuilt when robots have moved. The robots in cell c are
+	//gridRobots[gridStart[c]] to gridRobots[gridStart[c+1]-1], and cells are numbered row by row.
+	std::vector<int> gridStart;
+	std::vector<int> gridRobots;
+	int gridColumns, gridRows;
+	double gridLeft, gridBottom, gridCellSize;
+	bool robotGridDirty;
+	/**Scratch space for the robots near the one being looked at.*/
+	std::vector<int> nearbyRobots;
+
+	/**cos and sin of the IR headings, so the rays can be turned without calling trig functions.*/
+	double irCos[NUMBER_OF_IRS], irSin[NUMBER_OF_IRS];
+
+	//shared with the rest of the API
+	SimulationClock *clock;
+	PoseCache *poses;
+	AudioHandler *audio;
+
+	static const double ROBOT_RADIUS = 0.035;
+	static const double IR_MIN_RANGE = 0.0064;
+	static const double IR_MAX_RANGE = 0.1;
+	static const double CAMERA_FOV = M_PI/3;
+	static const double CAMERA_RANGE = 12.0;
+	static const double ROBOT_HEIGHT = 0.045;
+	static const uint32_t LED_COLOUR = 0xFFFF0000;
+	/**Smallest size of a robot grid cell. Cells are at least IR_MAX_RANGE + 2*ROBOT_RADIUS across so that every robot an IR
+	could see is in the 3x3 cells round a robot.*/
+	static const double ROBOT_GRID_SIZE = 0.17;
+	static const sensor_pose_t irPoses[NUMBER_OF_IRS];
+
+	void initialise(void);
+	int loadWorldfile(const char* worldfile);
+	int loadBitmap(const char* filename, double width, double height, double centreX, double centreY);
+	void buildDistanceTransform(void);
+	void publishTime(void);
+
+	void buildRobotGrid(void);
+	void findNearbyRobots(double x, double y);
+
+	bool collides(int robot, double x, double y);
+	bool isCellOccupied(int cellX, int cellY);
+	double distanceToWall(double x, double y);
+	void computeIRReadings(int robot, double *ranges);
+	double castRay(double x, double y, double dx, double dy, double maxRange);
+	static double normaliseAngle(double angle);
+};
+
+#endif /* HEADLESSWORLD_H_ */
@@ -0,0 +1,109 @@
+#ifndef INSTRUMENTEDEPUCK_H
+#define INSTRUMENTEDEPUCK_H
+
+#include <stdio.h>
+#include <vector>
+#include "EPuck.h"
+#include "LatencyHistogram.h"
+
+
+/**
+Wraps any EPuck and times every call made to it, to find out which calls are slow. Each method of the EPuck interface has its
+own LatencyHistogram, which counts the calls and how long they took. The calls are passed straight on to the wrapped robot,
+so an InstrumentedEPuck can be used anywhere the robot was.
+
+An example of timing the calls made to a simulated robot:<br>
+<code>EPuck *robot = new InstrumentedEPuck(new EPuckSim("robot1"), "robot1");<br>
+...<br>
+((InstrumentedEPuck*)robot)->printStatistics(stdout);</code>
+
+Recording a call doesn't lock, so this can be used on robots that are called from more than one thread, and the statistics
+can be printed from another thread while the robot is running. Timing a call adds about as long as two reads of the clock.
+@see LatencyHistogram
+@see EPuck
+ */
+class InstrumentedEPuck : public EPuck
+{
+public:
+	/**The methods that are timed. Used to index the histograms.*/
+	typedef enum epuck_method
+	{
+		READ_SENSORS, GET_TIME, GET_BATTERY_VOLTS, GET_SENSOR_FRAME, WAIT_FOR_SENSOR_FRAME,
+		GET_IR_READINGS, GET_IR_READING, GET_NUMBER_OF_IRS,
+		GET_CAMERA_WIDTH, GET_CAMERA_HEIGHT, GET_NUMBER_BLOBS, GET_BLOB, GET_BLOBS,
+		SET_MOTORS, SET_DIFFERENTIAL_MOTORS,
+		SET_ALL_LEDS_ON, SET_ALL_LEDS_OFF, TOGGLE_ALL_LEDS, SET_LED, FLASH_LEDS, STOP_FLASH_LEDS,
+		INITIALISE_AUDIO, PLAY_TONE, LISTEN_FOR_TONES, LISTEN_FOR_TONES_VECTOR,
+		NUMBER_OF_METHODS
+	}epuck_method_t;
+
+	/**Names of the methods, in the same order as epuck_method_t*/
+	static const char* METHOD_NAMES[NUMBER_OF_METHODS];
+
+protected:
+	/**The robot whose calls are timed*/
+	EPuck *robot;
+	/**Name used for the robot when the statistics are printed*/
+	char name[32];
+	LatencyHistogram histograms[NUMBER_OF_METHODS];
+
+public:
+
+	InstrumentedEPuck(EPuck *wrappedRobot, const char *robotName);
+	~InstrumentedEPuck(void);
+
+	EPuck* getRobot(void);
+	LatencyHistogram* getHistogram(epuck_method_t method);
+	void resetStatistics(void);
+	void printStatistics(FILE *file);
+	void printStatisticsJSON(FILE *file);
+
+	void readSensors(void);
+	double getTime(void);
+	double getBatteryVolts(void);
+	void getSensorFrame(SensorFrame &frame);
+	void waitForSensorFrame(SensorFrame &frame);
+
+	double* getIRReadings(void);
+	double getIRReading(int index);
+	int getNumberOfIRs(void);
+
+	int getCameraWidth(void);
+	int getCameraHeight(void);
+	int getNumberBlobs(void);
+	Blob getBlob(int index);
+	int getBlobs(std::vector<Blob> &blobs, const BlobFilter &filter = BlobFilter());
+
+	void setMotors(double forward, double turnrate);
+	void setDifferentialMotors(double left, double right);
+
+	void setAllLEDsOn(void);
+	void setAllLEDsOff(void);
+	void toggleAllLEDs(void);
+	void setLED(int index, int state);
+	void flashLEDs(double frequency);
+	void stopFlashLEDs(void);
+
+	int initaliseAudio(void);
+	int playTone(int frequency, double duration);
+	std::vector<Tone> listenForTones(void);
+	int listenForTones(std::vector<Tone> &tones);
+
+private:
+	/**
+	Times a call from when it is made to when it goes out of scope, and records it in a histogram.
+	*/
+	class CallTimer
+	{
+	public:
+		CallTimer(LatencyHistogram &histogram);
+		~CallTimer(void);
+	private:
+		LatencyHistogram &histogram;
+		uint64_t start;
+	};
+
+	static uint64_t getNanoseconds(void);
+};
+
+#endif
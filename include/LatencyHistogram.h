@@ -0,0 +1,50 @@
+#ifndef LATENCYHISTOGRAM_H_
+#define LATENCYHISTOGRAM_H_
+
+#include <stdint.h>
+
+/**
+ * LatencyHistogram counts how long something took, eg a call to the robot, in buckets that get wider as the times get
+ * longer, in the way HdrHistogram does. Times are split by their highest set bit and then into SUB_BUCKETS/2 equal
+ * buckets below that, so every bucket is within about 6% of the times in it, from 1 nanosecond up to about half an hour,
+ * in a fixed amount of memory.
+ *
+ * Recording a time doesn't lock, it only uses atomic adds, so any number of threads can record into one histogram and a
+ * thread can read it while they do. The percentiles read while times are being recorded may be a few calls behind.
+ * @see InstrumentedEPuck
+ * */
+class LatencyHistogram
+{
+public:
+	/**Number of bits of each time that are kept*/
+	static const int SUB_BUCKET_BITS = 5;
+	/**Number of buckets for times below 2^SUB_BUCKET_BITS ns, which are recorded exactly*/
+	static const int SUB_BUCKETS = 1 << SUB_BUCKET_BITS;
+	/**Times with more bits than this, about 37 minutes in nanoseconds, are counted as the longest time there is a bucket for*/
+	static const int MAX_BITS = 41;
+	static const int NUMBER_OF_BUCKETS = (MAX_BITS - SUB_BUCKET_BITS + 1)*(SUB_BUCKETS/2) + SUB_BUCKETS/2;
+
+	LatencyHistogram(void);
+	virtual ~LatencyHistogram();
+
+	void record(uint64_t nanoseconds);
+	void reset(void);
+
+	uint64_t getCount(void);
+	double getMean(void);
+	uint64_t getMin(void);
+	uint64_t getMax(void);
+	uint64_t getPercentile(double percentile);
+
+private:
+	volatile uint64_t counts[NUMBER_OF_BUCKETS];
+	volatile uint64_t totalCount;
+	volatile uint64_t totalNanoseconds;
+	volatile uint64_t minNanoseconds;
+	volatile uint64_t maxNanoseconds;
+
+	static int getBucket(uint64_t nanoseconds);
+	static uint64_t getBucketTop(int bucket);
+};
+
+#endif /* LATENCYHISTOGRAM_H_ */
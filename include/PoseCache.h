@@ -0,0 +1,77 @@
+#ifndef POSECACHE_H_
+#define POSECACHE_H_
+
+#include <stdio.h>
+#include <map>
+#include <string>
+#include "libplayerc++/playerc++.h"
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/thread.hpp>
+#include "SimulationClock.h"
+
+/**
+ * PoseCache keeps a copy of where every robot in the simulation is, so that finding out where a robot is doesn't need a
+ * blocking request to the Player server. Once per simulation step a single thread asks the simulation for the pose of every
+ * model it knows about, and everything else reads the stored poses from memory.
+ *
+ * A model is added to the cache the first time its pose is asked for (or when it is registered), and from then on it is
+ * refreshed every step. Each pose is stamped with the simulated time it was read at. A refresh doesn't overwrite a pose that
+ * setPose() changed while the refresh was reading the simulation.
+ *
+ * The PoseCache code is not intended to be user facing, the user interacts with it using the EPuck API.
+ *
+ * There is one cache per simulation, like SimulationClock, shared by every robot in it. GetPoseCache() makes the cache the
+ * first time it is given a SimulationProxy and returns the same cache for that proxy after that.
+ *
+ * If the cache is made without a SimulationProxy it never asks for poses, instead the simulation running in this process
+ * (eg HeadlessWorld) puts them in using setPose().
+ * @see SimulationClock
+ * */
+class PoseCache
+{
+public:
+	/**The pose of a model in the simulation*/
+	typedef struct model_pose
+	{
+		/**x coordinate of the model, in metres*/
+		double x;
+		/**y coordinate of the model, in metres*/
+		double y;
+		/**yaw of the model, in radians*/
+		double yaw;
+		/**The simulated time, in seconds, that the pose was read at*/
+		double time;
+		/**Goes up by one each time setPose() moves the model, so that a refresh which read the pose before the move doesn't undo it*/
+		unsigned long version;
+	}model_pose_t;
+
+	static PoseCache* GetPoseCache(PlayerCc::SimulationProxy *sim, SimulationClock *simClock);
+	virtual ~PoseCache();
+
+	void registerModel(char* name);
+	double getPose(char* name, double &x, double &y, double &yaw);
+	void setPose(char* name, double x, double y, double yaw);
+
+protected:
+	//protected so there is only one cache per simulation
+	PoseCache(PlayerCc::SimulationProxy *sim, SimulationClock *simClock);
+
+private:
+	/**The latest pose of each model, keyed by the model's name in the worldfile.*/
+	std::map<std::string, model_pose_t> poses;
+	/**Protects poses.*/
+	boost::mutex poseMutex;
+	boost::thread updatePosesThread;
+
+	//player stuff
+	PlayerCc::SimulationProxy	*simProxy;
+	SimulationClock *clock;
+
+	//the cache for each simulation, keyed by its SimulationProxy. NULL is the simulation running in this process.
+	static std::map<PlayerCc::SimulationProxy*, PoseCache*> instances;
+	static boost::mutex instanceMutex;
+
+	void updatePosesThreaded(void);
+};
+
+#endif /* POSECACHE_H_ */
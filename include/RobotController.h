@@ -0,0 +1,28 @@
+#ifndef ROBOTCONTROLLER_H_
+#define ROBOTCONTROLLER_H_
+
+#include "EPuck.h"
+
+/**
+ * A robot controller that is run by a SwarmScheduler. Instead of writing a while(true) loop for each robot, put the body
+ * of the loop in step() and give the controller and its robot to the scheduler, which calls step() once per tick.
+ *
+ * By the time step() is called the scheduler has already called readSensors() on the robot, so step() should just use
+ * the readings the robot already has and then set the motors, LEDs etc. step() is called from one of the scheduler's
+ * threads so it shouldn't block, and anything it shares with other controllers must be protected.
+ * @see SwarmScheduler
+ * */
+class RobotController
+{
+public:
+	virtual ~RobotController(){}
+
+	/**
+	 * Works out what the robot does this tick, from the sensor readings taken at the start of the tick.
+	 * @param robot the robot to control
+	 * @param tick the number of the tick, counting from 0
+	 * */
+	virtual void step(EPuck *robot, int tick) = 0;
+};
+
+#endif /* ROBOTCONTROLLER_H_ */
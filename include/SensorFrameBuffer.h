@@ -0,0 +1,50 @@
+#ifndef SENSORFRAMEBUFFER_H_
+#define SENSORFRAMEBUFFER_H_
+
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include "EPuck.h"
+
+/**
+ * SensorFrameBuffer passes sensor snapshots from the code that reads a robot's sensors to any number of readers, without
+ * the readers taking a lock or ever seeing half of one frame and half of the next.
+ *
+ * There are two frames. The writer fills in whichever one isn't the latest and then makes it the latest, so readers can
+ * go on copying the latest frame while the next one is written. Each frame has a sequence counter (a seqlock) which is odd
+ * while the frame is being written, and a reader checks the counter is even and hasn't changed either side of its copy.
+ * If it has, the writer has got all the way round to the frame the reader was copying and the reader just copies again.
+ *
+ * Only one thread writes at a time, which is enforced by a mutex that readers never touch.
+ *
+ * Threads that want to know as soon as there is a new frame can block in waitForFrame(), which uses a condition variable
+ * that the writer signals after each frame. Only threads that wait use it, read() still doesn't lock.
+ *
+ * The SensorFrameBuffer code is not intended to be user facing, the user interacts with it using EPuck#getSensorFrame.
+ * @see EPuck#SensorFrame
+ * */
+class SensorFrameBuffer
+{
+public:
+	SensorFrameBuffer(void);
+	virtual ~SensorFrameBuffer();
+
+	void publish(EPuck::SensorFrame &frame);
+	void read(EPuck::SensorFrame &frame);
+	unsigned long getSequence(void);
+	unsigned long waitForFrame(unsigned long lastSequence);
+
+private:
+	EPuck::SensorFrame frames[2];
+	/**Sequence counter for each frame. Odd while the frame is being written.*/
+	volatile unsigned long frameVersions[2];
+	/**Number of frames published, the latest one is frames[published%2].*/
+	volatile unsigned long published;
+	/**Stops two writers publishing at once.*/
+	boost::mutex writeMutex;
+	/**Used with frameArrived by threads waiting for a new frame.*/
+	boost::mutex waitMutex;
+	/**Signalled each time a frame is published.*/
+	boost::condition_variable frameArrived;
+};
+
+#endif /* SENSORFRAMEBUFFER_H_ */
@@ -0,0 +1,86 @@
+#ifndef SIMULATIONCLOCK_H_
+#define SIMULATIONCLOCK_H_
+
+#include <stdio.h>
+#include <stdint.h>
+#include <map>
+#include "libplayerc++/playerc++.h"
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/thread.hpp>
+#include <boost/thread/condition_variable.hpp>
+
+/**
+ * SimulationClock keeps track of the simulated time in Stage so that the rest of the code doesn't have to ask for it.
+ * Asking the simulation for the time is a blocking request to the Player server, and the time only changes once every
+ * simulation step ("interval_sim" in the worldfile) anyway. So instead a single thread asks for the time and everything
+ * else reads the stored value from memory, or waits on a condition variable for it to reach the time they want.
+ *
+ * The thread times its requests to the simulation steps. It learns how long a step takes in real time from the steps it
+ * has seen, and sleeps until the next one is due rather than asking every poll interval. If the step doesn't come when
+ * expected (the simulation is paused or slowed down) it asks again after 1 ms, then 2 ms and so on up to the poll interval.
+ * The time is not extrapolated between steps, as Stage only moves its models once per step.
+ *
+ * The SimulationClock code is not intended to be user facing, the user interacts with it using the EPuck API.
+ *
+ * There is one clock per simulation, shared by every robot in it. GetSimulationClock() makes the clock the first time it is
+ * given a SimulationProxy and returns the same clock for that proxy after that. ConnectionManager gives out one proxy per
+ * simulation port, so robots on different simulation ports get different clocks.
+ *
+ * If the clock is made without a SimulationProxy it doesn't ask anything for the time, instead the simulation running in this
+ * process (eg HeadlessWorld) moves it on using setTime().
+ * @see AudioHandler
+ * */
+class SimulationClock
+{
+public:
+	/**How often, in milliseconds of real time, the clock asks the simulation for the time by default when it doesn't know when the next step is due.*/
+	static const int defaultPollInterval = 10;
+	/**How soon, in milliseconds of real time, the clock asks again when a step it expected hasn't happened yet.*/
+	static const int minPollInterval = 1;
+
+	static SimulationClock* GetSimulationClock(PlayerCc::SimulationProxy *sim, char* name);
+	virtual ~SimulationClock();
+
+	double getTime(void);
+	void waitUntil(double simTime);
+	double waitForNextStep(double lastTime);
+	void waitSeconds(double seconds);
+
+	void setPollInterval(int milliseconds);
+	void setTime(double simTime);
+
+protected:
+	//protected so there is only one clock per simulation
+	SimulationClock(PlayerCc::SimulationProxy *sim, char* name);
+
+private:
+	/**The simulated time, in seconds, the last time the simulation was asked.*/
+	double currentTime;
+	/**Longest the clock waits between asking the simulation for the time, in milliseconds of real time.*/
+	int pollInterval;
+	/**The smallest change in simulated time seen so far, taken to be one simulation step. 0 until the time has changed.*/
+	double stepInterval;
+	/**Average real time, in seconds, that one simulation step takes. 0 until it has been measured.*/
+	double realTimePerStep;
+
+	/**Protects currentTime.*/
+	boost::mutex timeMutex;
+	/**Signalled whenever currentTime changes.*/
+	boost::condition_variable timeChanged;
+	boost::thread updateTimeThread;
+
+	//player stuff
+	PlayerCc::SimulationProxy	*simProxy;
+	char aRobotName[32];
+
+	//the clock for each simulation, keyed by its SimulationProxy. NULL is the simulation running in this process.
+	static std::map<PlayerCc::SimulationProxy*, SimulationClock*> instances;
+	static boost::mutex instanceMutex;
+
+	void updateTimeThreaded(void);
+
+	double readSimulationTime(void);
+	static double getRealTime(void);
+};
+
+#endif /* SIMULATIONCLOCK_H_ */
@@ -0,0 +1,120 @@
+#ifndef SWARMSCHEDULER_H_
+#define SWARMSCHEDULER_H_
+
+#include <stdio.h>
+#include <vector>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/thread.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include "EPuck.h"
+#include "RobotController.h"
+
+/**
+ * SwarmScheduler runs the controllers for a lot of robots at once, using a pool of threads so that every core is used.
+ * Each robot is given a RobotController and the scheduler runs them all in lockstep ticks. In each tick:<p>
+ * <ol>
+ * <li>readSensors() is called on every robot.</li>
+ * <li>once every robot has read its sensors, every controller's step() is called, which sets the motors, LEDs etc.</li>
+ * <li>once every controller has finished the tick is over.</li>
+ * </ol>
+ * So all the sensor readings for a tick are taken before any robot moves, and no robot starts the next tick early.
+ *
+ * The robots are shared out between the threads at the start of each half of a tick. A thread that runs out of robots takes
+ * half of the robots another thread has left, so one slow robot doesn't hold up the robots after it.
+ *
+ * An example of running a swarm at 10 ticks a second for a minute:<br>
+ * <code>SwarmScheduler scheduler;<br>
+ * for(i=0; i<200; i++) scheduler.addRobot(robots[i], controllers[i]);<br>
+ * scheduler.run(600, 0.1);<br>
+ * scheduler.printStatistics();</code>
+ *
+ * With a HeadlessWorld call tick() and step the world in between instead of using run().
+ * @see RobotController
+ * */
+class SwarmScheduler
+{
+public:
+	/**How long the ticks took, in seconds of real time.*/
+	typedef struct scheduler_statistics
+	{
+		/**Number of ticks run since the statistics were last reset.*/
+		int ticks;
+		/**Time from the start of a tick to when every controller had finished it.*/
+		double meanLatency, maxLatency, latencyStandardDeviation;
+		/**How late each tick started compared to when run() meant to start it. Only ticks started by run() count.*/
+		double meanJitter, maxJitter;
+	}scheduler_statistics_t;
+
+	SwarmScheduler(void);
+	SwarmScheduler(int numberThreads);
+	virtual ~SwarmScheduler();
+
+	int addRobot(EPuck *robot, RobotController *controller);
+	int getNumberOfRobots(void);
+	int getNumberOfThreads(void);
+
+	void tick(void);
+	void run(int numberTicks, double period);
+	void stop(void);
+
+	scheduler_statistics_t getStatistics(void);
+	void resetStatistics(void);
+	void printStatistics(void);
+
+private:
+	/**The two halves of a tick.*/
+	enum tick_phase {SENSE_PHASE, CONTROL_PHASE};
+
+	/**A robot and the controller that drives it.*/
+	typedef struct robot_task
+	{
+		EPuck *robot;
+		RobotController *controller;
+	}robot_task_t;
+
+	/**The robots a thread has still to do this phase, robots next to end-1. Other threads take from the end.*/
+	typedef struct worker_queue
+	{
+		int next, end;
+		boost::mutex queueMutex;
+	}worker_queue_t;
+
+	std::vector<robot_task_t> tasks;
+	std::vector<worker_queue_t*> queues;
+	boost::thread_group workers;
+
+	//tick state, protected by phaseMutex
+	tick_phase phase;
+	/**Which tick the controllers are on.*/
+	int tickNumber;
+	/**Goes up each time a phase starts, which is how the threads know to start work.*/
+	int phaseGeneration;
+	/**Number of threads that have finished the current phase.*/
+	int finishedWorkers;
+	bool shuttingDown;
+	boost::mutex phaseMutex;
+	/**Signalled when a phase starts.*/
+	boost::condition_variable phaseStarted;
+	/**Signalled when the last thread finishes a phase.*/
+	boost::condition_variable phaseFinished;
+
+	/**Set by stop() to make run() return.*/
+	bool stopRequested;
+	boost::mutex stopMutex;
+
+	//statistics, protected by statisticsMutex
+	int tickCount, jitterTicks;
+	double latencySum, latencySquaredSum, latencyMax;
+	double jitterSum, jitterMax;
+	boost::mutex statisticsMutex;
+
+	void initialise(int numberThreads);
+	void runPhase(tick_phase tickPhase);
+	void workerThread(int worker);
+	bool takeTask(int worker, int &task);
+	void runTask(int task);
+	void recordTick(double latency, double jitter, bool timed);
+	static double getRealTime(void);
+};
+
+#endif /* SWARMSCHEDULER_H_ */
@@ -0,0 +1,109 @@
+#ifndef TIMERWHEEL_H_
+#define TIMERWHEEL_H_
+
+#include <stdio.h>
+#include <stdint.h>
+#include <map>
+#include <vector>
+#include <boost/function.hpp>
+#include <boost/bind.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/thread.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include "SimulationClock.h"
+
+/**
+ * TimerWheel runs periodic tasks, such as flashing LEDs or playing a tone every few seconds, for every robot in the program
+ * from one thread. Before this each robot started its own thread for each of these which slept between goes, so a big swarm
+ * had hundreds of threads doing very little.
+ *
+ * Time is split into ticks of RESOLUTION seconds and the tasks are kept in a hierarchical timing wheel: NUMBER_OF_LEVELS
+ * wheels of SLOTS_PER_LEVEL slots, where each slot of one wheel covers a whole turn of the wheel below it. A task goes in the
+ * slot for the tick it is due, or if that is too far off in the slot of a higher wheel, and is moved down a wheel each time
+ * the wheel below comes round. So adding, cancelling and running a task take the same time however many tasks there are.
+ *
+ * There is one wheel that follows real time, for real robots. Each simulation has another that follows its SimulationClock,
+ * so simulated robots flash and beep in simulated time however fast the simulation is going. Each wheel has one thread.
+ *
+ * The tasks are run in the wheel's thread, so they should be quick and not block. A task can schedule or cancel tasks.
+ *
+ * The TimerWheel code is not intended to be user facing, the user interacts with it using the EPuck API.
+ *
+ * The wheels are got with GetRealTimeWheel() and GetSimulationWheel(), which make them the first time they are asked for.
+ * @see SimulationClock
+ * */
+class TimerWheel
+{
+public:
+	/**A task run by the wheel. Make these with boost::bind.*/
+	typedef boost::function<void (void)> timer_action_t;
+
+	/**Length of a tick of the wheel in seconds. Tasks are run on the first tick at or after they are due.*/
+	static const double RESOLUTION = 0.01;
+	/**Number of bits of the tick number each level of the wheel covers.*/
+	static const int LEVEL_BITS = 6;
+	/**Number of slots in each level of the wheel.*/
+	static const int SLOTS_PER_LEVEL = 1 << LEVEL_BITS;
+	/**Number of levels. With 10ms ticks, 4 levels of 64 slots covers about 46 hours, and tasks further off than that are moved down when the top level comes round.*/
+	static const int NUMBER_OF_LEVELS = 4;
+
+	static TimerWheel* GetRealTimeWheel(void);
+	static TimerWheel* GetSimulationWheel(SimulationClock *clock);
+	virtual ~TimerWheel();
+
+	int schedule(timer_action_t action, double period);
+	int schedule(timer_action_t action, double period, double delay);
+	void cancel(int task);
+
+	double getTime(void);
+	int getNumberOfTasks(void);
+
+protected:
+	//protected so the wheels are only made by GetRealTimeWheel() and GetSimulationWheel()
+	TimerWheel(SimulationClock *simulationClock);
+
+private:
+	/**A task in the wheel.*/
+	typedef struct timer_task
+	{
+		timer_action_t action;
+		/**How often the task runs, in ticks. 0 if it only runs once.*/
+		int64_t period;
+		/**The tick the task is next due on.*/
+		int64_t due;
+	}timer_task_t;
+
+	/**The tasks, keyed by the number schedule() gave them. A task that has been cancelled is taken out of here but left in its slot, and is ignored when the slot comes round.*/
+	std::map<int, timer_task_t> tasks;
+	/**The slots of every level, level 0 first. Each slot holds the numbers of the tasks in it.*/
+	std::vector< std::vector<int> > slots;
+	/**The last tick that has been run.*/
+	int64_t currentTick;
+	int nextTaskNumber;
+
+	/**The task being run, or -1. Tasks run without the lock held so cancel() has to wait for this.*/
+	int runningTask;
+	/**Signalled each time a task finishes running.*/
+	boost::condition_variable taskFinished;
+	/**Protects everything above.*/
+	boost::mutex wheelMutex;
+
+	/**Where the time comes from. NULL for the real time wheel.*/
+	SimulationClock *clock;
+	/**Real time when the real time wheel was made.*/
+	boost::system_time startTime;
+	boost::thread wheelThread;
+
+	//the real time wheel, and the wheel for each simulation keyed by its clock.
+	static TimerWheel* _realTimeInstance;
+	static std::map<SimulationClock*, TimerWheel*> simulationInstances;
+	static boost::mutex instanceMutex;
+
+	void wheelThreaded(void);
+	void advanceTo(int64_t tick);
+	void insertTask(int task, int64_t due);
+	void cascade(int level);
+	int64_t toTicks(double seconds);
+};
+
+#endif /* TIMERWHEEL_H_ */
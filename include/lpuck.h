@@ -13,6 +13,21 @@ struct image_t
     void *buf;
 };
 
+// one of the buffers the camera driver captures into when streaming, mmap'd into our memory
+struct capture_buffer_t
+{
+    void *start;
+    size_t length;
+};
+
+// how frames are got from the camera
+enum capture_mode_t
+{
+    CAPTURE_STREAMING,	// VIDIOC_DQBUF from a ring of mmap'd buffers, no copy
+    CAPTURE_READ,		// read() into imageFrame.buf
+    CAPTURE_FILE		// camera_device is a file of raw UYVY frames, played in a loop
+};
+
 
 struct cmd_t{
 	int16_t set_motor:1;
@@ -0,0 +1,74 @@
+#ifndef LPUCK_SPI_H_
+#define LPUCK_SPI_H_
+
+#include <stdint.h>
+#include <time.h>
+#include "lpuck.h"
+
+// How the lpuck driver exchanges its txbuf_t/rxbuf_t with the dsPIC. The SPI bus is full duplex,
+// so each transfer sends len 16 bit words and receives the same number back.
+class SPITransport
+{
+public:
+  virtual ~SPITransport() {}
+
+  // returns the number of bytes exchanged, or -1 if the transfer failed
+  virtual int transfer(int16_t *txbuf, int16_t *rxbuf, int16_t len) = 0;
+};
+
+// Opens spi_device: "emulated" gives an EmulatedDsPIC, anything else is a spidev device.
+// Returns NULL if the device can't be opened.
+SPITransport *openSPITransport(const char *device);
+
+
+// The real bus, through the spidev driver
+class SpidevTransport : public SPITransport
+{
+public:
+  SpidevTransport();
+  virtual ~SpidevTransport();
+
+  int open(const char *device);
+  virtual int transfer(int16_t *txbuf, int16_t *rxbuf, int16_t len);
+
+private:
+  int fd;
+};
+
+
+// A software stand-in for the dsPIC, so the driver can be run and benchmarked without a robot.
+//
+// Like the real one it loads its reply before the exchange, so each transfer gets back the state
+// from before the command it carries. Motor commands set the wheel speeds in steps a second, and
+// tacl/tacr count the steps the wheels would have made since, in real time. The IR, ambient light,
+// microphones and accelerometer are made up, slowly varying values with a little noise, and the
+// battery runs down slowly. The one byte shift of the real bus isn't emulated, as the driver
+// doesn't use the dummy word.
+class EmulatedDsPIC : public SPITransport
+{
+public:
+  // fastest the motors go, in steps a second
+  static const int MAX_SPEED = 1000;
+
+  EmulatedDsPIC();
+  virtual ~EmulatedDsPIC();
+
+  virtual int transfer(int16_t *txbuf, int16_t *rxbuf, int16_t len);
+
+  unsigned long getTransfers();
+
+private:
+  void update(const struct timespec *now);
+  void command(const struct txbuf_t *tx);
+  int16_t noise(int amplitude);
+
+  struct rxbuf_t state; // what the next transfer gets back
+  int left_speed, right_speed;
+  double left_steps, right_steps; // whole steps go into tacl/tacr
+  struct led_cmd_t leds;
+  struct timespec start, last;
+  unsigned int seed;
+  unsigned long transfers;
+};
+
+#endif
@@ -0,0 +1,202 @@
+#ifndef YUV422_H_
+#define YUV422_H_
+
+/* YUV 4:2:2 (UYVY) to RGB888 conversion for the lpuck camera frames.
+ *
+ * yuv422_to_rgb_scalar is the original conversion and is the reference: the vector versions give
+ * exactly the same bytes for every input. yuv422_to_rgb picks the fastest one the compiler was
+ * told it can use, NEON on ARM (-mfpu=neon) and SSE2 on x86, and otherwise uses the scalar one.
+ *
+ * All of them work out each channel as (298 * (y-16) + k1 * u' + k2 * v' + 128) >> 8 in 32 bits,
+ * then clip it to 0..255. The vector versions fold the offsets into one constant per channel and
+ * do the clipping with saturating packs, which give the same result as clip().
+ */
+
+#if defined(__ARM_NEON__) || defined(__ARM_NEON)
+#include <arm_neon.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+
+static inline unsigned char clip(int value)
+{
+  if (value < 0)
+    value = 0;
+  else if (value > 255)
+    value = 255;
+  return value;
+}
+
+static inline void yuv422_to_rgb_scalar(const unsigned char *src, unsigned char *dst,
+                                        unsigned int nr_pixels)
+{
+  unsigned int i;
+  int y1, y2, u, v;
+
+  for (i = 0; i < nr_pixels; i += 2)
+  {
+    /* Input format is Cb(i)Y(i)Cr(i)Y(i+1) */
+    u = *src++;
+    y1 = *src++;
+    v = *src++;
+    y2 = *src++;
+    y1 -= 16;
+    u -= 128;
+    v -= 128;
+    y2 -= 16;
+
+    *dst++ = clip(( 298 * y1           + 409 * v + 128) >> 8);
+    *dst++ = clip(( 298 * y1 - 100 * u - 208 * v + 128) >> 8);
+    *dst++ = clip(( 298 * y1 + 516 * u           + 128) >> 8);
+
+    *dst++ = clip(( 298 * y2           + 409 * v + 128) >> 8);
+    *dst++ = clip(( 298 * y2 - 100 * u - 208 * v + 128) >> 8);
+    *dst++ = clip(( 298 * y2 + 516 * u           + 128) >> 8);
+  }
+}
+
+
+#if defined(__ARM_NEON__) || defined(__ARM_NEON)
+
+/* shift the 32 bit sums down and clip them to 0..255 */
+static inline uint8x8_t yuv422_neon_clip(int32x4_t lo, int32x4_t hi)
+{
+  return vqmovun_s16(vcombine_s16(vqshrn_n_s32(lo, 8), vqshrn_n_s32(hi, 8)));
+}
+
+/* one channel of the 8 pixels whose luma is y */
+static inline uint8x8_t yuv422_neon_channel(int16x8_t y, int16x8_t c1, int16_t k1,
+                                            int16x8_t c2, int16_t k2)
+{
+  const int32x4_t round = vdupq_n_s32(128);
+  int32x4_t lo, hi;
+
+  lo = vmull_n_s16(vget_low_s16(y), 298);
+  hi = vmull_n_s16(vget_high_s16(y), 298);
+  lo = vmlal_n_s16(lo, vget_low_s16(c1), k1);
+  hi = vmlal_n_s16(hi, vget_high_s16(c1), k1);
+  lo = vmlal_n_s16(lo, vget_low_s16(c2), k2);
+  hi = vmlal_n_s16(hi, vget_high_s16(c2), k2);
+  return yuv422_neon_clip(vaddq_s32(lo, round), vaddq_s32(hi, round));
+}
+
+/* 16 pixels at a time: vld4 splits the U, Y, V, Y bytes of 8 pixel pairs and vst3 interleaves the RGB */
+static inline void yuv422_to_rgb_neon(const unsigned char *src, unsigned char *dst,
+                                      unsigned int nr_pixels)
+{
+  unsigned int i;
+  uint8x8x4_t in;
+  uint8x16x3_t out;
+  uint8x8x2_t zip;
+  int16x8_t u, y1, v, y2;
+  const int16x8_t zero = vdupq_n_s16(0);
+
+  for (i = 0; i + 16 <= nr_pixels; i += 16)
+  {
+    in = vld4_u8(src);
+    u = vsubq_s16(vreinterpretq_s16_u16(vmovl_u8(in.val[0])), vdupq_n_s16(128));
+    y1 = vsubq_s16(vreinterpretq_s16_u16(vmovl_u8(in.val[1])), vdupq_n_s16(16));
+    v = vsubq_s16(vreinterpretq_s16_u16(vmovl_u8(in.val[2])), vdupq_n_s16(128));
+    y2 = vsubq_s16(vreinterpretq_s16_u16(vmovl_u8(in.val[3])), vdupq_n_s16(16));
+
+    zip = vzip_u8(yuv422_neon_channel(y1, v, 409, zero, 0), yuv422_neon_channel(y2, v, 409, zero, 0));
+    out.val[0] = vcombine_u8(zip.val[0], zip.val[1]);
+    zip = vzip_u8(yuv422_neon_channel(y1, u, -100, v, -208), yuv422_neon_channel(y2, u, -100, v, -208));
+    out.val[1] = vcombine_u8(zip.val[0], zip.val[1]);
+    zip = vzip_u8(yuv422_neon_channel(y1, u, 516, zero, 0), yuv422_neon_channel(y2, u, 516, zero, 0));
+    out.val[2] = vcombine_u8(zip.val[0], zip.val[1]);
+
+    vst3q_u8(dst, out);
+    src += 32;
+    dst += 48;
+  }
+
+  yuv422_to_rgb_scalar(src, dst, nr_pixels - i);
+}
+
+#elif defined(__SSE2__)
+
+/* squeeze 4 pixels of RGBX into 12 bytes of RGB at the bottom of the register */
+static inline __m128i yuv422_sse2_pack_rgb(__m128i rgbx)
+{
+  const __m128i even = _mm_set_epi32(0, 0x00ffffff, 0, 0x00ffffff);
+  const __m128i odd = _mm_set_epi32(0x00ffffff, 0, 0x00ffffff, 0);
+  __m128i pairs;
+
+  // 6 bytes at the bottom of each 64 bit half, then the top half moved down next to the bottom one
+  pairs = _mm_or_si128(_mm_and_si128(rgbx, even), _mm_srli_epi64(_mm_and_si128(rgbx, odd), 8));
+  return _mm_or_si128(_mm_move_epi64(pairs), _mm_slli_si128(_mm_srli_si128(pairs, 8), 6));
+}
+
+/* 8 pixels at a time. Each pixel's U and V are paired with its Y so that pmaddwd does two of the
+ * multiplies and the add for a channel of 4 pixels in one go, in 32 bits. */
+static inline void yuv422_to_rgb_sse2(const unsigned char *src, unsigned char *dst,
+                                      unsigned int nr_pixels)
+{
+  unsigned int i;
+  const __m128i zero = _mm_setzero_si128();
+  // pmaddwd coefficients for (Y, V) or (Y, U) pairs
+  const __m128i r_yv = _mm_set_epi16(409, 298, 409, 298, 409, 298, 409, 298);
+  const __m128i g_yu = _mm_set_epi16(-100, 298, -100, 298, -100, 298, -100, 298);
+  const __m128i g_yv = _mm_set_epi16(-208, 0, -208, 0, -208, 0, -208, 0);
+  const __m128i b_yu = _mm_set_epi16(516, 298, 516, 298, 516, 298, 516, 298);
+  // the -16 and -128 offsets and the +128 rounding of each channel
+  const __m128i r_offset = _mm_set1_epi32(-298 * 16 - 409 * 128 + 128);
+  const __m128i g_offset = _mm_set1_epi32(-298 * 16 + 100 * 128 + 208 * 128 + 128);
+  const __m128i b_offset = _mm_set1_epi32(-298 * 16 - 516 * 128 + 128);
+  __m128i in, half[2], yu, yv, r[2], g[2], b[2], rg, bx, rgb0, rgb1;
+  int h;
+
+  for (i = 0; i + 8 <= nr_pixels; i += 8)
+  {
+    in = _mm_loadu_si128((const __m128i *)src);
+    half[0] = _mm_unpacklo_epi8(in, zero);  // U0 Y0 V0 Y1 U1 Y2 V1 Y3
+    half[1] = _mm_unpackhi_epi8(in, zero);
+
+    for (h = 0; h < 2; h++)
+    {
+      // Y0 U0 Y1 U0 Y2 U1 Y3 U1 and Y0 V0 Y1 V0 Y2 V1 Y3 V1
+      yu = _mm_shufflehi_epi16(_mm_shufflelo_epi16(half[h], _MM_SHUFFLE(0, 3, 0, 1)), _MM_SHUFFLE(0, 3, 0, 1));
+      yv = _mm_shufflehi_epi16(_mm_shufflelo_epi16(half[h], _MM_SHUFFLE(2, 3, 2, 1)), _MM_SHUFFLE(2, 3, 2, 1));
+
+      r[h] = _mm_srai_epi32(_mm_add_epi32(_mm_madd_epi16(yv, r_yv), r_offset), 8);
+      g[h] = _mm_srai_epi32(_mm_add_epi32(_mm_add_epi32(_mm_madd_epi16(yu, g_yu), _mm_madd_epi16(yv, g_yv)), g_offset), 8);
+      b[h] = _mm_srai_epi32(_mm_add_epi32(_mm_madd_epi16(yu, b_yu), b_offset), 8);
+    }
+
+    // packus clips to 0..255, giving R0..R7 G0..G7 and B0..B7
+    rg = _mm_packus_epi16(_mm_packs_epi32(r[0], r[1]), _mm_packs_epi32(g[0], g[1]));
+    bx = _mm_packus_epi16(_mm_packs_epi32(b[0], b[1]), zero);
+
+    // interleave into RGBX and squeeze out the X
+    rg = _mm_unpacklo_epi8(rg, _mm_srli_si128(rg, 8));
+    bx = _mm_unpacklo_epi8(bx, zero);
+    rgb0 = yuv422_sse2_pack_rgb(_mm_unpacklo_epi16(rg, bx));
+    rgb1 = yuv422_sse2_pack_rgb(_mm_unpackhi_epi16(rg, bx));
+
+    _mm_storeu_si128((__m128i *)dst, _mm_or_si128(rgb0, _mm_slli_si128(rgb1, 12)));
+    _mm_storel_epi64((__m128i *)(dst + 16), _mm_srli_si128(rgb1, 4));
+    src += 16;
+    dst += 24;
+  }
+
+  yuv422_to_rgb_scalar(src, dst, nr_pixels - i);
+}
+
+#endif
+
+
+static inline void yuv422_to_rgb(const unsigned char *src, unsigned char *dst,
+                                 unsigned int nr_pixels)
+{
+#if defined(__ARM_NEON__) || defined(__ARM_NEON)
+  yuv422_to_rgb_neon(src, dst, nr_pixels);
+#elif defined(__SSE2__)
+  yuv422_to_rgb_sse2(src, dst, nr_pixels);
+#else
+  yuv422_to_rgb_scalar(src, dst, nr_pixels);
+#endif
+}
+
+#endif
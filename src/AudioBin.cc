@@ -1,116 +1,100 @@
+
 #include "EPuck.h"
 #include "AudioHandler.h"
 
 /**
- * Creates a new AudioBin item. The AudioBin linked list uses the lower frequency bound as a key, so this must be given
- * upon initialisation.
- * @param lowerFreq the lower frequency bound of this audio bin.
- * @param prev the previous AudioBin in the Linked list the bins are stored in.
- * @param nxt the next AudioBin in the Linked list the bins are stored in.
+ * Creates a new, empty AudioBin item. The AudioHandler keeps one AudioBin per FFT block in a table, so the
+ * lower frequency bound is filled in by the handler once the table has been made.
  * */
-AudioHandler::AudioBin::AudioBin(double lowerFreq, AudioBin *prev, AudioBin *nxt)
+AudioHandler::AudioBin::AudioBin(void)
 {
-	lowerFrequencyBound = lowerFreq;
-	next = nxt;
-	previous = prev;
-	tones = NULL;
+	lowerFrequencyBound = 0;
 	numberTones = 0;
 
+	tx.reserve(initialToneCapacity);
+	ty.reserve(initialToneCapacity);
+	end.reserve(initialToneCapacity);
+
 	return;
 }
 
 AudioHandler::AudioBin::~AudioBin()
 {
-	//remove all tones in Linked list
-	audio_tone_t *ptr = tones;
-	audio_tone_t *prev;
-
-	while(ptr != NULL)
-	{
-		prev = ptr;
-		ptr = ptr->next;
-		delete prev;
-	}
-
+	//tone arrays free themselves
 	return;
 }
 
 /**Returns the number of tones currently stored in this audio bin*/
-int AudioHandler::AudioBin::getNumberTones(void)
+int AudioHandler::AudioBin::getNumberTones(void) const
 {
 	//printf("there are %d tones in this bin\n", numberTones);
 	return numberTones;
 }
 
 /**Updates list of tones in the bin so that ones which have finished playing are removed.
- * Also updates apparent sound sources
+ * The tones still playing are moved down the arrays to fill the gaps, so the order they were played in is kept and
+ * no memory is freed.
  * @param currentTime the current time of the simulation
- * @returns status 0 if a tone is removed but there are still tones in the AudioBin, 1 if entire list is now empty.*/
+ * @returns status 0 if there are still tones in the AudioBin, 1 if entire list is now empty.*/
 int AudioHandler::AudioBin::updateList(double currentTime)
 {
-	//move through LL and remove any entries with end times after the current time
-	audio_tone_t *ptr;
+	int readIndex, writeIndex = 0;
 
-	ptr = tones;
-
-	while(ptr != NULL)
+	for(readIndex=0; readIndex<numberTones; readIndex++)
 	{
-		audio_tone_t *del = ptr;
+		//if tone should have finished then skip over it
+		if(end[readIndex] <= currentTime) continue;
 
-		ptr = ptr->next;
-		//if tone should have finished
-		if(del->end <= currentTime)
+		if(writeIndex != readIndex)
 		{
-			//delete it and if LL is empty now return 1
-			if(removeTone(del)) return 1;
+			tx[writeIndex] 	= tx[readIndex];
+			ty[writeIndex] 	= ty[readIndex];
+			end[writeIndex] = end[readIndex];
 		}
+		writeIndex++;
 	}
+
+	//shrinking a vector keeps its capacity so the space is reused by the next addTone
+	tx.resize(writeIndex);
+	ty.resize(writeIndex);
+	end.resize(writeIndex);
+	numberTones = writeIndex;
+
+	if(numberTones == 0) return 1;
 	return 0;
 }
 
 /**
- * Adds an audio_tone_t into the AudioBin. Creates an audio_tone_t object, appends it to the linked list and updates itself.
+ * Adds a tone into the AudioBin by appending it to the end of the tone arrays.
  * @param x the x position of the robot playing the tone
  * @param y the y position of the robot playing the tone
- * @param voltage how loud to play the tone at. Value indicates in VOLTS how big the signal to the speaker should be.
- * This must be in the range 0 to 5, if this number is outside the range it will be assumed to be either 0 or 5 (whichever is closer).
- * So if you set this as 3, the speaker will play a sine wave at 3 volts (peak to peak).
  * @param endtime the simulated time at which the tone will end.
  * */
 void AudioHandler::AudioBin::addTone(double x, double y, double endtime)
 {
-	//construct new audiotone from the supplied data
-	audio_tone_t* newtone = new audio_tone_t;
-
-	newtone->tx = x;
-	newtone->ty = y;
+	tx.push_back(x);
+	ty.push_back(y);
 	//newtone->wattsAtSource = (voltage * voltage)/(EPuck::IMPEDANCE_OF_SPEAKER_OHMS);
-	newtone->end = endtime;
-	newtone->next = NULL;
+	end.push_back(endtime);
+	numberTones++;
 
-	//if there is no data in linked list then make this the first entry.
-	if(tones == NULL)
-	{
-		tones = newtone;
-		tones->previous = NULL;
-	}
-	else
-	{
-		//search linked list until the end is reached
-		audio_tone_t *toneptr = tones;
+	return;
+}
 
-		while(toneptr->next != NULL)
-		{
-			toneptr = toneptr->next;
-		}
+/**
+ * Returns a copy of one of the tones in this bin.
+ * @param index the index of the tone, between 0 and getNumberTones()-1
+ * @returns the tone at that index
+ * */
+AudioHandler::AudioBin::audio_tone_t AudioHandler::AudioBin::getTone(int index) const
+{
+	audio_tone_t tone;
 
-		//append newtone to LL
-		newtone->previous = toneptr;
-		toneptr->next = newtone;
-	}
-	numberTones++;
+	tone.tx 	= tx[index];
+	tone.ty 	= ty[index];
+	tone.end 	= end[index];
 
-	return;
+	return tone;
 }
 
 /**
@@ -121,13 +105,12 @@ void AudioHandler::AudioBin::addTone(double x, double y, double endtime)
  * @param yr the y position of the robot
  * @param yaw the yaw of the robot. In radians because that's the measure used by playerstage
  * @param output the audio_message_t pointer where the data should be stored.
- * @param noMsgs the number of audio messages to retrieve from the bin
+ * @param maxToFill the maximum number of audio messages to retrieve from the bin
  * @returns the number of tones actually saved by this function, so 0 if there were none.
  * */
-int AudioHandler::AudioBin::calculateRawToneDataForPosition(double xr, double yr, double yaw, audio_message_t* output, int maxToFill)
+int AudioHandler::AudioBin::calculateRawToneDataForPosition(double xr, double yr, double yaw, audio_message_t* output, int maxToFill) const
 {
-	audio_tone_t *ptr =  tones;
-	int currentTone = 0;
+	int currentTone;
 
 	//for each tone in this bin.
 	for(currentTone=0; (currentTone<numberTones) && (currentTone<maxToFill); currentTone++)
@@ -135,71 +118,111 @@ int AudioHandler::AudioBin::calculateRawToneDataForPosition(double xr, double yr
 		double xdiff, ydiff;
 
 		//calculate the x y distances to the tone from the listening robot
-		xdiff 	= ptr->tx - xr;
-		ydiff 	= ptr->ty - yr;
+		xdiff 	= tx[currentTone] - xr;
+		ydiff 	= ty[currentTone] - yr;
 
 		output[currentTone].distance	= sqrt( (xdiff * xdiff) + (ydiff * ydiff) );
 		output[currentTone].direction	= convertDifferentialCoordsIntoBearing(xdiff, ydiff, yaw);
 		output[currentTone].frequency 	= lowerFrequencyBound;
-
-		//advance place in linked list
-		ptr = ptr->next;
-		//if we reach the end of the linked list before running out of storage space then break the loop
-		if(ptr == NULL) break;
 	}
 
-	return currentTone+1;
+	return currentTone;
 }
 
+/**
+ * Works out the distance and direction of every tone in this bin for a whole group of listening robots at once,
+ * and appends the results to each robot's output vector. The listener positions are given as separate x, y and yaw
+ * arrays so that the distance calculations for all the listeners can be done in one tight loop per tone.
+ * @param numberListeners the number of listening robots
+ * @param xr the x positions of the robots
+ * @param yr the y positions of the robots
+ * @param yaw the yaws of the robots, in radians
+ * @param xdiff scratch space for numberListeners doubles
+ * @param ydiff scratch space for numberListeners doubles
+ * @param distance scratch space for numberListeners doubles
+ * @param outputs array of numberListeners vectors. The tones heard by robot i are appended to outputs[i].
+ * */
+void AudioHandler::AudioBin::calculateRawToneDataForPositions(int numberListeners, const double *xr, const double *yr, const double *yaw,
+		double *xdiff, double *ydiff, double *distance, std::vector<audio_message_t> *outputs) const
+{
+	int currentTone, listener;
+	audio_message_t message;
+
+	message.frequency = lowerFrequencyBound;
+
+	//for each tone in this bin.
+	for(currentTone=0; currentTone<numberTones; currentTone++)
+	{
+		const double x = tx[currentTone];
+		const double y = ty[currentTone];
+
+		//calculate the distances to the tone from all the listening robots.
+		//No branches or calls in here so the compiler can vectorise it.
+		for(listener=0; listener<numberListeners; listener++)
+		{
+			xdiff[listener] 	= x - xr[listener];
+			ydiff[listener] 	= y - yr[listener];
+			distance[listener] 	= sqrt( (xdiff[listener] * xdiff[listener]) + (ydiff[listener] * ydiff[listener]) );
+		}
+
+		for(listener=0; listener<numberListeners; listener++)
+		{
+			message.distance 	= distance[listener];
+			message.direction 	= convertDifferentialCoordsIntoBearing(xdiff[listener], ydiff[listener], yaw[listener]);
+			outputs[listener].push_back(message);
+		}
+	}
+
+	return;
+}
 
 
 
 
-//==================================================================================================
-//							PRIVATE FUNCTIONS
-//==================================================================================================
 
 /**
- * Removes the supplied audioTone from the linked list.
- * @param *del address of the tone to delete.
- * @returns success 0 if tone is deleted, 1 if tone is deleted and the bin is now empty.
+ * Works out the distance and direction of a single tone in this bin from the listening robot.
+ * @param index the index of the tone, between 0 and getNumberTones()-1
+ * @param xr the x position of the robot
+ * @param yr the y position of the robot
+ * @param yaw the yaw of the robot, in radians
+ * @param output where the data should be stored.
  * */
-int AudioHandler::AudioBin::removeTone(audio_tone_t *del)
+void AudioHandler::AudioBin::calculateRawToneDataForTone(int index, double xr, double yr, double yaw, audio_message_t* output) const
 {
-	//Four possibilities for this, each needing different stuff doing.
-	//case 1, tone is the first in the list.
-	//case 1a tone is the only thing in the list
-	//case 2, tone is in the middle
-	//case 3 tone is at the end of the list
+	double xdiff, ydiff;
 
-	//if next is not null then update its previous pointer to this.previous
-	if(del->next != NULL) del->next->previous = del->previous;
+	xdiff 	= tx[index] - xr;
+	ydiff 	= ty[index] - yr;
 
-	//if previous is not null update its next pointer to this.next
-	if(del->previous != NULL) del->previous->next = del->next;
+	output->distance	= sqrt( (xdiff * xdiff) + (ydiff * ydiff) );
+	output->direction	= convertDifferentialCoordsIntoBearing(xdiff, ydiff, yaw);
+	output->frequency 	= lowerFrequencyBound;
 
-	//is this the first tone?
-	if(del->previous == NULL)
-	{
-		//update tones to point to first item in list
-		tones = del->next;
+	return;
+}
 
-		//is this the only tone?
-		if(del->next == NULL)
-		{
-			//delete tone and flag as empty.
-			delete del;
-			return 1;
-		}
-	}
-	delete del;
-	numberTones--;
+/**
+ * Calculates the intensity of a sound at a distance from its source. Sound spreads out equally in all directions,
+ * so its power is spread over the surface of a sphere and it follows the inverse square law.
+ * @param levelAtSource the power of the sound at source, in watts
+ * @param distance how far from the source the sound is being heard, in metres
+ * @returns the sound intensity in watts per square metre. Within 1cm of the source the intensity at 1cm is returned.
+ * */
+double AudioHandler::AudioBin::getSoundIntensity(double levelAtSource, double distance)
+{
+	const double minimumDistance = 0.01;
 
-	return 0;
+	if(distance < minimumDistance) distance = minimumDistance;
+
+	return levelAtSource/(4 * M_PI * distance * distance);
 }
 
 
 
+//==================================================================================================
+//							PRIVATE FUNCTIONS
+//==================================================================================================
 
 /**
  * Function to convert two coordinates into a bearing.
@@ -209,7 +232,7 @@ int AudioHandler::AudioBin::removeTone(audio_tone_t *del)
  * @param ydiff the source y coordinate minus the reciever y coordinate
  * @param recieverYaw the yaw of the robot that is listening for tones.
  * */
-int AudioHandler::AudioBin::convertDifferentialCoordsIntoBearing(double xdiff, double ydiff, double recieverYaw)
+int AudioHandler::AudioBin::convertDifferentialCoordsIntoBearing(double xdiff, double ydiff, double recieverYaw) const
 {
 	int yaw, bearingWRTx, bearingWRTrobot;
 
@@ -248,7 +271,7 @@ int AudioHandler::AudioBin::convertDifferentialCoordsIntoBearing(double xdiff, d
 /**
  * converts radians to degrees.
  * */
-int AudioHandler::AudioBin::radiansToDegrees(double rads)
+int AudioHandler::AudioBin::radiansToDegrees(double rads) const
 {
 	double degs;
 
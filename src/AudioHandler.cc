@@ -7,6 +7,7 @@
 
 #include "EPuck.h"
 #include "AudioHandler.h"
+#include <algorithm>
 
 
 
@@ -28,18 +29,25 @@ AudioHandler::AudioHandler(PlayerCc::PlayerClient *simulationClient, PlayerCc::S
 
 	simClient = simulationClient;
 	simProxy = sim;
-	environment = NULL;
 	strncpy(aRobotName, name, 32);
+	clock = SimulationClock::GetSimulationClock(sim, name);
+	poses = PoseCache::GetPoseCache(sim, clock);
 	numberOfBins = 0;
+	environmentVersion = 0;
+	hearingRange = 0;
 
 	//printf("audio handler constructor making bins at freqs:\n");
 	//make array of frequency bins depending on FFT settings.
 	for(i=0; i<fftBlockSize/2; i++)
 	{
 		lowerFFTBounds[i] = (i*sampleRate)/fftBlockSize;
+		environment[i].lowerFrequencyBound = lowerFFTBounds[i];
 		//printf("%f, ", lowerFFTBounds[i]);
 	}
 
+	//readers always need a snapshot to look at, even if it is an empty one
+	publishSnapshot();
+
 	updateAudioBinListThread = boost::thread(&AudioHandler::updateAudioBinListThreaded, this);
 	//pthread_create(&updateAudioBinListThread, 0, AudioHandler::startupdateAudioBinListThread, this);
 
@@ -69,17 +77,7 @@ AudioHandler::~AudioHandler()
 	updateAudioBinListThread.interrupt();
 	updateAudioBinListThread.join();
 
-	//remove all bins in Linked list
-	AudioBin *ptr = environment;
-	AudioBin *prev;
-
-	while(ptr != NULL)
-	{
-		prev = ptr;
-		ptr = ptr->next;
-		delete prev;
-	}
-
+	//the bins live in the environment table and free their own tone arrays when destroyed
 	printf("AudioHandler destroyed.\n");
 	return;
 }
@@ -97,83 +95,55 @@ int AudioHandler::getFFTBlockSize(void)
  * */
 void AudioHandler::playTone(int freq, double duration, char* robotName)
 {
-	int whichbin;
 	double x, y, yaw, currenttime;
 	AudioBin *current;
-	AudioBin *last;
+	tone_expiry_t expiry;
 
-	//find FFT lower frequency bound for freq
-	for(whichbin=(fftBlockSize/2)-1; whichbin>-1; whichbin--)
-	{
-		if(lowerFFTBounds[whichbin] <= freq) break;
-	}
+	//the FFT bins are evenly spaced so the bin can be worked out directly from the frequency
+	expiry.bin = getBinIndex(freq);
+	current = &environment[expiry.bin];
+
+	//get xy coords. The pose comes from the cache so the lock isn't held while waiting for the simulation.
+	poses->getPose(robotName, x, y, yaw);
 
 	//Code is about to read information from the environment and the write to it
 	// putting mutex lock here so that while it is in scope read and write
 	//from other threads can't happen.
 	boost::mutex::scoped_lock lock(toneIOMutex);
 
-	//check linked list to see if there is an audio bin for this sound
-	current = environment;
-	while(current != NULL)
-	{
-		if(current->lowerFrequencyBound == lowerFFTBounds[whichbin])
-		{
-			//if existing bin is found then stop searching.
-			break;
-		}
-		last = current;
-		current = current->next;
-	}
-
-	//if there is no audio bin for the sound then make one
-	if(current == NULL)
-	{
-		current = new AudioBin(lowerFFTBounds[whichbin], last, NULL);
-		numberOfBins++;
-		//if this is the first bin in the LL then point the Handler to it
-		if(environment == NULL)
-		{
-			environment = current;
-			current->previous = NULL;
-		}
-		else last->next = current;
-	}
-
 	//add data to the audio bin entry
 
-	//get xy coords.
-	simProxy->GetPose2d(robotName, x, y, yaw);
-
 	//get simulation time
 	currenttime = getCurrentTime();
 
+	//if the bin was empty then it now becomes active
+	if(current->getNumberTones() == 0) numberOfBins++;
+
 	//write tone to environment
-	current->addTone(x, y, currenttime+(duration/1000));
+	expiry.end = currenttime+(duration/1000);
+	current->addTone(x, y, expiry.end);
+	updateBinSnapshot(expiry.bin, true);
+	publishSnapshot();
+
+	//let the update thread know if this tone finishes before anything it is already waiting for
+	if(expiryQueue.empty() || expiry.end < expiryQueue.top().end)
+	{
+		expiryQueue.push(expiry);
+		expiryQueueChanged.notify_one();
+	}
+	else expiryQueue.push(expiry);
 
 	return;
 }
 
 /**
- * Returns the number of AudioBins currently in the environment. This function is needed so that space can be allocated for the Tones in the EPuck code.
+ * Returns the number of tones currently in the environment. This function is needed so that space can be allocated for the Tones in the EPuck code.
+ * Reads the latest snapshot of the environment so does not need to lock it.
  * @returns notones the number of different frequency tones the robot can detect.
  * */
 int AudioHandler::getNumberOfTones(void)
 {
-	//code is about to read audio data, so lock it down so that any writes to
-	//environment don't mess stuff up
-	boost::mutex::scoped_lock lock(toneIOMutex);
-
-	AudioBin *binptr = environment;
-	int numTones = 0;
-
-	while(binptr != NULL)
-	{
-		numTones += binptr->getNumberTones();
-		binptr = binptr->next;
-	}
-
-	return numTones;
+	return getSnapshot()->numberOfTones;
 }
 
 /**
@@ -190,63 +160,230 @@ int AudioHandler::getNumberOfTones(void)
 int AudioHandler::getTones(char* robotName, audio_message_t *store, int numberAllocatedSlots)
 {
 	double x, y, yaw;
-	int slotsFilled = 0;
-	AudioBin *binptr;
+	//work from one snapshot of the environment throughout, so tones added while this function runs can't overflow store
+	boost::shared_ptr<const audio_snapshot_t> current = getSnapshot();
 
-	if(getNumberOfTones() > numberAllocatedSlots)
+	if(current->numberOfTones > numberAllocatedSlots)
 	{
 		//printf("There are %d tones in the environment, but you have only reserved enough space for %d. Try again.\n", getNumberOfTones(), numberAllocatedSlots);
 		return -1;
 	}
 
 	//get positional info about the robot calling this function
-	simProxy->GetPose2d(robotName, x, y, yaw);
+	poses->getPose(robotName, x, y, yaw);
 
-	//code is about to read audio data, so lock it down so that any writes to
-	//environment don't mess stuff up
-	boost::mutex::scoped_lock lock(toneIOMutex);
+	return fillTonesForPosition(current.get(), x, y, yaw, store, numberAllocatedSlots);
+}
+
+/**
+ * Provides the audio data in the environment, including frequency, volume and direction of the tones.
+ * Unlike the array version of this function the memory is managed by the vector, which is resized to fit all the tones
+ * in one go, so it can't fail because tones were added in the meantime. The vector keeps its capacity between calls
+ * so reusing it avoids allocating memory.
+ * @param robotName	the name of the robot which is requesting the data (this is given in the worldfile)
+ * @param store		vector the audio data is copied into. Anything already in it is removed.
+ * @returns the number of tones in the environment that this robot can detect.
+ * */
+int AudioHandler::getTones(char* robotName, std::vector<audio_message_t> &store)
+{
+	double x, y, yaw;
+	int slotsFilled;
+	boost::shared_ptr<const audio_snapshot_t> current = getSnapshot();
+
+	store.resize(current->numberOfTones);
+	if(current->numberOfTones == 0) return 0;
+
+	//get positional info about the robot calling this function
+	poses->getPose(robotName, x, y, yaw);
+
+	slotsFilled = fillTonesForPosition(current.get(), x, y, yaw, &store[0], current->numberOfTones);
+	//tones out of hearing range leave unused space at the end
+	store.resize(slotsFilled);
+
+	return slotsFilled;
+}
+
+/**
+ * Provides the audio data in the environment for a group of listening robots in a single pass over the environment.
+ * This is much cheaper than calling getTones once per robot when lots of robots are listening, because the
+ * environment is only scanned once.
+ * @param numberListeners the number of listening robots
+ * @param x array of the x positions of the listening robots
+ * @param y array of the y positions of the listening robots
+ * @param yaw array of the yaws of the listening robots, in radians
+ * @param stores array of numberListeners vectors. Each is cleared and then filled with the tones that robot can hear.
+ * The vectors keep their capacity so reusing them between calls avoids allocating memory.
+ * @returns the number of tones in the environment. If there is a hearing range robots may be able to detect fewer than this.
+ * @see AudioHandler#getTones()
+ * @see AudioHandler#setHearingRange()
+ * */
+int AudioHandler::getTonesForPositions(int numberListeners, const double *x, const double *y, const double *yaw, std::vector<audio_message_t> *stores)
+{
+	int i;
+
+	if(numberListeners <= 0) return 0;
+
+	for(i=0; i<numberListeners; i++)
+	{
+		stores[i].clear();
+	}
+
+	boost::shared_ptr<const audio_snapshot_t> current = getSnapshot();
+
+	if(current->numberOfTones == 0) return 0;
+
+	//if robots can't hear everything then looking up nearby tones in the grid is quicker than scanning them all
+	if(current->hearingRange > 0)
+	{
+		for(i=0; i<numberListeners; i++)
+		{
+			stores[i].resize(current->numberOfTones);
+			stores[i].resize(fillTonesForPosition(current.get(), x[i], y[i], yaw[i], &stores[i][0], current->numberOfTones));
+		}
+		return current->numberOfTones;
+	}
+
+	std::vector<double> xdiff(numberListeners), ydiff(numberListeners), distance(numberListeners);
 
-	binptr = environment;
 	//for each bin get the full tone information for it.
-	while(binptr != NULL && slotsFilled < numberAllocatedSlots)
+	for(i=0; i<(int)current->bins.size(); i++)
+	{
+		current->bins[i]->bin.calculateRawToneDataForPositions(numberListeners, x, y, yaw,
+				&xdiff[0], &ydiff[0], &distance[0], stores);
+	}
+
+	return current->numberOfTones;
+}
+
+/**
+ * Provides the audio data in the environment for a group of listening robots in a single pass over the environment.
+ * Looks up where each robot is in the simulation and then calls getTonesForPositions.
+ * @param numberRobots the number of listening robots
+ * @param robotNames array of the names of the listening robots (as given in the worldfile)
+ * @param stores array of numberRobots vectors. Each is cleared and then filled with the tones that robot can hear.
+ * @returns the number of tones in the environment.
+ * @see AudioHandler#getTonesForPositions()
+ * */
+int AudioHandler::getTonesForRobots(int numberRobots, char **robotNames, std::vector<audio_message_t> *stores)
+{
+	std::vector<double> x(numberRobots), y(numberRobots), yaw(numberRobots);
+	int i;
+
+	if(numberRobots <= 0) return 0;
+
+	//get positional info about the robots calling this function
+	for(i=0; i<numberRobots; i++)
+	{
+		poses->getPose(robotNames[i], x[i], y[i], yaw[i]);
+	}
+
+	return getTonesForPositions(numberRobots, &x[0], &y[0], &yaw[0], stores);
+}
+
+/**
+ * Returns the version number of the audio environment. This goes up every time a tone is added or removed,
+ * so if it hasn't changed since the last time a robot listened then neither has anything it can hear (unless it has moved).
+ * @returns the version of the latest snapshot of the environment
+ * */
+unsigned long AudioHandler::getEnvironmentVersion(void)
+{
+	return getSnapshot()->version;
+}
+
+/**
+ * Sets how far away from a robot a tone can be heard. Tones further away than this are not reported to the robot, and
+ * the environment is indexed so that robots only look at tones near to them.
+ * @param range the hearing range in metres. 0 (the default) means every robot can hear every tone.
+ * @see AudioHandler#setHearingThreshold()
+ * */
+void AudioHandler::setHearingRange(double range)
+{
+	boost::mutex::scoped_lock lock(toneIOMutex);
+	int i;
+
+	if(range < 0) range = 0;
+	hearingRange = range;
+
+	//rebuild every bin so that the grids match the new range
+	for(i=0; i<fftBlockSize/2; i++)
+	{
+		updateBinSnapshot(i, false);
+	}
+	publishSnapshot();
+	return;
+}
+
+/**
+ * Sets how far away from a robot a tone can be heard, using the inverse square law to work out how far a tone of
+ * the given power travels before it is too quiet for the microphones to detect.
+ * @param wattsAtSource the power of the tones played by the robots, in watts
+ * @param threshold the quietest sound intensity the microphones can detect, in watts per square metre
+ * @see AudioBin#getSoundIntensity()
+ * */
+void AudioHandler::setHearingThreshold(double wattsAtSource, double threshold)
+{
+	if(wattsAtSource <= 0 || threshold <= 0)
 	{
-		int numTonesSaved;
-		numTonesSaved = binptr->calculateRawToneDataForPosition(x, y, yaw, &store[slotsFilled], numberAllocatedSlots-slotsFilled);
-		slotsFilled += numTonesSaved;
-		binptr = binptr->next;
+		setHearingRange(0);
+		return;
 	}
 
-	return 0;
+	//solving threshold = wattsAtSource/(4*pi*range^2) for range
+	setHearingRange( sqrt(wattsAtSource/(4 * M_PI * threshold)) );
+	return;
+}
+
+/**
+ * Returns how far away from a robot a tone can be heard.
+ * @returns the hearing range in metres, 0 if there is no limit.
+ * */
+double AudioHandler::getHearingRange(void)
+{
+	return getSnapshot()->hearingRange;
 }
 
+/**
+ * Removes any tones that have finished playing straight away, instead of waiting for the thread that normally does it.
+ * Simulations that run in this process call this after each step, because they can run so much faster than real time
+ * that the thread wouldn't keep up.
+ * */
+void AudioHandler::removeFinishedTones(void)
+{
+	boost::mutex::scoped_lock lock(toneIOMutex);
 
+	if(removeExpiredTones(getCurrentTime()))
+	{
+		publishSnapshot();
+	}
+	return;
+}
 
 
 void AudioHandler::dumpData_TEST(void)
 {
 	boost::mutex::scoped_lock lock(toneIOMutex);
 
-	AudioBin *binptr = environment;
-	AudioBin::audio_tone_t *toneptr;
+	AudioBin::audio_tone_t tone;
+	int i, j;
 
 	printf("AudioHandler has %d bins containing stored data:\n", numberOfBins);
-	if(binptr == NULL)
+	if(numberOfBins == 0)
 	{
 		printf("\tno audio data\n");
 		return;
 	}
 
-	while(binptr != NULL)
+	for(i=0; i<fftBlockSize/2; i++)
 	{
-		printf("\nBin lower bound is %f\n", binptr->lowerFrequencyBound);
+		if(environment[i].getNumberTones() == 0) continue;
+
+		printf("\nBin lower bound is %f\n", environment[i].lowerFrequencyBound);
 		printf("Stored tones:\n");
-		toneptr = binptr->tones;
-		while(toneptr != NULL)
+		for(j=0; j<environment[i].getNumberTones(); j++)
 		{
-			printf("\t\tx: %f, y: %f, end: %f\n", toneptr->tx, toneptr->ty, (double)toneptr->end);
-			toneptr = toneptr->next;
+			tone = environment[i].getTone(j);
+			printf("\t\tx: %f, y: %f, end: %f\n", tone.tx, tone.ty, (double)tone.end);
 		}
-		binptr = binptr->next;
 	}
 
 	return;
@@ -259,103 +396,287 @@ void AudioHandler::dumpData_TEST(void)
 
 
 /**
- * Removes an AudioBin from the Linked list.
- * @param del AudioBin to remove from LL.
+ * Works out which FFT bin a frequency falls into, that is the highest bin whose lowerFFTBounds entry is <= freq.
+ * The bins are all sampleRate/fftBlockSize wide so this is a division rather than a search of lowerFFTBounds.
+ * @param freq the frequency of the tone in Hz
+ * @returns the index into the environment table of the bin containing freq. Frequencies outside the spectrum are put in the first or last bin.
  * */
-int AudioHandler::removeBin(AudioBin *del)
+int AudioHandler::getBinIndex(int freq)
 {
-	//Four possibilities for this, each needing different stuff doing.
-	//case 1, tone is the first in the list.
-	//case 1a tone is the only thing in the list
-	//case 2, tone is in the middle
-	//case 3 tone is at the end of the list
-
-	//if next is not null then update its previous pointer to this.previous
-	if(del->next != NULL) del->next->previous = del->previous;
+	if(freq < 0) return 0;
 
-	//if previous is not null update its next pointer to this.next
-	if(del->previous != NULL) del->previous->next = del->next;
+	//lowerFFTBounds[i] is rounded down so it is <= freq whenever i*sampleRate < (freq+1)*fftBlockSize
+	int whichbin = ((freq+1)*fftBlockSize - 1)/sampleRate;
 
-	//is this the first tone?
-	if(del->previous == NULL)
-	{
-		//is this the only tone?
-		if(del->next == NULL)
-		{
-			//delete tone and flag as empty.
-			delete del;
-			numberOfBins = 0;
-			return 1;
-		}
+	if(whichbin > (fftBlockSize/2)-1) whichbin = (fftBlockSize/2)-1;
 
-		//update tones to point to first item in list
-		environment = del->next;
-	}
-	delete del;
-	numberOfBins--;
-	return 0;
+	return whichbin;
 }
 
 /**
  * Updates the list of AudioBins so that tones which have finished playing are removed from data storage.
+ * The thread sleeps until the earliest end time in expiryQueue, or until playTone adds a tone that finishes sooner,
+ * and only updates the bins that have a tone due to finish. When no tones are playing it waits without polling the simulation.
  * This function is intended to be threaded, so contains a loop which does not terminate.
  * */
 void AudioHandler::updateAudioBinListThreaded(void)
 {
 	printf("AudioHandler is threaded\n");
-	boost::posix_time::milliseconds wait(10);
-	AudioBin *ptr;
-	char simproxFlag[] = "time";
+	//shortest and longest real time (in seconds) to wait before checking the simulation time again.
+	//The sim only goes to a resolution of 100ms so there's no point checking more often than the minimum,
+	//and the maximum stops tones outstaying their welcome if the simulation runs faster than real time.
+	//Checking the time just reads the shared SimulationClock so doesn't cost a request to the simulation.
+	const double minimumWait = 0.01;
+	const double maximumWait = 0.1;
+
+	//code is about to read/write audio data, so lock it down so that any writes to
+	//environment don't mess stuff up. Waiting on expiryQueueChanged releases the lock.
+	boost::mutex::scoped_lock lock(toneIOMutex);
 
 	while(true)
 	{
-		//sleep for 50ms. This is a lot but the sim only goes to a resolution of 100ms
-		boost::this_thread::sleep(wait);
-
-		//code is about to read/write audio data, so lock it down so that any writes to
-		//environment don't mess stuff up
-		boost::mutex::scoped_lock lock(toneIOMutex);
+		//nothing can finish playing if nothing is playing
+		while(expiryQueue.empty())
+		{
+			expiryQueueChanged.wait(lock);
+		}
 
 		double currentTime = getCurrentTime();
-		ptr = environment;
-		//currentTime = (double)time(NULL);
-		while(ptr != NULL)
+
+		if(removeExpiredTones(currentTime))
 		{
-			//updateList(currentTime) returns 1 if list is now empty
-			if(ptr->updateList(currentTime))
-			{
-				//delete current bin
-				AudioBin *del = ptr;
-				//move ptr along one so that the place in the list isn't lost.
-				ptr = ptr->next;
+			publishSnapshot();
+		}
 
-				//removeBin returns 1 if there are no more audiobins
-				if(removeBin(del))
-				{
-					environment = NULL;
-				}
+		if(expiryQueue.empty()) continue;
+
+		//sleep until the next tone is due to finish, assuming the simulation runs at about real time.
+		//If it runs slower we wake up early, check the time again and go back to sleep.
+		double wait = expiryQueue.top().end - currentTime;
+		if(wait < minimumWait) wait = minimumWait;
+		if(wait > maximumWait) wait = maximumWait;
+		expiryQueueChanged.timed_wait(lock, boost::posix_time::milliseconds((long)(wait*1000)));
+	}
+
+	return;
+}
+
+/**
+ * Removes tones from each bin that has one due to finish by the given time. The caller must hold toneIOMutex.
+ * @param currentTime the simulated time in seconds.
+ * @returns true if any tones were removed, in which case the caller should publish a new snapshot.
+ * */
+bool AudioHandler::removeExpiredTones(double currentTime)
+{
+	bool updatedBins[fftBlockSize/2];
+	bool removedTones = false;
+	int i;
+
+	for(i=0; i<fftBlockSize/2; i++) updatedBins[i] = false;
+
+	while(!expiryQueue.empty() && expiryQueue.top().end <= currentTime)
+	{
+		i = expiryQueue.top().bin;
+		expiryQueue.pop();
+
+		//updateList(currentTime) returns 1 if list is now empty. An earlier entry may already have updated or emptied the bin.
+		if(!updatedBins[i] && environment[i].getNumberTones() > 0)
+		{
+			updatedBins[i] = true;
+			if(environment[i].updateList(currentTime)) numberOfBins--;
+		}
+		removedTones = true;
+	}
+
+	//only the bins that changed need copying for the next snapshot
+	for(i=0; i<fftBlockSize/2; i++)
+	{
+		if(updatedBins[i]) updateBinSnapshot(i, false);
+	}
+
+	return removedTones;
+}
 
-				//already advanced the ptr so should skip rest of loop
-				continue;
+/**
+ * Makes an immutable copy of one bin of the environment for the snapshots to share, with its tones sorted into the grid.
+ * The caller must hold toneIOMutex.
+ * @param bin index of the bin in the environment table.
+ * @param toneAdded true if the only change since the last copy is a tone added to the end of the bin, in which case the
+ * new tone is merged into the old grid instead of sorting the whole grid again.
+ * */
+void AudioHandler::updateBinSnapshot(int bin, bool toneAdded)
+{
+	const AudioBin &current = environment[bin];
+	boost::shared_ptr<const bin_snapshot_t> old = binSnapshots[bin];
+	grid_entry_t entry;
+	int numberTones = current.getNumberTones();
+
+	if(numberTones == 0)
+	{
+		binSnapshots[bin].reset();
+		return;
+	}
+
+	boost::shared_ptr<bin_snapshot_t> newBin(new bin_snapshot_t);
+	newBin->bin = current;
+
+	if(hearingRange > 0)
+	{
+		newBin->grid.reserve(numberTones);
+
+		if(toneAdded && old && (int)old->grid.size() == numberTones-1)
+		{
+			//the new tone has the highest index, so it goes after any other tones in the same cell
+			entry.tone = numberTones-1;
+			entry.cell = getGridCell(current.tx[entry.tone], current.ty[entry.tone], hearingRange);
+			std::vector<grid_entry_t>::const_iterator position = std::upper_bound(old->grid.begin(), old->grid.end(), entry);
+
+			newBin->grid.insert(newBin->grid.end(), old->grid.begin(), position);
+			newBin->grid.push_back(entry);
+			newBin->grid.insert(newBin->grid.end(), position, old->grid.end());
+		}
+		else
+		{
+			for(entry.tone=0; entry.tone<numberTones; entry.tone++)
+			{
+				entry.cell = getGridCell(current.tx[entry.tone], current.ty[entry.tone], hearingRange);
+				newBin->grid.push_back(entry);
 			}
-			ptr = ptr->next;
+			std::sort(newBin->grid.begin(), newBin->grid.end());
 		}
 	}
 
+	binSnapshots[bin] = newBin;
 	return;
 }
 
-double AudioHandler::getCurrentTime(void)
+/**
+ * Makes a snapshot out of the latest copies of the bins which have tones in them and makes it the snapshot that readers see.
+ * The bins themselves aren't copied, so this doesn't depend on how many tones there are.
+ * The caller must hold toneIOMutex.
+ * */
+void AudioHandler::publishSnapshot(void)
+{
+	boost::shared_ptr<audio_snapshot_t> newSnapshot(new audio_snapshot_t);
+	int i;
+
+	newSnapshot->version = ++environmentVersion;
+	newSnapshot->numberOfTones = 0;
+	newSnapshot->hearingRange = hearingRange;
+	newSnapshot->bins.reserve(numberOfBins);
+
+	for(i=0; i<fftBlockSize/2; i++)
+	{
+		if(!binSnapshots[i]) continue;
+		newSnapshot->bins.push_back(binSnapshots[i]);
+		newSnapshot->numberOfTones += binSnapshots[i]->bin.getNumberTones();
+	}
+
+	boost::atomic_store(&snapshot, boost::shared_ptr<const audio_snapshot_t>(newSnapshot));
+	return;
+}
+
+/**
+ * Returns the latest snapshot of the audio environment. Does not lock toneIOMutex.
+ * */
+boost::shared_ptr<const AudioHandler::audio_snapshot_t> AudioHandler::getSnapshot(void)
+{
+	return boost::atomic_load(&snapshot);
+}
+
+/**
+ * Works out the distance and direction of the tones in a snapshot that a robot at the given position can hear.
+ * Tones are given in order of frequency.
+ * @param current the snapshot of the environment to use
+ * @param x the x position of the robot
+ * @param y the y position of the robot
+ * @param yaw the yaw of the robot, in radians
+ * @param store where the tone data is written to
+ * @param numberAllocatedSlots the number of audio_message_t items in the store array
+ * @returns the number of tones written to store
+ * */
+int AudioHandler::fillTonesForPosition(const audio_snapshot_t *current, double x, double y, double yaw, audio_message_t *store, int numberAllocatedSlots)
 {
-	uint64_t timeData;
-	double currentTime;
-	char simproxFlag[] = "time";
+	int slotsFilled = 0;
+	int i;
+
+	//no hearing range so every tone can be heard
+	if(current->hearingRange <= 0)
+	{
+		//for each bin get the full tone information for it.
+		for(i=0; (i<(int)current->bins.size()) && (slotsFilled < numberAllocatedSlots); i++)
+		{
+			slotsFilled += current->bins[i]->bin.calculateRawToneDataForPosition(x, y, yaw, &store[slotsFilled], numberAllocatedSlots-slotsFilled);
+		}
+		return slotsFilled;
+	}
+
+	const double range = current->hearingRange;
+	const int cellX = (int)floor(x/range);
+	const int cellY = (int)floor(y/range);
+	int dx, dy;
+
+	//any tone within range must be in the same cell as the robot or one of the 8 around it.
+	//Going through the bins in order gives the tones in order of frequency.
+	for(i=0; (i<(int)current->bins.size()) && (slotsFilled < numberAllocatedSlots); i++)
+	{
+		const bin_snapshot_t &binSnapshot = *current->bins[i];
+		const AudioBin &bin = binSnapshot.bin;
+
+		for(dx=-1; dx<=1; dx++)
+		{
+			for(dy=-1; dy<=1; dy++)
+			{
+				grid_entry_t key;
+				key.cell = getGridCell(cellX+dx, cellY+dy);
+				key.tone = -1;
+
+				std::vector<grid_entry_t>::const_iterator it = std::lower_bound(binSnapshot.grid.begin(), binSnapshot.grid.end(), key);
+				for(; (it != binSnapshot.grid.end()) && (it->cell == key.cell) && (slotsFilled < numberAllocatedSlots); it++)
+				{
+					double xdiff = bin.tx[it->tone] - x;
+					double ydiff = bin.ty[it->tone] - y;
+
+					if( (xdiff * xdiff) + (ydiff * ydiff) > (range * range) ) continue;
+
+					bin.calculateRawToneDataForTone(it->tone, x, y, yaw, &store[slotsFilled]);
+					slotsFilled++;
+				}
+			}
+		}
+	}
 
-	simProxy->GetProperty(aRobotName, simproxFlag, &timeData, sizeof(uint64_t));
-	currentTime = (double)timeData;
-	currentTime = currentTime/1000000;
+	return slotsFilled;
+}
 
-	return currentTime;
+/**
+ * Works out which cell of the tone location grid a point is in.
+ * @param x the x coordinate of the point
+ * @param y the y coordinate of the point
+ * @param cellSize the width of the grid cells
+ * @returns a number identifying the cell
+ * */
+int64_t AudioHandler::getGridCell(double x, double y, double cellSize)
+{
+	return getGridCell((int)floor(x/cellSize), (int)floor(y/cellSize));
 }
 
+/**
+ * Combines the column and row numbers of a grid cell into a single number identifying that cell.
+ * @param cellX the column of the cell
+ * @param cellY the row of the cell
+ * @returns a number identifying the cell
+ * */
+int64_t AudioHandler::getGridCell(int cellX, int cellY)
+{
+	return ((int64_t)cellX << 32) | (uint32_t)cellY;
+}
 
+/**
+ * Returns the simulated time, from the clock shared by the whole simulation.
+ * @returns the simulated time in seconds.
+ * */
+double AudioHandler::getCurrentTime(void)
+{
+	return clock->getTime();
+}
@@ -0,0 +1,304 @@
+/*
+ * BlobTracker.cc
+ *
+ */
+
+#include <math.h>
+#include <stdlib.h>
+#include <algorithm>
+#include "BlobTracker.h"
+
+
+/*====================================================================
+			CONSTRUCTOR/DESTRUCTOR
+====================================================================*/
+
+/**
+ * Makes a tracker with the default settings.
+ * */
+BlobTracker::BlobTracker(void)
+{
+	initialise(DEFAULT_MAX_DISTANCE, DEFAULT_MAX_MISSED_FRAMES);
+	return;
+}
+
+/**
+ * Makes a tracker.
+ * @param maxDistance how far, in pixels, a blob can be from where its track was predicted to be and still be matched to it.
+ * @param maxMissedFrames how many frames in a row a track can go unseen before it is dropped. 0 drops tracks as soon as they aren't seen.
+ * */
+BlobTracker::BlobTracker(double maxDistance, int maxMissedFrames)
+{
+	initialise(maxDistance, maxMissedFrames);
+	return;
+}
+
+BlobTracker::~BlobTracker()
+{
+	return;
+}
+
+void BlobTracker::initialise(double distance, int missedFrames)
+{
+	if(distance < 1) distance = 1;
+	if(missedFrames < 0) missedFrames = 0;
+
+	maxDistance 	= distance;
+	maxMissedFrames = missedFrames;
+	nextId 			= 0;
+	lastSequence 	= 0;
+	bucketStart.resize(NUMBER_OF_BUCKETS+1);
+	return;
+}
+
+
+/*====================================================================
+			PUBLIC FUNCTIONS
+====================================================================*/
+
+/**
+ * Updates the tracks with the blobs in the robot's latest sensor frame. If the robot hasn't published a frame since the last
+ * update nothing is changed, so this can be called more often than the sensors are read.
+ * @param robot the robot whose camera is being tracked.
+ * @returns the number of tracks.
+ * */
+int BlobTracker::update(EPuck *robot)
+{
+	EPuck::SensorFrame frame;
+
+	robot->getSensorFrame(frame);
+	if(frame.sequence == lastSequence) return tracks.size();
+	lastSequence = frame.sequence;
+
+	frame.getBlobs(frameBlobs, EPuck::BlobFilter());
+	return update(frameBlobs, frame.time);
+}
+
+/**
+ * Updates the tracks with the blobs seen in one frame.
+ * @param blobs every blob seen in the frame, eg from EPuck#getBlobs.
+ * @param time the time the frame was seen. Only used to work out velocities, so any units can be used as long as they are the same each time.
+ * @returns the number of tracks.
+ * */
+int BlobTracker::update(const std::vector<EPuck::Blob> &blobs, double time)
+{
+	Track newTrack;
+	unsigned int i;
+	int t;
+
+	fillBuckets(time);
+	findMatches(blobs);
+
+	//greedy matching, cheapest pair first
+	std::sort(matches.begin(), matches.end());
+	trackMatch.assign(tracks.size(), -1);
+	blobTrackIds.assign(blobs.size(), -1);
+	for(i=0; i<matches.size(); i++)
+	{
+		if(trackMatch[matches[i].track] != -1 || blobTrackIds[matches[i].blob] != -1) continue;
+		trackMatch[matches[i].track] 	= matches[i].blob;
+		blobTrackIds[matches[i].blob] 	= tracks[matches[i].track].id;
+	}
+
+	for(t=0; t<(int)tracks.size(); t++)
+	{
+		Track &track = tracks[t];
+
+		if(trackMatch[t] == -1)
+		{
+			track.missedFrames++;
+			continue;
+		}
+
+		const EPuck::Blob &blob = blobs[trackMatch[t]];
+		double elapsed = time - track.lastSeen;
+		if(elapsed > 0)
+		{
+			double measuredX = (blob.x - track.blob.x)/elapsed;
+			double measuredY = (blob.y - track.blob.y)/elapsed;
+
+			//the first measurement is all there is to go on
+			if(track.age == 1)
+			{
+				track.vx = measuredX;
+				track.vy = measuredY;
+			}
+			else
+			{
+				track.vx += VELOCITY_SMOOTHING*(measuredX - track.vx);
+				track.vy += VELOCITY_SMOOTHING*(measuredY - track.vy);
+			}
+		}
+		track.blob 			= blob;
+		track.lastSeen 		= time;
+		track.age++;
+		track.missedFrames 	= 0;
+	}
+
+	//drop tracks that have been gone too long. The order of the tracks doesn't matter so the last one is moved into the gap.
+	for(t=tracks.size()-1; t>=0; t--)
+	{
+		if(tracks[t].missedFrames <= maxMissedFrames) continue;
+		tracks[t] = tracks.back();
+		tracks.pop_back();
+	}
+
+	//blobs that weren't matched are new
+	for(i=0; i<blobs.size(); i++)
+	{
+		if(blobTrackIds[i] != -1) continue;
+
+		newTrack.id 			= nextId++;
+		newTrack.blob 			= blobs[i];
+		newTrack.vx 			= 0;
+		newTrack.vy 			= 0;
+		newTrack.lastSeen 		= time;
+		newTrack.age 			= 1;
+		newTrack.missedFrames 	= 0;
+		tracks.push_back(newTrack);
+		blobTrackIds[i] = newTrack.id;
+	}
+
+	return tracks.size();
+}
+
+/**
+ * Forgets every track. IDs carry on from where they were so they aren't reused.
+ * */
+void BlobTracker::reset(void)
+{
+	tracks.clear();
+	blobTrackIds.clear();
+	return;
+}
+
+/**
+ * @returns the tracks, including ones that weren't seen in the last frame (whose missedFrames is more than 0).
+ * The reference is only valid until the next update.
+ * */
+const std::vector<BlobTracker::Track>& BlobTracker::getTracks(void)
+{
+	return tracks;
+}
+
+int BlobTracker::getNumberOfTracks(void)
+{
+	return tracks.size();
+}
+
+/**
+ * Tells you which track a blob from the last update was matched to.
+ * @param blobIndex the index of the blob in the vector given to the last update.
+ * @returns the ID of the blob's track, or -1 if there is no such blob.
+ * */
+int BlobTracker::getTrackId(int blobIndex)
+{
+	if(blobIndex < 0 || blobIndex >= (int)blobTrackIds.size()) return -1;
+	return blobTrackIds[blobIndex];
+}
+
+
+/*====================================================================
+			PRIVATE FUNCTIONS
+====================================================================*/
+
+/**
+ * Predicts where each track is at the given time and sorts the tracks into the hash grid by their predicted position.
+ * */
+void BlobTracker::fillBuckets(double time)
+{
+	int numberTracks = tracks.size();
+	int t, bucket;
+
+	predictedX.resize(numberTracks);
+	predictedY.resize(numberTracks);
+	bucketTracks.resize(numberTracks);
+	std::fill(bucketStart.begin(), bucketStart.end(), 0);
+
+	for(t=0; t<numberTracks; t++)
+	{
+		double elapsed = time - tracks[t].lastSeen;
+		predictedX[t] = tracks[t].blob.x + tracks[t].vx*elapsed;
+		predictedY[t] = tracks[t].blob.y + tracks[t].vy*elapsed;
+		bucketStart[getBucket(getCell(predictedX[t]), getCell(predictedY[t]))]++;
+	}
+
+	//counting sort: make bucketStart the end of each bucket, then fill each bucket from the back
+	for(bucket=1; bucket<=NUMBER_OF_BUCKETS; bucket++)
+	{
+		bucketStart[bucket] += bucketStart[bucket-1];
+	}
+	for(t=numberTracks-1; t>=0; t--)
+	{
+		bucket = getBucket(getCell(predictedX[t]), getCell(predictedY[t]));
+		bucketTracks[--bucketStart[bucket]] = t;
+	}
+	return;
+}
+
+/**
+ * Finds every track and blob close enough to be matched, and how good a match each is.
+ * */
+void BlobTracker::findMatches(const std::vector<EPuck::Blob> &blobs)
+{
+	int visited[9];
+	int numberVisited, cellX, cellY, dx, dy, bucket, i, k, t;
+	unsigned int b;
+	track_match_t match;
+
+	matches.clear();
+	for(b=0; b<blobs.size(); b++)
+	{
+		const EPuck::Blob &blob = blobs[b];
+		cellX = getCell(blob.x);
+		cellY = getCell(blob.y);
+		numberVisited = 0;
+
+		for(dx=-1; dx<=1; dx++)
+		{
+			for(dy=-1; dy<=1; dy++)
+			{
+				//different cells can hash to the same bucket, which only needs looking at once
+				bucket = getBucket(cellX+dx, cellY+dy);
+				for(i=0; i<numberVisited && visited[i] != bucket; i++);
+				if(i < numberVisited) continue;
+				visited[numberVisited++] = bucket;
+
+				for(k=bucketStart[bucket]; k<bucketStart[bucket+1]; k++)
+				{
+					t = bucketTracks[k];
+					const EPuck::Blob &last = tracks[t].blob;
+
+					if(((last.colour ^ blob.colour) & 0x00FFFFFF) != 0) continue;
+
+					double distance = hypot(blob.x - predictedX[t], blob.y - predictedY[t]);
+					if(distance > maxDistance) continue;
+
+					match.cost 	= distance
+								+ abs((blob.right - blob.left) - (last.right - last.left))
+								+ abs((blob.bottom - blob.top) - (last.bottom - last.top));
+					match.track = t;
+					match.blob 	= b;
+					matches.push_back(match);
+				}
+			}
+		}
+	}
+	return;
+}
+
+/**
+ * @returns the bucket of the hash grid a cell is in.
+ * */
+int BlobTracker::getBucket(int cellX, int cellY)
+{
+	return (int)(((unsigned int)cellX*73856093u ^ (unsigned int)cellY*19349663u) & (NUMBER_OF_BUCKETS-1));
+}
+
+/**
+ * @returns the column or row of the hash grid a coordinate is in.
+ * */
+int BlobTracker::getCell(double coordinate)
+{
+	return (int)floor(coordinate/maxDistance);
+}
@@ -0,0 +1,240 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include <map>
+#include <vector>
+#include <algorithm>
+#include "BlobTracker.h"
+
+/**
+Benchmark program for BlobTracker.
+Plays a sequence of frames of blobs through a tracker and prints how long each update takes, and how often a blob's track ID
+changed when it shouldn't have.
+
+Sequences are text files. Each frame starts with a line <code>frame time numberBlobs</code>, followed by one line per blob:
+<code>trueId colour area x y left right top bottom</code>, where colour is in hex and trueId is the object the blob really is,
+or -1 if that isn't known. ID switches are only counted for blobs whose trueId is known.
+
+<code>BlobTrackerBenchmark sequence.txt</code> plays a recorded sequence.<br>
+<code>BlobTrackerBenchmark</code> makes up sequences of objects moving about in front of the camera and plays those.<br>
+<code>BlobTrackerBenchmark -w sequence.txt objects frames</code> writes a made up sequence to a file.
+*/
+
+typedef struct recorded_frame
+{
+	double time;
+	std::vector<EPuck::Blob> blobs;
+	std::vector<int> trueIds;
+}recorded_frame_t;
+
+typedef struct moving_object
+{
+	double x, y, vx, vy;
+	int width, height;
+	uint32_t colour;
+}moving_object_t;
+
+static double getRealTime(void)
+{
+	struct timeval now;
+	gettimeofday(&now, NULL);
+	return (double)now.tv_sec + (double)now.tv_usec/1000000;
+}
+
+static double randomBetween(double low, double high)
+{
+	return low + (high-low)*rand()/RAND_MAX;
+}
+
+/**
+Makes up a sequence of objects bouncing around a 640x480 image at 30 frames per second. Objects are sometimes missed by the
+blobfinder, have a pixel or so of noise, and are listed in a different order each frame.
+*/
+static void makeSequence(int numberObjects, int numberFrames, std::vector<recorded_frame_t> &sequence)
+{
+	const uint32_t colours[4] = {0xff0000, 0x00ff00, 0x0000ff, 0xffff00};
+	std::vector<moving_object_t> objects(numberObjects);
+	std::vector<int> order(numberObjects);
+	EPuck::Blob blob;
+	int i, f;
+
+	srand(1);
+	for(i=0; i<numberObjects; i++)
+	{
+		objects[i].x 		= randomBetween(20, 620);
+		objects[i].y 		= randomBetween(20, 460);
+		objects[i].vx 		= randomBetween(-120, 120);
+		objects[i].vy 		= randomBetween(-120, 120);
+		objects[i].width 	= (int)randomBetween(8, 30);
+		objects[i].height 	= (int)randomBetween(8, 30);
+		objects[i].colour 	= colours[i%4];
+		order[i] = i;
+	}
+
+	sequence.resize(numberFrames);
+	for(f=0; f<numberFrames; f++)
+	{
+		recorded_frame_t &frame = sequence[f];
+		frame.time = f/30.0;
+		frame.blobs.clear();
+		frame.trueIds.clear();
+
+		std::random_shuffle(order.begin(), order.end());
+		for(i=0; i<numberObjects; i++)
+		{
+			moving_object_t &object = objects[order[i]];
+
+			object.x += object.vx/30;
+			object.y += object.vy/30;
+			if(object.x < 0 || object.x > 640) object.vx = -object.vx;
+			if(object.y < 0 || object.y > 480) object.vy = -object.vy;
+
+			//the blobfinder misses one in twenty
+			if(rand()%20 == 0) continue;
+
+			blob.id 	= frame.blobs.size();
+			blob.colour = object.colour;
+			blob.x 		= (int)(object.x + randomBetween(-1, 1));
+			blob.y 		= (int)(object.y + randomBetween(-1, 1));
+			blob.left 	= blob.x - object.width/2;
+			blob.right 	= blob.x + object.width/2;
+			blob.top 	= blob.y - object.height/2;
+			blob.bottom = blob.y + object.height/2;
+			blob.area 	= object.width*object.height;
+			frame.blobs.push_back(blob);
+			frame.trueIds.push_back(order[i]);
+		}
+	}
+	return;
+}
+
+static bool readSequence(char *fileName, std::vector<recorded_frame_t> &sequence)
+{
+	FILE *file = fopen(fileName, "r");
+	recorded_frame_t frame;
+	EPuck::Blob blob;
+	int numberBlobs, trueId, i;
+
+	if(file == NULL) return false;
+
+	while(fscanf(file, " frame %lf %d", &frame.time, &numberBlobs) == 2)
+	{
+		frame.blobs.clear();
+		frame.trueIds.clear();
+		for(i=0; i<numberBlobs; i++)
+		{
+			if(fscanf(file, "%d %x %d %d %d %d %d %d %d", &trueId, &blob.colour, &blob.area, &blob.x, &blob.y,
+					&blob.left, &blob.right, &blob.top, &blob.bottom) != 9) break;
+			blob.id = i;
+			frame.blobs.push_back(blob);
+			frame.trueIds.push_back(trueId);
+		}
+		sequence.push_back(frame);
+	}
+	fclose(file);
+	return true;
+}
+
+static bool writeSequence(char *fileName, std::vector<recorded_frame_t> &sequence)
+{
+	FILE *file = fopen(fileName, "w");
+	unsigned int f, i;
+
+	if(file == NULL) return false;
+
+	for(f=0; f<sequence.size(); f++)
+	{
+		fprintf(file, "frame %f %d\n", sequence[f].time, (int)sequence[f].blobs.size());
+		for(i=0; i<sequence[f].blobs.size(); i++)
+		{
+			EPuck::Blob &blob = sequence[f].blobs[i];
+			fprintf(file, "%d %06x %d %d %d %d %d %d %d\n", sequence[f].trueIds[i], blob.colour, blob.area, blob.x, blob.y,
+					blob.left, blob.right, blob.top, blob.bottom);
+		}
+	}
+	fclose(file);
+	return true;
+}
+
+/**
+Plays a sequence through a tracker and prints the results on one line.
+*/
+static void runSequence(const char *name, std::vector<recorded_frame_t> &sequence)
+{
+	BlobTracker tracker;
+	std::map<int, int> lastTrack;
+	std::map<int, int>::iterator it;
+	double start, elapsed, total = 0, slowest = 0;
+	long numberBlobs = 0;
+	int idSwitches = 0;
+	int highestId = -1;
+	unsigned int f, i;
+
+	for(f=0; f<sequence.size(); f++)
+	{
+		start = getRealTime();
+		tracker.update(sequence[f].blobs, sequence[f].time);
+		elapsed = getRealTime() - start;
+
+		total += elapsed;
+		if(elapsed > slowest) slowest = elapsed;
+		numberBlobs += sequence[f].blobs.size();
+
+		for(i=0; i<sequence[f].blobs.size(); i++)
+		{
+			int trackId = tracker.getTrackId(i);
+			if(trackId > highestId) highestId = trackId;
+			if(sequence[f].trueIds[i] < 0) continue;
+
+			it = lastTrack.find(sequence[f].trueIds[i]);
+			if(it != lastTrack.end() && it->second != trackId) idSwitches++;
+			lastTrack[sequence[f].trueIds[i]] = trackId;
+		}
+	}
+
+	if(sequence.size() == 0) return;
+	printf("%s\t%d\t%.1f\t\t%.2f\t\t%.2f\t\t%d\t%d\n", name, (int)sequence.size(), (double)numberBlobs/sequence.size(),
+			1000000*total/sequence.size(), 1000000*slowest, highestId+1, idSwitches);
+	return;
+}
+
+int main(int argc, char** argv)
+{
+	std::vector<recorded_frame_t> sequence;
+	const int objectCounts[5] = {4, 8, 16, 32, 64};
+	char name[32];
+	int i;
+
+	if(argc > 2 && strcmp(argv[1], "-w") == 0)
+	{
+		makeSequence(argc > 3 ? atoi(argv[3]) : 16, argc > 4 ? atoi(argv[4]) : 1000, sequence);
+		if(!writeSequence(argv[2], sequence))
+		{
+			printf("Couldn't write %s\n", argv[2]);
+			return 1;
+		}
+		return 0;
+	}
+
+	printf("sequence\tframes\tblobs/frame\tmean (us)\tmax (us)\ttracks\tID switches\n");
+
+	if(argc > 1)
+	{
+		if(!readSequence(argv[1], sequence))
+		{
+			printf("Couldn't read %s\n", argv[1]);
+			return 1;
+		}
+		runSequence(argv[1], sequence);
+		return 0;
+	}
+
+	for(i=0; i<5; i++)
+	{
+		sprintf(name, "%d objects", objectCounts[i]);
+		makeSequence(objectCounts[i], 10000, sequence);
+		runSequence(name, sequence);
+	}
+	return 0;
+}
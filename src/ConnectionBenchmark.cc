@@ -0,0 +1,81 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/time.h>
+#include <vector>
+#include "EPuckSim.h"
+
+/**
+Benchmark program for the shared Player connections.
+Connects to a simulation of robots called robot1, robot2 ... robotN and prints how long it took to start them all up,
+how many connections to Player were opened, and how long the calls that go through Player take on average.
+
+Run it with a simulation already going, eg <code>ConnectionBenchmark 50 6665 6664 1</code>.
+Arguments are the number of robots, the first robot port, the simulation port, and whether every robot is on its own port (1)
+or they are all served on the first port with index 0, 1, 2 ... (0). All are optional.
+*/
+
+static double getRealTime(void)
+{
+	struct timeval now;
+	gettimeofday(&now, NULL);
+	return (double)now.tv_sec + (double)now.tv_usec/1000000;
+}
+
+int main(int argc, char** argv)
+{
+	int numberRobots 	= 10;
+	int firstPort 		= 6665;
+	int simulationPort 	= 6664;
+	int portPerRobot 	= 1;
+	int repeats 		= 1000;
+	std::vector<EPuckSim*> robots;
+	char name[32];
+	double start, startupTime, x, y, yaw;
+	int i, j;
+
+	if(argc > 1) numberRobots 	= atoi(argv[1]);
+	if(argc > 2) firstPort 		= atoi(argv[2]);
+	if(argc > 3) simulationPort = atoi(argv[3]);
+	if(argc > 4) portPerRobot 	= atoi(argv[4]);
+
+	//start up
+	start = getRealTime();
+	for(i=0; i<numberRobots; i++)
+	{
+		sprintf(name, "robot%d", i+1);
+		if(portPerRobot) robots.push_back(new EPuckSim(name, firstPort+i, simulationPort, 0));
+		else robots.push_back(new EPuckSim(name, firstPort, simulationPort, i));
+	}
+	startupTime = getRealTime() - start;
+
+	printf("\n%d robots started in %f s (%f ms per robot), using %d Player connections.\n",
+			numberRobots, startupTime, 1000*startupTime/numberRobots,
+			ConnectionManager::GetConnectionManager()->getNumberOfClients());
+
+	//per call latency, averaged over every robot
+	printf("call\t\t\tmean latency (us)\n");
+
+	start = getRealTime();
+	for(j=0; j<repeats; j++)
+	{
+		for(i=0; i<numberRobots; i++) robots[i]->readSensors();
+	}
+	printf("readSensors\t\t%f\n", 1000000*(getRealTime()-start)/(repeats*numberRobots));
+
+	start = getRealTime();
+	for(j=0; j<repeats; j++)
+	{
+		for(i=0; i<numberRobots; i++) robots[i]->getPosition(x, y, yaw);
+	}
+	printf("getPosition\t\t%f\n", 1000000*(getRealTime()-start)/(repeats*numberRobots));
+
+	start = getRealTime();
+	for(j=0; j<repeats; j++)
+	{
+		for(i=0; i<numberRobots; i++) robots[i]->toggleAllLEDs();
+	}
+	printf("toggleAllLEDs\t\t%f\n", 1000000*(getRealTime()-start)/(repeats*numberRobots));
+
+	for(i=0; i<numberRobots; i++) delete robots[i];
+	return 0;
+}
@@ -0,0 +1,164 @@
+/*
+ * ConnectionManager.cc
+ *
+ */
+
+#include "ConnectionManager.h"
+
+
+ConnectionManager* ConnectionManager::_instance = 0;
+boost::mutex ConnectionManager::instanceMutex;
+
+
+ConnectionManager::ConnectionManager(void)
+{
+	printf("ConnectionManager initialised\n");
+	return;
+}
+
+/**
+ * Function that allows ConnectionManager to be a singleton. Use this to construct the ConnectionManager object.
+ * */
+ConnectionManager* ConnectionManager::GetConnectionManager(void)
+{
+	boost::mutex::scoped_lock lock(instanceMutex);
+
+	if(_instance == 0)
+	{
+		_instance = new ConnectionManager();
+	}
+	return _instance;
+}
+
+ConnectionManager::~ConnectionManager()
+{
+	std::map<int, PlayerCc::SimulationProxy*>::iterator sim;
+	std::map<int, player_connection_t>::iterator it;
+
+	for(sim = simulationProxies.begin(); sim != simulationProxies.end(); sim++)
+	{
+		delete sim->second;
+	}
+	for(it = clients.begin(); it != clients.end(); it++)
+	{
+		delete it->second.client;
+	}
+
+	printf("ConnectionManager destroyed.\n");
+	return;
+}
+
+/**
+ * Gets a client connected to the Player server on the given port, opening one if there isn't one already.
+ * Each call must be matched by a call to releaseClient() when the robot is finished with it.
+ * @param port the port to connect to.
+ * @returns the shared client for that port.
+ * @throws PlayerCc::PlayerError if there is no Player server on that port.
+ * */
+PlayerCc::PlayerClient* ConnectionManager::getClient(int port)
+{
+	boost::mutex::scoped_lock lock(connectionMutex);
+	return openClient(port);
+}
+
+/**
+ * Tells the manager that a robot has finished with a client. The connection is closed once nothing is using it.
+ * @param client a client returned by getClient().
+ * */
+void ConnectionManager::releaseClient(PlayerCc::PlayerClient *client)
+{
+	std::map<int, player_connection_t>::iterator it;
+	boost::mutex::scoped_lock lock(connectionMutex);
+
+	for(it = clients.begin(); it != clients.end(); it++)
+	{
+		if(it->second.client == client)
+		{
+			it->second.users--;
+			if(it->second.users <= 0)
+			{
+				delete it->second.client;
+				clients.erase(it);
+			}
+			return;
+		}
+	}
+
+	return;
+}
+
+/**
+ * Gets the SimulationProxy for the simulation on the given port. Every robot in the simulation shares the same one.
+ * @param simulationPort the port on which the simulation is running. Get this from the .cfg file of your simulation.
+ * @returns the shared SimulationProxy.
+ * @throws PlayerCc::PlayerError if there is no Player server on that port.
+ * */
+PlayerCc::SimulationProxy* ConnectionManager::getSimulationProxy(int simulationPort)
+{
+	std::map<int, PlayerCc::SimulationProxy*>::iterator it;
+	PlayerCc::SimulationProxy *proxy;
+	boost::mutex::scoped_lock lock(connectionMutex);
+
+	it = simulationProxies.find(simulationPort);
+	if(it != simulationProxies.end()) return it->second;
+
+	//the proxy keeps its own reference to the client, which is never released
+	proxy = new PlayerCc::SimulationProxy(openClient(simulationPort), 0);
+	simulationProxies[simulationPort] = proxy;
+	return proxy;
+}
+
+/**
+ * Gets the client that the shared SimulationProxy for the given port is attached to.
+ * @param simulationPort the port on which the simulation is running.
+ * @returns the client handling the simulation.
+ * @throws PlayerCc::PlayerError if there is no Player server on that port.
+ * */
+PlayerCc::PlayerClient* ConnectionManager::getSimulationClient(int simulationPort)
+{
+	getSimulationProxy(simulationPort);
+
+	boost::mutex::scoped_lock lock(connectionMutex);
+	return clients[simulationPort].client;
+}
+
+/**
+ * Returns the number of connections to the Player server that are currently open.
+ * @returns the number of open clients.
+ * */
+int ConnectionManager::getNumberOfClients(void)
+{
+	boost::mutex::scoped_lock lock(connectionMutex);
+	return (int)clients.size();
+}
+
+
+//==================================================================================================
+//							PRIVATE FUNCTIONS
+//==================================================================================================
+
+
+/**
+ * Finds the client for a port, or connects a new one, and adds a user to it. Must be called with connectionMutex held.
+ * @param port the port to connect to.
+ * @returns the client for that port.
+ * */
+PlayerCc::PlayerClient* ConnectionManager::openClient(int port)
+{
+	std::map<int, player_connection_t>::iterator it;
+	player_connection_t connection;
+
+	it = clients.find(port);
+	if(it != clients.end())
+	{
+		it->second.users++;
+		return it->second.client;
+	}
+
+	//if this throws nothing has been added to the map
+	connection.client = new PlayerCc::PlayerClient("localhost", port);
+	connection.users = 1;
+	clients[port] = connection;
+
+	return connection.client;
+}
@@ -0,0 +1,315 @@
+#include <algorithm>
+#include "EPuckHeadless.h"
+
+
+/*====================================================================
+			CONSTRUCTOR/DESTRUCTOR
+====================================================================*/
+
+/**
+Creates an e-puck in a headless world.
+@param headlessWorld the world the robot is in.
+@param robotName the name of the robot model in the worldfile eg robot1, robot2 etc. If there isn't a robot with that name
+in the world one is added at the origin. Maximum 32 chars.
+*/
+EPuckHeadless::EPuckHeadless(HeadlessWorld *headlessWorld, char* robotName)
+{
+	strncpy(name, robotName, 31);
+	name[31] = '\0';
+	world 				= headlessWorld;
+	handler 			= NULL;
+	audioInitialised 	= false;
+
+	index = world->findRobot(name);
+	if(index < 0)
+	{
+		printf("There is no robot called %s in the headless world, adding one at (0, 0).\n", name);
+		index = world->addRobot(name, 0, 0, 0);
+	}
+	return;
+}
+
+/**
+Stops the robot. The world carries on without it.
+*/
+EPuckHeadless::~EPuckHeadless(void)
+{
+	world->setSpeed(index, 0, 0);
+	world->flashLEDs(index, 0);
+	return;
+}
+
+
+/*
+	READ SENSORS
+*/
+
+void EPuckHeadless::readSensors(void)
+{
+	SensorFrame frame;
+	int i;
+
+	world->getIRReadings(index, frame.irReadings);
+	world->getBlobs(index, blobs);
+
+	frame.time 			= getTime();
+	frame.batteryVolts 	= getBatteryVolts();
+	frame.numberOfIRs 	= HeadlessWorld::NUMBER_OF_IRS;
+	frame.cameraWidth 	= HeadlessWorld::CAMERA_WIDTH;
+	frame.cameraHeight 	= HeadlessWorld::CAMERA_HEIGHT;
+	frame.totalBlobs 	= blobs.size();
+	frame.numberBlobs 	= std::min(frame.totalBlobs, (int)SensorFrame::MAX_BLOBS);
+	for(i=0; i<frame.numberBlobs; i++) frame.blobs[i] = blobs[i];
+
+	frameBuffer.publish(frame);
+	return;
+}
+
+void EPuckHeadless::getSensorFrame(SensorFrame &frame)
+{
+	frameBuffer.read(frame);
+	return;
+}
+
+void EPuckHeadless::waitForSensorFrame(SensorFrame &frame)
+{
+	//the frame buffer can have moved on again by the time it is read, which is fine as the frame is only ever newer
+	frameBuffer.waitForFrame(frame.sequence);
+	frameBuffer.read(frame);
+	return;
+}
+
+double EPuckHeadless::getTime(void)
+{
+	return world->getTime();
+}
+
+void EPuckHeadless::waitMilliseconds(int timeMs)
+{
+	//the world moves the shared clock on each step
+	SimulationClock::GetSimulationClock(NULL, name)->waitSeconds((double)timeMs/1000);
+	return;
+}
+
+double EPuckHeadless::getBatteryVolts(void)
+{
+	return EPuck::MAXIMUM_BATTERY_VOLTAGE;
+}
+
+void EPuckHeadless::getPosition(double& x, double& y, double& yaw)
+{
+	world->getPose(index, x, y, yaw);
+	return;
+}
+
+void EPuckHeadless::setPosition(double x, double y, double yaw)
+{
+	world->setPose(index, x, y, yaw);
+	return;
+}
+
+//************INFRA-RED SENSORS*******************
+
+double* EPuckHeadless::getIRReadings(void)
+{
+	//copied from the latest frame into a buffer the calling thread keeps, so readSensors() never writes an array a caller
+	//is reading. Each robot has its own buffer, so a thread can hold on to the readings of more than one robot.
+	SensorFrame frame;
+
+	if(irBuffer.get() == NULL) irBuffer.reset(new std::vector<double>(SensorFrame::MAX_IRS, 0.0));
+	frameBuffer.read(frame);
+	std::copy(frame.irReadings, frame.irReadings + frame.numberOfIRs, irBuffer->begin());
+	return &(*irBuffer)[0];
+}
+
+double EPuckHeadless::getIRReading(int index)
+{
+	SensorFrame frame;
+
+	frameBuffer.read(frame);
+	return frame.irReadings[index];
+}
+
+int EPuckHeadless::getNumberOfIRs(void)
+{
+	return HeadlessWorld::NUMBER_OF_IRS;
+}
+
+//************BLOBFINDER SENSORS*******************
+
+int EPuckHeadless::getCameraWidth(void)
+{
+	return HeadlessWorld::CAMERA_WIDTH;
+}
+
+int EPuckHeadless::getCameraHeight(void)
+{
+	return HeadlessWorld::CAMERA_HEIGHT;
+}
+
+int EPuckHeadless::getNumberBlobs(void)
+{
+	return blobs.size();
+}
+
+EPuck::Blob EPuckHeadless::getBlob(int index)
+{
+	return blobs[index];
+}
+
+int EPuckHeadless::getBlobs(std::vector<Blob> &blobs, const BlobFilter &filter)
+{
+	SensorFrame frame;
+
+	frameBuffer.read(frame);
+	return frame.getBlobs(blobs, filter);
+}
+
+
+/*
+	USE ACTUATORS
+*/
+
+//*************************** MOTORS *****************************
+
+void EPuckHeadless::setMotors(double forward, double turnrate)
+{
+	if(forward > EPuck::MAX_WHEEL_SPEED) forward = EPuck::MAX_WHEEL_SPEED;
+	if(forward < (-1)*EPuck::MAX_WHEEL_SPEED) forward = (-1)*EPuck::MAX_WHEEL_SPEED;
+	world->setSpeed(index, forward, turnrate);
+	return;
+}
+
+void EPuckHeadless::setDifferentialMotors(double left, double right)
+{
+	const double separation = 52*0.001; //52 millimetres
+
+	//limit wheel speeds to+/- maximum
+	if(left > EPuck::MAX_WHEEL_SPEED) left = EPuck::MAX_WHEEL_SPEED;
+	if(left < (-1)*EPuck::MAX_WHEEL_SPEED) left = (-1)*EPuck::MAX_WHEEL_SPEED;
+	if(right > EPuck::MAX_WHEEL_SPEED) right = EPuck::MAX_WHEEL_SPEED;
+	if(right < (-1)*EPuck::MAX_WHEEL_SPEED) right = (-1)*EPuck::MAX_WHEEL_SPEED;
+
+	//same conversion as EPuckSim::setDifferentialMotors, so a controller drives the same way in both: the robot moves
+	//forward at the inner wheel's speed and turns by the difference between the wheels over the wheel separation
+	if(left > right)
+	{
+		setMotors(right, (-1)*(left - right)/separation);
+	}
+	else
+	{
+		setMotors(left, (right - left)/separation);
+	}
+	return;
+}
+
+//*************************** LEDS *****************************
+
+void EPuckHeadless::setAllLEDsOn(void)
+{
+	world->setLEDs(index, true);
+	return;
+}
+
+void EPuckHeadless::setAllLEDsOff(void)
+{
+	world->setLEDs(index, false);
+	return;
+}
+
+void EPuckHeadless::toggleAllLEDs(void)
+{
+	world->setLEDs(index, !world->getLEDs(index));
+	return;
+}
+
+void EPuckHeadless::setLED(int index, int state)
+{
+	//like in Stage the entire robot can be either on or off.
+	if(state == 1) setAllLEDsOn();
+	else setAllLEDsOff();
+	return;
+}
+
+void EPuckHeadless::flashLEDs(double frequency)
+{
+	//flashing follows simulated time so it is done by the world each step
+	world->flashLEDs(index, frequency);
+	return;
+}
+
+void EPuckHeadless::stopFlashLEDs(void)
+{
+	world->flashLEDs(index, 0);
+	return;
+}
+
+//******************************* AUDIO *************************************
+
+int EPuckHeadless::initaliseAudio(void)
+{
+	if(!audioInitialised)
+	{
+		handler = world->getAudioHandler(name);
+		audioInitialised = true;
+		return 0;
+	}
+
+	return -1;
+}
+
+AudioHandler* EPuckHeadless::getAudioHandler(void)
+{
+	return handler;
+}
+
+int EPuckHeadless::playTone(int frequency, double duration)
+{
+	if(audioInitialised)
+	{
+		handler->playTone(frequency, duration, name);
+		return 0;
+	}
+
+	printf("Unsuccessful epuck %s playTone() request. Audio not initialised.\n", name);
+	return -1;
+}
+
+std::vector<EPuck::Tone> EPuckHeadless::listenForTones(void)
+{
+	std::vector<EPuck::Tone> out;
+
+	listenForTones(out);
+	return out;
+}
+
+int EPuckHeadless::listenForTones(std::vector<EPuck::Tone> &tones)
+{
+	//each thread that listens gets its own message buffer which it keeps between calls, as in EPuckSim
+	static boost::thread_specific_ptr< std::vector<AudioHandler::audio_message_t> > messageBuffer;
+	int numberOfTones;
+
+	tones.clear();
+
+	if(!audioInitialised)
+	{
+		printf("Unsuccessful epuck %s listenToTones() request. Audio not initialised.\n", name);
+		return -1;
+	}
+
+	if(messageBuffer.get() == NULL) messageBuffer.reset(new std::vector<AudioHandler::audio_message_t>);
+	std::vector<AudioHandler::audio_message_t> &message = *messageBuffer;
+
+	numberOfTones = handler->getTones(name, message);
+
+	for(int i=0; i<numberOfTones; i++)
+	{
+		EPuck::Tone t;
+		t.distance 	= message[i].distance;
+		t.bearing 	= message[i].direction;
+		t.frequency = message[i].frequency;
+		tones.push_back(t);
+	}
+
+	return numberOfTones;
+}
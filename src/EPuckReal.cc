@@ -1,5 +1,6 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <algorithm>
 
 #include "EPuckReal.h"
 
@@ -13,6 +14,7 @@ EPuckReal::EPuckReal(void)
 {
 	//initialise member variables
 	allLEDsOn			= false;
+	flashTask 			= -1;
 
 	//make proxies
 	try
@@ -31,9 +33,6 @@ EPuckReal::EPuckReal(void)
 		return;
 	}
 
-	//start threads
-	pthread_create(&readSensorsThread, 0, EPuckReal::startReadSensorThread, this);
-
 	//open file with system time in it
 	//TODO in real robots change line below to
 	//FILE *fp = fopen("/home/utils/systemtime.data", "r");
@@ -43,14 +42,18 @@ EPuckReal::EPuckReal(void)
 	fgets(readBuffer, 32, fp);
 	startTime = atof(readBuffer) + time(NULL);
 	srand(startTime);
+
+	//start threads last, so the first frames are stamped with the right time
+	readSensorsThread = boost::thread(&EPuckReal::readSensorsThreaded, this);
 }
 
 
 EPuckReal::~EPuckReal(void)
 {
 	//close threads
-	pthread_cancel(readSensorsThread);
-	stopFlashLEDs();	//stops the flashing LEDs and closes the thread
+	readSensorsThread.interrupt();
+	readSensorsThread.join();
+	stopFlashLEDs();	//stops the flashing LEDs
 
 
 	//free the items in memory
@@ -83,7 +86,38 @@ EPuckReal::~EPuckReal(void)
 
 void EPuckReal::readSensors(void)
 {	
+	SensorFrame frame;
+	int i;
+
 	epuck->Read();
+
+	//take a snapshot of everything the proxies now hold and publish it
+	frame.time 			= getTime();
+	frame.batteryVolts 	= getBatteryVolts();
+	frame.numberOfIRs 	= std::min(getNumberOfIRs(), (int)SensorFrame::MAX_IRS);
+	for(i=0; i<frame.numberOfIRs; i++) frame.irReadings[i] = irProxy->GetRange(i);
+
+	frame.cameraWidth 	= getCameraWidth();
+	frame.cameraHeight 	= getCameraHeight();
+	frame.totalBlobs 	= blobProxy->GetCount();
+	frame.numberBlobs 	= std::min(frame.totalBlobs, (int)SensorFrame::MAX_BLOBS);
+	for(i=0; i<frame.numberBlobs; i++) frame.blobs[i] = convertBlob(blobProxy->GetBlob(i));
+
+	frameBuffer.publish(frame);
+	return;
+}
+
+void EPuckReal::getSensorFrame(SensorFrame &frame)
+{
+	frameBuffer.read(frame);
+	return;
+}
+
+void EPuckReal::waitForSensorFrame(SensorFrame &frame)
+{
+	//the frame buffer can have moved on again by the time it is read, which is fine as the frame is only ever newer
+	frameBuffer.waitForFrame(frame.sequence);
+	frameBuffer.read(frame);
 	return;
 }
 
@@ -103,20 +137,23 @@ double EPuckReal::getBatteryVolts(void)
 
 double* EPuckReal::getIRReadings(void)
 {
-	int i;
-	
-	for(i=0; i<getNumberOfIRs(); i++)
-	{
-		irReadings[i] = irProxy->GetRange(i);
-	}	
-	
-	return irReadings;
+	//copied from the latest frame into a buffer the calling thread keeps, so readSensors() never writes an array a caller
+	//is reading. Each robot has its own buffer, so a thread can hold on to the readings of more than one robot.
+	SensorFrame frame;
+
+	if(irBuffer.get() == NULL) irBuffer.reset(new std::vector<double>(SensorFrame::MAX_IRS, 0.0));
+	frameBuffer.read(frame);
+	std::copy(frame.irReadings, frame.irReadings + frame.numberOfIRs, irBuffer->begin());
+	return &(*irBuffer)[0];
 }
 
 
 double EPuckReal::getIRReading(int index)
 {
-	return irProxy->GetRange(index);
+	SensorFrame frame;
+
+	frameBuffer.read(frame);
+	return frame.irReadings[index];
 }
 
 
@@ -170,19 +207,30 @@ int EPuckReal::getNumberBlobs(void)
  * */
 EPuck::Blob EPuckReal::getBlob(int index)
 {
-	player_blobfinder_blob_t oldBlob;
+	return convertBlob(blobProxy->GetBlob(index));
+}
+
+int EPuckReal::getBlobs(std::vector<Blob> &blobs, const BlobFilter &filter)
+{
+	SensorFrame frame;
+
+	frameBuffer.read(frame);
+	return frame.getBlobs(blobs, filter);
+}
+
+EPuck::Blob EPuckReal::convertBlob(const player_blobfinder_blob_t &blob)
+{
 	EPuck::Blob newBlob;
 
-	oldBlob = blobProxy->GetBlob(index);
-	newBlob.id = (int)oldBlob.id;
-	newBlob.colour = oldBlob.color;
-	newBlob.area = (int)oldBlob.area;
-	newBlob.x = (int)oldBlob.x;
-	newBlob.y = (int)oldBlob.y;
-	newBlob.left = (int)oldBlob.left;
-	newBlob.right = (int)oldBlob.right;
-	newBlob.top = (int)oldBlob.top;
-	newBlob.bottom = (int)oldBlob.bottom;
+	newBlob.id = (int)blob.id;
+	newBlob.colour = blob.color;
+	newBlob.area = (int)blob.area;
+	newBlob.x = (int)blob.x;
+	newBlob.y = (int)blob.y;
+	newBlob.left = (int)blob.left;
+	newBlob.right = (int)blob.right;
+	newBlob.top = (int)blob.top;
+	newBlob.bottom = (int)blob.bottom;
 
 	return newBlob;
 }
@@ -321,19 +369,20 @@ void EPuckReal::flashLEDs(double frequency)
 		return;
 	}
 
-	LEDFlashFrequency = frequency;
-	pthread_create(&flashLEDsThread, 0, EPuckReal::startFlashLEDsThread, this);
+	//the LEDs are toggled each half period by the timer wheel shared by everything in the program
+	stopFlashLEDs();
+	flashTask = TimerWheel::GetRealTimeWheel()->schedule(boost::bind(&EPuckReal::toggleAllLEDs, this), 0.5/frequency);
 	return;
 }
 
 
 void EPuckReal::stopFlashLEDs(void)
 {
-//	if(LEDFlashFrequency != 0)
-//	{
-//		pthread_cancel(flashLEDsThread);
-		LEDFlashFrequency = 0;
-//	}
+	if(flashTask >= 0)
+	{
+		TimerWheel::GetRealTimeWheel()->cancel(flashTask);
+		flashTask = -1;
+	}
 	return;
 }
 
@@ -397,6 +446,12 @@ std::vector<EPuck::Tone> EPuckReal::listenForTones(void)
 	return t;
 }
 
+int EPuckReal::listenForTones(std::vector<EPuck::Tone> &tones)
+{
+	tones.clear();
+	return -1;
+}
+
 
 
 /*
@@ -442,30 +497,16 @@ void EPuckReal::dumpToneData_TEST(AudioHandler::audio_message_t *store, size_t s
 
 void EPuckReal::readSensorsThreaded(void)
 {
-	printf("threaded\n");
 	while(true)
 	{
-		epuck->Read();
-		usleep(10);
+		//Peek blocks until the robot has sent data, so the thread sleeps until there is something to read
+		//instead of spinning. It gives up after the timeout so that the thread can be stopped.
+		if(epuck->Peek(SENSOR_PEEK_TIMEOUT)) readSensors();
+		boost::this_thread::interruption_point();
 	}
-	pthread_exit(NULL);
 	return;
 }
 
-void EPuckReal::flashLEDsThreaded(void)
-{
-	double period = 1/LEDFlashFrequency; //flash period in seconds
-	period = period*1000000; //now in micro-seconds
-	period = period/2;	//will toggle LEDs each half period
-
-	while(LEDFlashFrequency > 0)
-	{
-		toggleAllLEDs();
-		usleep(period);
-	}
-	pthread_exit(NULL);
-	return;
-}
 
 
 
@@ -1,3 +1,4 @@
+#include <algorithm>
 #include "EPuckSim.h"
 
 
@@ -14,7 +15,7 @@
  * */
 EPuckSim::EPuckSim(char* robotName)
 {
-	initialise(6665, robotName, 6664);
+	initialise(6665, robotName, 6664, 0);
 }
 
 /**
@@ -27,7 +28,7 @@ EPuckSim::EPuckSim(char* robotName)
  * */
 EPuckSim::EPuckSim(char* robotName, int robotPort)
 {
-	initialise(robotPort, robotName, 6664);
+	initialise(robotPort, robotName, 6664, 0);
 }
 
 /**
@@ -39,7 +40,22 @@ Creates and instance of the EPuck class.
 */
 EPuckSim::EPuckSim(char* robotName, int robotPort, int simulationPort)
 {	
-	initialise(robotPort, robotName, simulationPort);
+	initialise(robotPort, robotName, simulationPort, 0);
+	return;
+}
+
+/**
+Creates and instance of the EPuck class, for when several robots are served on the same port.
+This lets the robots share one connection to Player instead of each having their own. In the .cfg file give each robot's
+interfaces the same port and a different index, eg <code>provides ["6665:position2d:1" "6665:ranger:1"]</code> for the second robot.
+@param robotPort the port the EPuck's interfaces are served on. Eg 6665.
+@param robotName the name of the robot model in the simulation eg robot1, robot2 etc. Maximum 64 chars.
+@param simulationPort the port on which the simulation is running. Get this from the .cfg file of your simulation.
+@param robotIndex the index given to this robot's interfaces in the .cfg file.
+*/
+EPuckSim::EPuckSim(char* robotName, int robotPort, int simulationPort, int robotIndex)
+{
+	initialise(robotPort, robotName, simulationPort, robotIndex);
 	return;
 }
 
@@ -51,20 +67,20 @@ Epuck destructor. Closes threads and stops the robot nicely (ish).
 EPuckSim::~EPuckSim(void)
 {
 	//close threads
-	readSensorsThread.interrupt();
-	readSensorsThread.join();
+	stopSensorThread();
+
+	stopFlashLEDs();	//stops the flashing LEDs
 
-	stopFlashLEDs();	//stops the flashing LEDs and closes the thread
+	//send the last commands the user gave
+	flushCommands();
 
 
 	//free the items in memory
-	//this is probably unnecessary
+	//the simulation proxy and client are shared with the other robots so belong to the ConnectionManager
 	delete	p2dProxy;		//motors
 	delete	rangerProxy;	//rangers
 	delete	blobProxy;		//camera
-	delete	simProxy;		//leds
-	delete	epuck;
-	delete	simulation;
+	ConnectionManager::GetConnectionManager()->releaseClient(epuck);
 
 	if(audioInitialised) delete handler;
 
@@ -93,33 +109,67 @@ bool EPuckSim::operator==(const EPuckSim& other)
 
 void EPuckSim::readSensors(void)
 {	
+	SensorFrame frame;
+	int i;
+
+	//a tick boundary, so send whatever the user has asked for since the last one
+	flushCommands();
+
 	epuck->Read();
+
+	//take a snapshot of everything the proxies now hold and publish it
+	frame.time 			= getTime();
+	frame.batteryVolts 	= getBatteryVolts();
+	frame.numberOfIRs 	= 0;
+	if(rangerProxy != NULL)
+	{
+		frame.numberOfIRs = std::min(getNumberOfIRs(), (int)SensorFrame::MAX_IRS);
+		for(i=0; i<frame.numberOfIRs; i++)
+		{
+			frame.irReadings[i] = rangerProxy->GetRange(i);
+		}
+	}
+
+	frame.cameraWidth 	= -1;
+	frame.cameraHeight 	= -1;
+	frame.numberBlobs 	= 0;
+	frame.totalBlobs 	= 0;
+	if(blobProxy != NULL)
+	{
+		frame.cameraWidth 	= getCameraWidth();
+		frame.cameraHeight 	= getCameraHeight();
+		frame.totalBlobs 	= blobProxy->GetCount();
+		frame.numberBlobs 	= std::min(frame.totalBlobs, (int)SensorFrame::MAX_BLOBS);
+		for(i=0; i<frame.numberBlobs; i++) frame.blobs[i] = convertBlob(blobProxy->GetBlob(i));
+	}
+
+	frameBuffer.publish(frame);
 	return;
 }
 
-double EPuckSim::getTime(void)
+void EPuckSim::getSensorFrame(SensorFrame &frame)
 {
-	uint64_t data;
-	double time;
-	char flag[] = "time";
+	frameBuffer.read(frame);
+	return;
+}
 
-	simProxy->GetProperty(name, flag, &data, sizeof(data));
-//printf("read value %f\n", (double)data);
-	time = (double)data;
-	time = time / 1000000;
+void EPuckSim::waitForSensorFrame(SensorFrame &frame)
+{
+	//the frame buffer can have moved on again by the time it is read, which is fine as the frame is only ever newer
+	frameBuffer.waitForFrame(frame.sequence);
+	frameBuffer.read(frame);
+	return;
+}
 
-	return time;
+double EPuckSim::getTime(void)
+{
+	//the clock is shared by all the robots and reads the time from the simulation once per step
+	return clock->getTime();
 }
 
 void EPuckSim::waitMilliseconds(int timeMs)
 {
-	boost::posix_time::milliseconds wait(10);
-	double endTime = getTime() + (double)timeMs/1000;
-
-	while(getTime() < endTime)
-	{
-		boost::this_thread::sleep(wait);
-	}
+	clock->waitSeconds((double)timeMs/1000);
 	return;
 }
 
@@ -131,13 +181,14 @@ double EPuckSim::getBatteryVolts(void)
 
 void EPuckSim::getPosition(double& x, double& y, double& yaw)
 {
-	simProxy->GetPose2d(name, x, y, yaw);
+	//the pose cache reads every robot's position from the simulation once per step
+	poses->getPose(name, x, y, yaw);
 	return;
 }
 
 void EPuckSim::setPosition(double x, double y, double yaw)
 {
-	simProxy->SetPose2d(name, x, y, yaw);
+	poses->setPose(name, x, y, yaw);
 	return;
 }
 
@@ -146,20 +197,23 @@ void EPuckSim::setPosition(double x, double y, double yaw)
 
 double* EPuckSim::getIRReadings(void)
 {
-	int i;
-	
-	for(i=0; i<getNumberOfIRs(); i++)
-	{
-		irReadings[i] = rangerProxy->GetRange(i);
-	}	
-	
-	return irReadings;
+	//copied from the latest frame into a buffer the calling thread keeps, so readSensors() never writes an array a caller
+	//is reading. Each robot has its own buffer, so a thread can hold on to the readings of more than one robot.
+	SensorFrame frame;
+
+	if(irBuffer.get() == NULL) irBuffer.reset(new std::vector<double>(SensorFrame::MAX_IRS, 0.0));
+	frameBuffer.read(frame);
+	std::copy(frame.irReadings, frame.irReadings + frame.numberOfIRs, irBuffer->begin());
+	return &(*irBuffer)[0];
 }
 
 
 double EPuckSim::getIRReading(int index)
 {
-	return rangerProxy->GetRange(index);
+	SensorFrame frame;
+
+	frameBuffer.read(frame);
+	return frame.irReadings[index];
 }
 
 /**
@@ -209,19 +263,30 @@ int EPuckSim::getNumberBlobs(void)
 
 EPuck::Blob EPuckSim::getBlob(int index)
 {
-	player_blobfinder_blob_t oldBlob;
+	return convertBlob(blobProxy->GetBlob(index));
+}
+
+int EPuckSim::getBlobs(std::vector<Blob> &blobs, const BlobFilter &filter)
+{
+	SensorFrame frame;
+
+	frameBuffer.read(frame);
+	return frame.getBlobs(blobs, filter);
+}
+
+EPuck::Blob EPuckSim::convertBlob(const player_blobfinder_blob_t &blob)
+{
 	EPuck::Blob newBlob;
 
-	oldBlob = blobProxy->GetBlob(index);
-	newBlob.id = (int)oldBlob.id;
-	newBlob.colour = oldBlob.color;
-	newBlob.area = (int)oldBlob.area;
-	newBlob.x = (int)oldBlob.x;
-	newBlob.y = (int)oldBlob.y;
-	newBlob.left = (int)oldBlob.left;
-	newBlob.right = (int)oldBlob.right;
-	newBlob.top = (int)oldBlob.top;
-	newBlob.bottom = (int)oldBlob.bottom;
+	newBlob.id = (int)blob.id;
+	newBlob.colour = blob.color;
+	newBlob.area = (int)blob.area;
+	newBlob.x = (int)blob.x;
+	newBlob.y = (int)blob.y;
+	newBlob.left = (int)blob.left;
+	newBlob.right = (int)blob.right;
+	newBlob.top = (int)blob.top;
+	newBlob.bottom = (int)blob.bottom;
 
 	return newBlob;
 }
@@ -238,7 +303,15 @@ void EPuckSim::setMotors(double forward, double turnrate)
 {
 	if(forward > EPuck::MAX_WHEEL_SPEED) forward = EPuck::MAX_WHEEL_SPEED;
 	if(forward < (-1)*EPuck::MAX_WHEEL_SPEED) forward = (-1)*EPuck::MAX_WHEEL_SPEED;
-	p2dProxy->SetSpeed(forward, turnrate);
+
+	bool sendNow;
+	{
+		boost::mutex::scoped_lock lock(commandMutex);
+		commandForward 	= forward;
+		commandTurnrate = turnrate;
+		sendNow = commandChanged();
+	}
+	if(sendNow) sendCommands();
 	return;
 }
 
@@ -312,30 +385,39 @@ void EPuckSim::setDifferentialMotors(double left, double right)
 
 void EPuckSim::setAllLEDsOn(void)
 {
-	float red[]={1, 0, 0, 1};
-	char colour[]="color";
-
-	simProxy->SetProperty(name, colour, &red, sizeof(red));
-	allLEDsOn = true;
+	bool sendNow;
+	{
+		boost::mutex::scoped_lock lock(commandMutex);
+		allLEDsOn = true;
+		sendNow = commandChanged();
+	}
+	if(sendNow) sendCommands();
 	return;
 }
 
 
 void EPuckSim::setAllLEDsOff(void)
 {
-	float darkGreen[]={0.67, 0.88, 0.43, 1};
-	char colour[]="color";
-
-	simProxy->SetProperty(name, colour, &darkGreen, sizeof(darkGreen));
-	allLEDsOn = false;
+	bool sendNow;
+	{
+		boost::mutex::scoped_lock lock(commandMutex);
+		allLEDsOn = false;
+		sendNow = commandChanged();
+	}
+	if(sendNow) sendCommands();
 	return;
 }
 
 
 void EPuckSim::toggleAllLEDs(void)
 {
-	if(allLEDsOn) setAllLEDsOff();
-	else setAllLEDsOn();
+	bool sendNow;
+	{
+		boost::mutex::scoped_lock lock(commandMutex);
+		allLEDsOn = !allLEDsOn;
+		sendNow = commandChanged();
+	}
+	if(sendNow) sendCommands();
 	return;
 }
 
@@ -357,17 +439,68 @@ void EPuckSim::flashLEDs(double frequency)
 		return;
 	}
 
-	flashLEDsThread = boost::thread(&EPuckSim::flashLEDsThreaded, this, frequency);
-	//pthread_create(&flashLEDsThread, 0, EPuckSim::startFlashLEDsThread, this);
+	//the LEDs are toggled each half period in simulated time by the timer wheel shared by all the robots
+	stopFlashLEDs();
+	flashTask = TimerWheel::GetSimulationWheel(clock)->schedule(boost::bind(&EPuckSim::toggleLEDsThreaded, this), 0.5/frequency);
 	return;
 }
 
 
 void EPuckSim::stopFlashLEDs(void)
 {
-	flashLEDsThread.interrupt();
-	flashLEDsThread.join();
+	if(flashTask >= 0)
+	{
+		TimerWheel::GetSimulationWheel(clock)->cancel(flashTask);
+		flashTask = -1;
+	}
+	return;
+}
+
+//*************************** COMMAND CACHE *****************************
+
+
+void EPuckSim::setCommandCoalescing(bool coalesce)
+{
+	{
+		boost::mutex::scoped_lock lock(commandMutex);
+		coalesceCommands = coalesce;
+	}
+	if(!coalesce) sendCommands();
+	return;
+}
+
+
+void EPuckSim::flushCommands(void)
+{
+	sendCommands();
+	return;
+}
+
 
+void EPuckSim::getCommandCounts(int &sent, int &suppressed)
+{
+	boost::mutex::scoped_lock sendLock(sendMutex);
+	boost::mutex::scoped_lock lock(commandMutex);
+	sent 		= commandsSent;
+	suppressed 	= commandsRequested - commandsSent;
+	return;
+}
+
+//*************************** SENSOR THREAD *****************************
+
+
+void EPuckSim::startSensorThread(void)
+{
+	stopSensorThread();
+	readSensorsThread = boost::thread(&EPuckSim::readSensorsThreaded, this);
+	return;
+}
+
+
+void EPuckSim::stopSensorThread(void)
+{
+	readSensorsThread.interrupt();
+	readSensorsThread.join();
 	return;
 }
 
@@ -410,44 +543,88 @@ int EPuckSim::playTone(int frequency, double duration)
 std::vector<EPuck::Tone> EPuckSim::listenForTones(void)
 {
 	std::vector<EPuck::Tone> out;
-	out.clear();
 
-	if(audioInitialised)
+	listenForTones(out);
+	return out;
+}
+
+
+int EPuckSim::listenForTones(std::vector<EPuck::Tone> &tones)
+{
+	//each thread that listens gets its own message buffer which it keeps between calls,
+	//so listening doesn't need a lock or any memory allocation once the buffer is big enough.
+	static boost::thread_specific_ptr< std::vector<AudioHandler::audio_message_t> > messageBuffer;
+	int numberOfTones;
+
+	tones.clear();
+
+	if(!audioInitialised)
 	{
-		int success;
-		int numberOfTones;
-		AudioHandler::audio_message_t *message;
-		//lock this function so that deleting and creating these arrays doesn't cause
-		//memory leaks and segfaults.
-		boost::mutex::scoped_lock lock(listeningMutex);
-		do
+		printf("Unsuccessful epuck %s listenToTones() request. Audio not initialised.\n", name);
+		return -1;
+	}
+
+	if(messageBuffer.get() == NULL) messageBuffer.reset(new std::vector<AudioHandler::audio_message_t>);
+	std::vector<AudioHandler::audio_message_t> &message = *messageBuffer;
+
+	numberOfTones = handler->getTones(name, message);
+
+	for(int i=0; i<numberOfTones; i++)
+	{
+		EPuck::Tone t;
+		t.distance 	= message[i].distance;
+		t.bearing 	= message[i].direction;
+		t.frequency = message[i].frequency;
+		tones.push_back(t);
+	}
+
+	return numberOfTones;
+}
+
+void EPuckSim::listenForTones(int numberRobots, EPuckSim **robots, std::vector<EPuck::Tone> *tones)
+{
+	std::vector<char*> names;
+	std::vector<int> listeners;
+	AudioHandler *audio = NULL;
+	int i, j;
+
+	for(i=0; i<numberRobots; i++)
+	{
+		tones[i].clear();
+		if(robots[i]->audioInitialised)
 		{
-			//reserve space for new tone data
-			numberOfTones 	= handler->getNumberOfTones();
-			message 		= new AudioHandler::audio_message_t[numberOfTones];
-			success = handler->getTones(name, message, numberOfTones);
-			if(success == -1) delete[] message;
-		}while(success == -1); //if unsuccessful try again
+			names.push_back(robots[i]->name);
+			listeners.push_back(i);
+			audio = robots[i]->handler;
+		}
+		else
+			printf("Unsuccessful epuck %s listenToTones() request. Audio not initialised.\n", robots[i]->name);
+	}
 
-		for(int i=0; i<numberOfTones; i++)
+	if(audio == NULL) return;
+
+	std::vector< std::vector<AudioHandler::audio_message_t> > messages(names.size());
+	audio->getTonesForRobots(names.size(), &names[0], &messages[0]);
+
+	for(i=0; i<(int)listeners.size(); i++)
+	{
+		std::vector<EPuck::Tone> &out = tones[listeners[i]];
+		out.reserve(messages[i].size());
+
+		for(j=0; j<(int)messages[i].size(); j++)
 		{
 			EPuck::Tone t;
-			t.distance 	= message[i].distance;
-			t.bearing 	= message[i].direction;
-			t.frequency = message[i].frequency;
+			t.distance 	= messages[i][j].distance;
+			t.bearing 	= messages[i][j].direction;
+			t.frequency = messages[i][j].frequency;
 			out.push_back(t);
 		}
-
-		delete[] message;
 	}
-	else
-		printf("Unsuccessful epuck %s listenToTones() request. Audio not initialised.\n", name);
 
-	return out;
+	return;
 }
 
 
-
 /*
 int EPuckSim::listenForTones(void)
 {
@@ -531,24 +708,41 @@ int EPuckSim::listenForTones(void)
 
 
 
-void EPuckSim::initialise(int robotPort, char* robotName, int simulationPort)
+void EPuckSim::initialise(int robotPort, char* robotName, int simulationPort, int robotIndex)
 {
+	ConnectionManager *connections = ConnectionManager::GetConnectionManager();
+
 	//initialise member variables
 	strcpy(name, robotName);
 	port 				= robotPort;
+	index 				= robotIndex;
 	allLEDsOn			= false;
+	flashTask 			= -1;
+	commandForward 		= 0;
+	commandTurnrate 	= 0;
+	motorsSent 			= false;
+	ledsSent 			= false;
+	coalesceCommands 	= false;
+	commandsRequested 	= 0;
+	commandsSent 		= 0;
 	audioInitialised 	= false;
 	//toneArray 			= NULL;
 
 	try
 	{
-		epuck 		= new PlayerCc::PlayerClient("localhost", port);
-		simulation 	= new PlayerCc::PlayerClient("localhost", simulationPort);
-
-		p2dProxy 	= new PlayerCc::Position2dProxy(epuck, 0);
-	//	rangerProxy = new PlayerCc::RangerProxy(epuck, 0);
-	//	blobProxy 	= new PlayerCc::BlobfinderProxy(epuck, 0);
-		simProxy 	= new PlayerCc::SimulationProxy(simulation, 0);
+		//connections are shared with any other robots on the same ports
+		epuck 		= connections->getClient(port);
+		simulation 	= connections->getSimulationClient(simulationPort);
+
+		p2dProxy 	= new PlayerCc::Position2dProxy(epuck, index);
+		rangerProxy = NULL;
+		blobProxy 	= NULL;
+	//	rangerProxy = new PlayerCc::RangerProxy(epuck, index);
+	//	blobProxy 	= new PlayerCc::BlobfinderProxy(epuck, index);
+		simProxy 	= connections->getSimulationProxy(simulationPort);
+		clock 		= SimulationClock::GetSimulationClock(simProxy, name);
+		poses 		= PoseCache::GetPoseCache(simProxy, clock);
+		poses->registerModel(name);
 	}
 	catch (PlayerCc::PlayerError e)
 	{
@@ -556,44 +750,83 @@ void EPuckSim::initialise(int robotPort, char* robotName, int simulationPort)
 		return;
 	}
 
-//	readSensorsThread = boost::thread(&EPuckSim::readSensorsThreaded, this);
-//	pthread_create(&readSensorsThread, 0, EPuckSim::startReadSensorThread, this);
+	//the sensor thread isn't started unless the user asks for it with startSensorThread()
 }
 
 
 void EPuckSim::readSensorsThreaded(void)
 {
-	printf("%s is threaded\n", name);
-	boost::posix_time::milliseconds wait(10);
-
 	while(true)
 	{
-		epuck->Read();
-		boost::this_thread::sleep(wait);
+		//Peek blocks until the server has sent data, so the thread sleeps until there is something to read.
+		//It gives up after the timeout so that the thread can be stopped.
+		if(epuck->Peek(SENSOR_PEEK_TIMEOUT)) readSensors();
+		boost::this_thread::interruption_point();
 	}
 
 	return;
 }
 
 
-void EPuckSim::flashLEDsThreaded(int ledFlashFrequency)
+/**
+ * Called each time the user changes an actuator command. Must be called with commandMutex held.
+ * @returns true if the commands should be sent straight away, false if they are being coalesced and will be sent by the
+ * next flushCommands() or readSensors(). The caller sends them after releasing commandMutex.
+ * */
+bool EPuckSim::commandChanged(void)
 {
-	double period = 1/ledFlashFrequency; //flash period in seconds
-	period = period*1000; //now in milliseconds
-	period = period/2;	//will toggle LEDs each half period
-	boost::posix_time::milliseconds wait(period);
-
-	while(true)
-	{
-		toggleAllLEDs();
-		boost::this_thread::sleep(wait);
-	}
+	commandsRequested++;
+	return !coalesceCommands;
+}
 
+/**
+ * Run by the simulation TimerWheel to flash the LEDs. Only the LED state is changed, it is sent by the next
+ * flushCommands() or readSensors() so the wheel's thread never waits for Player.
+ * */
+void EPuckSim::toggleLEDsThreaded(void)
+{
+	boost::mutex::scoped_lock lock(commandMutex);
+	allLEDsOn = !allLEDsOn;
+	commandsRequested++;
 	return;
 }
 
+/**
+ * Sends the motor speeds and LED state to the simulation, if they are different to the ones last sent.
+ * The commands are copied under commandMutex and sent without it, so setting the motors or LEDs never waits for Player.
+ * */
+void EPuckSim::sendCommands(void)
+{
+	float red[]={1, 0, 0, 1};
+	float darkGreen[]={0.67, 0.88, 0.43, 1};
+	char colour[]="color";
+	double forward, turnrate;
+	bool ledsOn;
 
+	boost::mutex::scoped_lock sendLock(sendMutex);
+	{
+		boost::mutex::scoped_lock lock(commandMutex);
+		forward 	= commandForward;
+		turnrate 	= commandTurnrate;
+		ledsOn 		= allLEDsOn;
+	}
 
+	if(!motorsSent || forward != sentForward || turnrate != sentTurnrate)
+	{
+		p2dProxy->SetSpeed(forward, turnrate);
+		sentForward 	= forward;
+		sentTurnrate 	= turnrate;
+		motorsSent 		= true;
+		commandsSent++;
+	}
 
-
-
+	if(!ledsSent || ledsOn != sentLEDsOn)
+	{
+		if(ledsOn) simProxy->SetProperty(name, colour, &red, sizeof(red));
+		else simProxy->SetProperty(name, colour, &darkGreen, sizeof(darkGreen));
+		sentLEDsOn 	= ledsOn;
+		ledsSent 	= true;
+		commandsSent++;
+	}
+	return;
+}
@@ -0,0 +1,1155 @@
+/*
+ * HeadlessWorld.cc
+ *
+ */
+
+#include <math.h>
+#include <string.h>
+#include <stdlib.h>
+#include <ctype.h>
+#include <map>
+#include <algorithm>
+#include <png.h>
+#include "HeadlessWorld.h"
+
+
+/**IR ranger positions [x y heading], the same as the ir_pose table in the lpuck driver for the real robot.*/
+const HeadlessWorld::sensor_pose_t HeadlessWorld::irPoses[HeadlessWorld::NUMBER_OF_IRS] =
+{
+	{0.030,		-0.010,	342.8*M_PI/180},
+	{0.022,		-0.025,	314.2*M_PI/180},
+	{0.0,		-0.031,	270*M_PI/180},
+	{-0.03,		-0.015,	208.5*M_PI/180},
+	{-0.03,		0.015,	151.5*M_PI/180},
+	{0.0,		0.031,	90*M_PI/180},
+	{0.022,		0.025,	405.8*M_PI/180},
+	{0.03,		0.01,	377.2*M_PI/180}
+};
+
+
+/*====================================================================
+			WORLDFILE READING
+====================================================================*/
+
+/**A block in a worldfile, eg epuck( pose [0 0 0 0] name "robot1" ). Only the top level properties are kept.*/
+typedef struct worldfile_block
+{
+	std::string type;
+	std::map< std::string, std::vector<std::string> > properties;
+}worldfile_block_t;
+
+/**
+ * Splits a worldfile into tokens. Brackets are tokens on their own, quotes are removed from strings and comments are skipped.
+ * */
+static void tokeniseWorldfile(const std::string &text, std::vector<std::string> &tokens)
+{
+	size_t i = 0, start;
+
+	while(i < text.size())
+	{
+		char c = text[i];
+
+		if(isspace(c)) i++;
+		else if(c == '#')
+		{
+			while(i < text.size() && text[i] != '\n') i++;
+		}
+		else if(c == '(' || c == ')' || c == '[' || c == ']')
+		{
+			tokens.push_back(std::string(1, c));
+			i++;
+		}
+		else if(c == '"')
+		{
+			start = ++i;
+			while(i < text.size() && text[i] != '"') i++;
+			tokens.push_back(text.substr(start, i-start));
+			i++;
+		}
+		else
+		{
+			start = i;
+			while(i < text.size() && !isspace(text[i]) && strchr("()[]\"#", text[i]) == NULL) i++;
+			tokens.push_back(text.substr(start, i-start));
+		}
+	}
+	return;
+}
+
+/**
+ * Skips over a bracketed section of tokens.
+ * @param index the index of the opening bracket. Is left pointing at the token after the matching closing bracket.
+ * */
+static void skipBrackets(const std::vector<std::string> &tokens, size_t &index)
+{
+	int depth = 0;
+
+	do
+	{
+		if(tokens[index] == "(" || tokens[index] == "[") depth++;
+		else if(tokens[index] == ")" || tokens[index] == "]") depth--;
+		index++;
+	}while(depth > 0 && index < tokens.size());
+	return;
+}
+
+/**
+ * Reads the value of a property, which is either a single token or a list in square brackets.
+ * @param index the index of the first token of the value. Is left pointing at the token after it.
+ * */
+static std::vector<std::string> readValue(const std::vector<std::string> &tokens, size_t &index)
+{
+	std::vector<std::string> value;
+
+	if(tokens[index] == "[")
+	{
+		for(index++; index < tokens.size() && tokens[index] != "]"; index++)
+		{
+			value.push_back(tokens[index]);
+		}
+		index++;
+	}
+	else value.push_back(tokens[index++]);
+
+	return value;
+}
+
+/**
+ * Reads the top level blocks and properties out of a worldfile. Nested blocks and defines are skipped.
+ * */
+static void parseWorldfile(const std::vector<std::string> &tokens, std::vector<worldfile_block_t> &blocks,
+		std::map< std::string, std::vector<std::string> > &globals)
+{
+	size_t i = 0;
+
+	while(i+1 < tokens.size())
+	{
+		if(tokens[i] == "define")
+		{
+			//define name parent ( ... )
+			i += 3;
+			if(i < tokens.size() && tokens[i] == "(") skipBrackets(tokens, i);
+		}
+		else if(tokens[i+1] == "(")
+		{
+			worldfile_block_t block;
+			block.type = tokens[i];
+			i += 2;
+
+			while(i+1 < tokens.size() && tokens[i] != ")")
+			{
+				std::string key = tokens[i++];
+				if(tokens[i] == "(") skipBrackets(tokens, i);
+				else block.properties[key] = readValue(tokens, i);
+			}
+			i++;
+			blocks.push_back(block);
+		}
+		else
+		{
+			std::string key = tokens[i++];
+			globals[key] = readValue(tokens, i);
+		}
+	}
+	return;
+}
+
+/**
+ * Reads a number out of a property.
+ * @returns the number, or defaultValue if the property doesn't have that many values.
+ * */
+static double getNumber(std::map< std::string, std::vector<std::string> > &properties, const char* key, unsigned int index, double defaultValue)
+{
+	std::map< std::string, std::vector<std::string> >::iterator it = properties.find(key);
+
+	if(it == properties.end() || index >= it->second.size()) return defaultValue;
+	return atof(it->second[index].c_str());
+}
+
+
+/*====================================================================
+			CONSTRUCTOR/DESTRUCTOR
+====================================================================*/
+
+/**
+ * Creates an empty world with no walls. Robots can be added with addRobot().
+ * */
+HeadlessWorld::HeadlessWorld(void)
+{
+	initialise();
+	return;
+}
+
+/**
+ * Creates a world from a Stage worldfile, eg worlds/boids.world.
+ * @param worldfile path to the worldfile. Bitmaps are found relative to it, as in Stage.
+ * */
+HeadlessWorld::HeadlessWorld(const char* worldfile)
+{
+	initialise();
+
+	if(loadWorldfile(worldfile) != 0)
+	{
+		printf("HeadlessWorld couldn't load worldfile %s\n", worldfile);
+	}
+	return;
+}
+
+HeadlessWorld::~HeadlessWorld()
+{
+	return;
+}
+
+
+/*====================================================================
+			SIMULATION
+====================================================================*/
+
+/**
+ * Moves the world on by one step. Each robot drives at the speed it was last given, unless that would make it hit
+ * something in which case it stays where it is and is marked as stalled. Then the clock, pose cache and audio are updated.
+ * */
+void HeadlessWorld::step(void)
+{
+	unsigned int i;
+	double newX, newY, newYaw;
+
+	{
+		boost::mutex::scoped_lock lock(worldMutex);
+
+		//robots move much less than a grid cell each step, so the grid from before anyone moves is good enough to find collisions
+		if(robotGridDirty) buildRobotGrid();
+
+		for(i=0; i<robots.size(); i++)
+		{
+			headless_robot_t &r = robots[i];
+
+			//differential drive, integrated using the heading half way through the step
+			newYaw = r.yaw + r.turnrate*interval;
+			newX = r.x + r.forward*interval*cos(r.yaw + r.turnrate*interval/2);
+			newY = r.y + r.forward*interval*sin(r.yaw + r.turnrate*interval/2);
+
+			r.stalled = collides(i, newX, newY);
+			if(!r.stalled)
+			{
+				r.x = newX;
+				r.y = newY;
+			}
+			r.yaw = normaliseAngle(newYaw);
+		}
+		robotGridDirty = true;
+
+		currentTime += interval;
+
+		for(i=0; i<robots.size(); i++)
+		{
+			headless_robot_t &r = robots[i];
+
+			if(r.flashPeriod > 0 && currentTime >= r.nextFlash)
+			{
+				r.ledsOn = !r.ledsOn;
+				r.nextFlash += r.flashPeriod;
+			}
+		}
+	}
+
+	publishTime();
+	return;
+}
+
+/**
+ * Moves the world on by several steps.
+ * @param numberSteps how many steps to take.
+ * */
+void HeadlessWorld::step(int numberSteps)
+{
+	int i;
+
+	for(i=0; i<numberSteps; i++)
+	{
+		step();
+	}
+	return;
+}
+
+/**
+ * Returns the simulated time.
+ * @returns the simulated time in seconds.
+ * */
+double HeadlessWorld::getTime(void)
+{
+	boost::mutex::scoped_lock lock(worldMutex);
+	return currentTime;
+}
+
+/**
+ * Returns the length of a simulation step.
+ * @returns the simulated time that passes each step, in seconds.
+ * */
+double HeadlessWorld::getInterval(void)
+{
+	boost::mutex::scoped_lock lock(worldMutex);
+	return interval;
+}
+
+/**
+ * Sets the length of a simulation step. Shorter steps are more accurate but the world has to take more of them.
+ * @param seconds the simulated time that passes each step, in seconds.
+ * */
+void HeadlessWorld::setInterval(double seconds)
+{
+	boost::mutex::scoped_lock lock(worldMutex);
+
+	if(seconds > 0) interval = seconds;
+	return;
+}
+
+
+/*====================================================================
+			ROBOTS
+====================================================================*/
+
+/**
+ * Puts a new robot in the world.
+ * @param name the name of the robot eg robot1. Maximum 32 chars.
+ * @param x x coordinate of the robot in metres
+ * @param y y coordinate of the robot in metres
+ * @param yaw direction the robot faces in radians
+ * @returns the index of the robot, which the other robot functions use.
+ * */
+int HeadlessWorld::addRobot(const char* name, double x, double y, double yaw)
+{
+	headless_robot_t r;
+	int index;
+
+	memset(&r, 0, sizeof(r));
+	strncpy(r.name, name, 31);
+	r.x 	= x;
+	r.y 	= y;
+	r.yaw 	= normaliseAngle(yaw);
+
+	{
+		boost::mutex::scoped_lock lock(worldMutex);
+		robots.push_back(r);
+		index = robots.size()-1;
+		robotGridDirty = true;
+	}
+
+	poses->setPose(r.name, r.x, r.y, r.yaw);
+	return index;
+}
+
+/**
+ * Finds a robot by name.
+ * @param name the name of the robot in the worldfile.
+ * @returns the index of the robot, -1 if there isn't one with that name.
+ * */
+int HeadlessWorld::findRobot(const char* name)
+{
+	unsigned int i;
+	boost::mutex::scoped_lock lock(worldMutex);
+
+	for(i=0; i<robots.size(); i++)
+	{
+		if(strcmp(robots[i].name, name) == 0) return i;
+	}
+	return -1;
+}
+
+int HeadlessWorld::getNumberOfRobots(void)
+{
+	boost::mutex::scoped_lock lock(worldMutex);
+	return robots.size();
+}
+
+/**
+ * Sets how fast a robot moves. It keeps going at this speed each step until it is told otherwise.
+ * @param robot index of the robot
+ * @param forward forward speed in metres/sec
+ * @param turnrate turn rate in radians/sec, positive is anticlockwise
+ * */
+void HeadlessWorld::setSpeed(int robot, double forward, double turnrate)
+{
+	boost::mutex::scoped_lock lock(worldMutex);
+
+	robots[robot].forward 	= forward;
+	robots[robot].turnrate 	= turnrate;
+	return;
+}
+
+void HeadlessWorld::getPose(int robot, double &x, double &y, double &yaw)
+{
+	boost::mutex::scoped_lock lock(worldMutex);
+
+	x 	= robots[robot].x;
+	y 	= robots[robot].y;
+	yaw = robots[robot].yaw;
+	return;
+}
+
+/**
+ * Moves a robot to a new pose straight away. It isn't checked for hitting anything.
+ * */
+void HeadlessWorld::setPose(int robot, double x, double y, double yaw)
+{
+	char name[32];
+
+	{
+		boost::mutex::scoped_lock lock(worldMutex);
+
+		robots[robot].x 	= x;
+		robots[robot].y 	= y;
+		robots[robot].yaw 	= normaliseAngle(yaw);
+		yaw = robots[robot].yaw;
+		strcpy(name, robots[robot].name);
+		robotGridDirty = true;
+	}
+
+	poses->setPose(name, x, y, yaw);
+	return;
+}
+
+/**
+ * @returns true if the robot couldn't move last step because it would have hit something.
+ * */
+bool HeadlessWorld::isStalled(int robot)
+{
+	boost::mutex::scoped_lock lock(worldMutex);
+	return robots[robot].stalled;
+}
+
+/**
+ * Turns a robot's LEDs on or off, and stops them flashing.
+ * */
+void HeadlessWorld::setLEDs(int robot, bool on)
+{
+	boost::mutex::scoped_lock lock(worldMutex);
+
+	robots[robot].ledsOn = on;
+	robots[robot].flashPeriod = 0;
+	return;
+}
+
+bool HeadlessWorld::getLEDs(int robot)
+{
+	boost::mutex::scoped_lock lock(worldMutex);
+	return robots[robot].ledsOn;
+}
+
+/**
+ * Makes a robot's LEDs flash. The LEDs toggle every half period of simulated time.
+ * @param frequency flashing frequency in Hz. 0 or less stops the flashing.
+ * */
+void HeadlessWorld::flashLEDs(int robot, double frequency)
+{
+	boost::mutex::scoped_lock lock(worldMutex);
+
+	if(frequency <= 0)
+	{
+		robots[robot].flashPeriod = 0;
+		return;
+	}
+	robots[robot].flashPeriod = 1/(2*frequency);
+	robots[robot].nextFlash = currentTime + robots[robot].flashPeriod;
+	return;
+}
+
+
+/*====================================================================
+			SENSORS
+====================================================================*/
+
+/**
+ * Works out what each of the robot's IR rangers can see.
+ * @param robot index of the robot
+ * @param ranges array of NUMBER_OF_IRS where the ranges are stored, in metres.
+ * Rangers that don't see anything return their maximum range.
+ * */
+void HeadlessWorld::getIRReadings(int robot, double *ranges)
+{
+	boost::mutex::scoped_lock lock(worldMutex);
+
+	if(robotGridDirty) buildRobotGrid();
+	computeIRReadings(robot, ranges);
+	return;
+}
+
+/**
+ * Works out what every robot's IR rangers can see in one go. This is quicker than asking for each robot in turn.
+ * @param ranges vector the ranges are copied into, NUMBER_OF_IRS for each robot in order.
+ * ranges[robot*NUMBER_OF_IRS + i] is IR i of that robot.
+ * */
+void HeadlessWorld::getAllIRReadings(std::vector<double> &ranges)
+{
+	unsigned int i;
+	boost::mutex::scoped_lock lock(worldMutex);
+
+	ranges.resize(robots.size()*NUMBER_OF_IRS);
+	if(robots.empty()) return;
+
+	if(robotGridDirty) buildRobotGrid();
+	for(i=0; i<robots.size(); i++)
+	{
+		computeIRReadings(i, &ranges[i*NUMBER_OF_IRS]);
+	}
+	return;
+}
+
+/**
+ * Works out what the robot's blobfinder can see. Other robots show up as blobs when their LEDs are on, unless there is a wall in the way.
+ * @param robot index of the robot
+ * @param blobs vector the blobs are copied into. Anything already in it is removed.
+ * @returns the number of blobs.
+ * */
+int HeadlessWorld::getBlobs(int robot, std::vector<EPuck::Blob> &blobs)
+{
+	const double verticalFOV = CAMERA_FOV*CAMERA_HEIGHT/CAMERA_WIDTH;
+	unsigned int i;
+	boost::mutex::scoped_lock lock(worldMutex);
+	headless_robot_t &me = robots[robot];
+
+	blobs.clear();
+
+	for(i=0; i<robots.size(); i++)
+	{
+		headless_robot_t &other = robots[i];
+		if((int)i == robot || !other.ledsOn) continue;
+
+		double dx = other.x - me.x;
+		double dy = other.y - me.y;
+		double distance = sqrt(dx*dx + dy*dy);
+		if(distance > CAMERA_RANGE || distance <= ROBOT_RADIUS) continue;
+
+		//angle to the middle of the robot and half the angle it takes up
+		double bearing = normaliseAngle(atan2(dy, dx) - me.yaw);
+		double halfWidth = asin(ROBOT_RADIUS/distance);
+		if(fabs(bearing) - halfWidth > CAMERA_FOV/2) continue;
+
+		//can't see through walls
+		if(castRay(me.x, me.y, dx/distance, dy/distance, distance - ROBOT_RADIUS) < distance - ROBOT_RADIUS) continue;
+
+		//positive bearings are to the left, which is the left of the image
+		double halfHeight = atan2(ROBOT_HEIGHT/2, distance);
+		EPuck::Blob b;
+		b.id 		= blobs.size();
+		b.colour 	= LED_COLOUR;
+		b.left 		= (int)(CAMERA_WIDTH/2 - (bearing + halfWidth)*CAMERA_WIDTH/CAMERA_FOV);
+		b.right 	= (int)(CAMERA_WIDTH/2 - (bearing - halfWidth)*CAMERA_WIDTH/CAMERA_FOV);
+		b.top 		= (int)(CAMERA_HEIGHT/2 - halfHeight*CAMERA_HEIGHT/verticalFOV);
+		b.bottom 	= (int)(CAMERA_HEIGHT/2 + halfHeight*CAMERA_HEIGHT/verticalFOV);
+		if(b.left < 0) b.left = 0;
+		if(b.right > CAMERA_WIDTH-1) b.right = CAMERA_WIDTH-1;
+		if(b.top < 0) b.top = 0;
+		if(b.bottom > CAMERA_HEIGHT-1) b.bottom = CAMERA_HEIGHT-1;
+		b.x 		= (b.left + b.right)/2;
+		b.y 		= (b.top + b.bottom)/2;
+		b.area 		= (b.right - b.left + 1)*(b.bottom - b.top + 1);
+
+		blobs.push_back(b);
+	}
+
+	return blobs.size();
+}
+
+/**
+ * Gets the AudioHandler for this world, making it if this is the first robot to ask.
+ * @param name the name of the robot that is initialising audio.
+ * */
+AudioHandler* HeadlessWorld::getAudioHandler(char* name)
+{
+	boost::mutex::scoped_lock lock(worldMutex);
+
+	//there is no Player server, the audio uses the clock and poses this world keeps up to date
+	if(audio == NULL) audio = AudioHandler::GetAudioHandler(NULL, NULL, name);
+	return audio;
+}
+
+/**
+ * Checks whether a point is inside a wall.
+ * @returns true if the point is on an obstacle in the floorplan. Outside the floorplan is empty space, like in Stage.
+ * */
+bool HeadlessWorld::isOccupied(double x, double y)
+{
+	if(occupancy.empty()) return false;
+	return isCellOccupied((int)floor((x - mapLeft)/cellWidth), (int)floor((y - mapBottom)/cellHeight));
+}
+
+
+//==================================================================================================
+//							PRIVATE FUNCTIONS
+//==================================================================================================
+
+
+void HeadlessWorld::initialise(void)
+{
+	currentTime 	= 0;
+	interval 		= DEFAULT_INTERVAL;
+	mapWidth 		= 0;
+	mapHeight 		= 0;
+	mapLeft 		= 0;
+	mapBottom 		= 0;
+	cellWidth 		= 1;
+	cellHeight 		= 1;
+	cellDiagonal 	= 0;
+	robotGridDirty 	= true;
+	gridColumns 	= 0;
+	gridRows 		= 0;
+	audio 			= NULL;
+
+	for(int i=0; i<NUMBER_OF_IRS; i++)
+	{
+		irCos[i] = cos(irPoses[i].yaw);
+		irSin[i] = sin(irPoses[i].yaw);
+	}
+
+	//no simulation proxy, so the clock and pose cache get their data from this world
+	char clockName[] = "headless";
+	clock = SimulationClock::GetSimulationClock(NULL, clockName);
+	poses = PoseCache::GetPoseCache(NULL, clock);
+	clock->setTime(currentTime);
+
+	printf("HeadlessWorld initialised\n");
+	return;
+}
+
+/**
+ * Loads the floorplan and robots from a worldfile.
+ * @returns 0 if successful, -1 if the file couldn't be read.
+ * */
+int HeadlessWorld::loadWorldfile(const char* worldfile)
+{
+	std::vector<std::string> tokens;
+	std::vector<worldfile_block_t> blocks;
+	std::map< std::string, std::vector<std::string> > globals;
+	std::string text, directory;
+	char buffer[4096];
+	size_t n, slash;
+	unsigned int i;
+	FILE *file;
+
+	file = fopen(worldfile, "r");
+	if(file == NULL) return -1;
+	while((n = fread(buffer, 1, sizeof(buffer), file)) > 0) text.append(buffer, n);
+	fclose(file);
+
+	directory = worldfile;
+	slash = directory.rfind('/');
+	directory = (slash == std::string::npos) ? "" : directory.substr(0, slash+1);
+
+	tokeniseWorldfile(text, tokens);
+	parseWorldfile(tokens, blocks, globals);
+
+	//interval_sim is in milliseconds
+	interval = getNumber(globals, "interval_sim", 0, interval*1000)/1000;
+
+	for(i=0; i<blocks.size(); i++)
+	{
+		worldfile_block_t &block = blocks[i];
+
+		//Stage 4 poses are [x y z yaw], Stage 3 ones are [x y yaw]. Yaw is in degrees.
+		int yawIndex = (block.properties["pose"].size() == 3) ? 2 : 3;
+		double x = getNumber(block.properties, "pose", 0, 0);
+		double y = getNumber(block.properties, "pose", 1, 0);
+		double yaw = getNumber(block.properties, "pose", yawIndex, 0)*M_PI/180;
+
+		if(block.type == "floorplan" && block.properties.count("bitmap"))
+		{
+			std::string bitmap = block.properties["bitmap"][0];
+			if(bitmap[0] != '/') bitmap = directory + bitmap;
+
+			if(loadBitmap(bitmap.c_str(), getNumber(block.properties, "size", 0, 1),
+					getNumber(block.properties, "size", 1, 1), x, y) != 0)
+			{
+				printf("HeadlessWorld couldn't load bitmap %s\n", bitmap.c_str());
+			}
+		}
+		else if(block.type == "epuck" && block.properties.count("name"))
+		{
+			addRobot(block.properties["name"][0].c_str(), x, y, yaw);
+		}
+	}
+
+	publishTime();
+	return 0;
+}
+
+/**
+ * Loads a floorplan bitmap into the occupancy grid. Dark pixels (and opaque ones, if it has transparency) are obstacles.
+ * The bitmap is stretched to the size given, like a Stage floorplan.
+ * @param filename the PNG file to load
+ * @param width width of the floorplan in metres
+ * @param height height of the floorplan in metres
+ * @param centreX x coordinate of the centre of the floorplan
+ * @param centreY y coordinate of the centre of the floorplan
+ * @returns 0 if successful, -1 if the file couldn't be loaded.
+ * */
+int HeadlessWorld::loadBitmap(const char* filename, double width, double height, double centreX, double centreY)
+{
+	png_structp png;
+	png_infop info;
+	png_bytepp rows;
+	int x, y, channels, colourType;
+	FILE *file;
+
+	file = fopen(filename, "rb");
+	if(file == NULL) return -1;
+
+	png = png_create_read_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
+	info = (png == NULL) ? NULL : png_create_info_struct(png);
+	if(info == NULL || setjmp(png_jmpbuf(png)))
+	{
+		png_destroy_read_struct(&png, &info, NULL);
+		fclose(file);
+		return -1;
+	}
+
+	//get 8 bit grey or RGB, with or without alpha
+	png_init_io(png, file);
+	png_read_png(png, info, PNG_TRANSFORM_STRIP_16 | PNG_TRANSFORM_PACKING | PNG_TRANSFORM_EXPAND, NULL);
+	rows = png_get_rows(png, info);
+	channels = png_get_channels(png, info);
+	colourType = png_get_color_type(png, info);
+
+	mapWidth 	= png_get_image_width(png, info);
+	mapHeight 	= png_get_image_height(png, info);
+	cellWidth 	= width/mapWidth;
+	cellHeight 	= height/mapHeight;
+	mapLeft 	= centreX - width/2;
+	mapBottom 	= centreY - height/2;
+	occupancy.assign(mapWidth*mapHeight, 0);
+
+	for(y=0; y<mapHeight; y++)
+	{
+		//the top row of the image is the top (highest y) of the map
+		png_bytep row = rows[mapHeight-1-y];
+
+		for(x=0; x<mapWidth; x++)
+		{
+			png_bytep pixel = row + x*channels;
+			int brightness, alpha = 255;
+
+			if(colourType & PNG_COLOR_MASK_COLOR)
+			{
+				brightness = (pixel[0] + pixel[1] + pixel[2])/3;
+				if(channels == 4) alpha = pixel[3];
+			}
+			else
+			{
+				brightness = pixel[0];
+				if(channels == 2) alpha = pixel[1];
+			}
+
+			occupancy[y*mapWidth + x] = (alpha >= 128 && brightness < 128);
+		}
+	}
+
+	//floorplans have a boundary round the edge (see map.inc)
+	for(x=0; x<mapWidth; x++)
+	{
+		occupancy[x] = 1;
+		occupancy[(mapHeight-1)*mapWidth + x] = 1;
+	}
+	for(y=0; y<mapHeight; y++)
+	{
+		occupancy[y*mapWidth] = 1;
+		occupancy[y*mapWidth + mapWidth-1] = 1;
+	}
+
+	png_destroy_read_struct(&png, &info, NULL);
+	fclose(file);
+
+	buildDistanceTransform();
+	return 0;
+}
+
+/**
+ * Finds the squared distance from each point on a line to the nearest occupied one, using the lower envelope of parabolas
+ * (Felzenszwalb and Huttenlocher, Distance Transforms of Sampled Functions).
+ * @param f squared distances so far, 0 for occupied points and a huge number for free ones.
+ * @param n number of points on the line
+ * @param spacing distance between the points, in metres
+ * @param d where the squared distances are stored
+ * @param v scratch space for n ints
+ * @param z scratch space for n+1 doubles
+ * */
+static void distanceTransform1D(const double *f, int n, double spacing, double *d, int *v, double *z)
+{
+	int k = 0, q;
+	double s;
+
+	//the ends of the envelope must be infinite, crossing points can be far bigger than the huge values used for free points
+	v[0] = 0;
+	z[0] = -HUGE_VAL;
+	z[1] = HUGE_VAL;
+
+	for(q=1; q<n; q++)
+	{
+		//where the parabola from q crosses the lowest one so far
+		s = ((f[q] + (q*spacing)*(q*spacing)) - (f[v[k]] + (v[k]*spacing)*(v[k]*spacing))) / (2*spacing*(q - v[k]));
+		while(s <= z[k])
+		{
+			k--;
+			s = ((f[q] + (q*spacing)*(q*spacing)) - (f[v[k]] + (v[k]*spacing)*(v[k]*spacing))) / (2*spacing*(q - v[k]));
+		}
+		k++;
+		v[k] = q;
+		z[k] = s;
+		z[k+1] = HUGE_VAL;
+	}
+
+	k = 0;
+	for(q=0; q<n; q++)
+	{
+		while(z[k+1] < q*spacing) k++;
+		d[q] = ((q - v[k])*spacing)*((q - v[k])*spacing) + f[v[k]];
+	}
+	return;
+}
+
+/**
+ * Works out how far each cell of the floorplan is from the nearest wall, so that rays can jump through open space.
+ * The distance is found down each column and then along each row, which gives the exact euclidean distance.
+ * */
+void HeadlessWorld::buildDistanceTransform(void)
+{
+	const double huge = 1e20;
+	int x, y, longest = std::max(mapWidth, mapHeight);
+	std::vector<double> squared(mapWidth*mapHeight);
+	std::vector<double> f(longest), d(longest), z(longest+1);
+	std::vector<int> v(longest);
+
+	for(x=0; x<mapWidth*mapHeight; x++)
+	{
+		squared[x] = occupancy[x] ? 0 : huge;
+	}
+
+	for(x=0; x<mapWidth; x++)
+	{
+		for(y=0; y<mapHeight; y++) f[y] = squared[y*mapWidth + x];
+		distanceTransform1D(&f[0], mapHeight, cellHeight, &d[0], &v[0], &z[0]);
+		for(y=0; y<mapHeight; y++) squared[y*mapWidth + x] = d[y];
+	}
+
+	for(y=0; y<mapHeight; y++)
+	{
+		distanceTransform1D(&squared[y*mapWidth], mapWidth, cellWidth, &d[0], &v[0], &z[0]);
+		for(x=0; x<mapWidth; x++) squared[y*mapWidth + x] = d[x];
+	}
+
+	wallDistance.resize(mapWidth*mapHeight);
+	for(x=0; x<mapWidth*mapHeight; x++)
+	{
+		wallDistance[x] = (float)sqrt(squared[x]);
+	}
+
+	cellDiagonal = sqrt(cellWidth*cellWidth + cellHeight*cellHeight);
+	return;
+}
+
+/**
+ * Tells the rest of the API about the state of the world after a step: puts the robots' poses in the pose cache,
+ * moves the clock on and removes any tones that have finished.
+ * */
+void HeadlessWorld::publishTime(void)
+{
+	unsigned int i;
+	double time;
+	AudioHandler *audioHandler;
+	std::vector<headless_robot_t> copy;
+
+	{
+		boost::mutex::scoped_lock lock(worldMutex);
+		copy = robots;
+		time = currentTime;
+		audioHandler = audio;
+	}
+
+	for(i=0; i<copy.size(); i++)
+	{
+		poses->setPose(copy[i].name, copy[i].x, copy[i].y, copy[i].yaw);
+	}
+	clock->setTime(time);
+	if(audioHandler != NULL) audioHandler->removeFinishedTones();
+
+	return;
+}
+
+/**
+ * Puts the robots into grid cells so that the robots near a point can be found quickly. Must be called with worldMutex held.
+ * The grid just covers the robots, and the cells are made bigger if the robots are spread out so there are never many more cells
+ * than robots. The robots are bucketed with a counting sort so the grid takes time in proportion to the number of robots.
+ * */
+void HeadlessWorld::buildRobotGrid(void)
+{
+	double right, top;
+	unsigned int i;
+	int cell;
+
+	robotGridDirty = false;
+	gridColumns = gridRows = 0;
+	if(robots.empty()) return;
+
+	gridLeft = right = robots[0].x;
+	gridBottom = top = robots[0].y;
+	for(i=1; i<robots.size(); i++)
+	{
+		gridLeft 	= std::min(gridLeft, robots[i].x);
+		right 		= std::max(right, robots[i].x);
+		gridBottom 	= std::min(gridBottom, robots[i].y);
+		top 		= std::max(top, robots[i].y);
+	}
+
+	gridCellSize = std::max(ROBOT_GRID_SIZE, sqrt((right-gridLeft)*(top-gridBottom)/(4*robots.size())));
+	gridColumns = (int)((right-gridLeft)/gridCellSize) + 1;
+	gridRows 	= (int)((top-gridBottom)/gridCellSize) + 1;
+
+	//count the robots in each cell, and add the counts up so each cell has where it ends in gridRobots
+	gridStart.assign(gridColumns*gridRows + 1, 0);
+	gridRobots.resize(robots.size());
+	for(i=0; i<robots.size(); i++)
+	{
+		cell = (int)((robots[i].y-gridBottom)/gridCellSize)*gridColumns + (int)((robots[i].x-gridLeft)/gridCellSize);
+		gridStart[cell]++;
+	}
+	for(cell=1; cell<gridColumns*gridRows; cell++) gridStart[cell] += gridStart[cell-1];
+	gridStart[gridColumns*gridRows] = robots.size();
+
+	//fill each cell from the back, which leaves gridStart pointing at the start of each cell
+	for(i=robots.size(); i-- > 0;)
+	{
+		cell = (int)((robots[i].y-gridBottom)/gridCellSize)*gridColumns + (int)((robots[i].x-gridLeft)/gridCellSize);
+		gridRobots[--gridStart[cell]] = i;
+	}
+
+	return;
+}
+
+/**
+ * Finds the robots in the 3x3 grid cells round a point and puts their indexes in nearbyRobots. Must be called with worldMutex held.
+ * @param x x coordinate of the point
+ * @param y y coordinate of the point
+ * */
+void HeadlessWorld::findNearbyRobots(double x, double y)
+{
+	int cellX, cellY, row, firstColumn, lastColumn, i;
+
+	nearbyRobots.clear();
+	if(gridColumns == 0) return;
+
+	cellX = (int)floor((x-gridLeft)/gridCellSize);
+	cellY = (int)floor((y-gridBottom)/gridCellSize);
+	if(cellX < -1 || cellY < -1 || cellX > gridColumns || cellY > gridRows) return;
+
+	firstColumn = std::max(cellX-1, 0);
+	lastColumn 	= std::min(cellX+1, gridColumns-1);
+
+	//the cells in a row are next to each other in gridRobots, so each row is one run of robots
+	for(row=std::max(cellY-1, 0); row<=std::min(cellY+1, gridRows-1); row++)
+	{
+		for(i=gridStart[row*gridColumns + firstColumn]; i<gridStart[row*gridColumns + lastColumn + 1]; i++)
+		{
+			nearbyRobots.push_back(gridRobots[i]);
+		}
+	}
+	return;
+}
+
+/**
+ * Checks whether a robot would hit a wall or another robot if it were at the given position.
+ * Must be called with worldMutex held and the robot grid built.
+ * */
+bool HeadlessWorld::collides(int robot, double x, double y)
+{
+	unsigned int i;
+
+	findNearbyRobots(x, y);
+	for(i=0; i<nearbyRobots.size(); i++)
+	{
+		int other = nearbyRobots[i];
+		if(other == robot) continue;
+		double dx = robots[other].x - x;
+		double dy = robots[other].y - y;
+		if(dx*dx + dy*dy < 4*ROBOT_RADIUS*ROBOT_RADIUS) return true;
+	}
+
+	return distanceToWall(x, y) < ROBOT_RADIUS;
+}
+
+/**
+ * @returns true if the cell is an obstacle, false if it is free or outside the map.
+ * */
+bool HeadlessWorld::isCellOccupied(int cellX, int cellY)
+{
+	if(cellX < 0 || cellY < 0 || cellX >= mapWidth || cellY >= mapHeight) return false;
+	return occupancy[cellY*mapWidth + cellX] != 0;
+}
+
+/**
+ * Finds roughly how far a point is from the nearest wall, to within a cell.
+ * @returns the distance in metres. Outside the floorplan this is the distance to its edge, which is a wall.
+ * */
+double HeadlessWorld::distanceToWall(double x, double y)
+{
+	if(wallDistance.empty()) return HUGE_VAL;
+
+	int cellX = (int)floor((x - mapLeft)/cellWidth);
+	int cellY = (int)floor((y - mapBottom)/cellHeight);
+
+	if(cellX < 0 || cellY < 0 || cellX >= mapWidth || cellY >= mapHeight)
+	{
+		double outX = std::max(mapLeft - x, x - (mapLeft + mapWidth*cellWidth));
+		double outY = std::max(mapBottom - y, y - (mapBottom + mapHeight*cellHeight));
+		if(outX < 0) outX = 0;
+		if(outY < 0) outY = 0;
+		return sqrt(outX*outX + outY*outY);
+	}
+
+	if(occupancy[cellY*mapWidth + cellX]) return 0;
+	return wallDistance[cellY*mapWidth + cellX];
+}
+
+/**
+ * Works out what each of a robot's IR rangers can see. Must be called with worldMutex held and the robot grid built.
+ * The rays are kept in arrays, one entry per IR, and the per ray sums are done a sensor at a time over
+ * the arrays so that the compiler can vectorise them.
+ * @param robot index of the robot
+ * @param ranges array of NUMBER_OF_IRS where the ranges are stored, in metres.
+ * */
+void HeadlessWorld::computeIRReadings(int robot, double *ranges)
+{
+	const headless_robot_t &r = robots[robot];
+	double c = cos(r.yaw), s = sin(r.yaw);
+	double originX[NUMBER_OF_IRS], originY[NUMBER_OF_IRS];
+	double directionX[NUMBER_OF_IRS], directionY[NUMBER_OF_IRS];
+	unsigned int j;
+	int i;
+
+	//turn the sensor poses into rays in the world
+	for(i=0; i<NUMBER_OF_IRS; i++)
+	{
+		originX[i] 		= r.x + irPoses[i].x*c - irPoses[i].y*s;
+		originY[i] 		= r.y + irPoses[i].x*s + irPoses[i].y*c;
+		directionX[i] 	= c*irCos[i] - s*irSin[i];
+		directionY[i] 	= s*irCos[i] + c*irSin[i];
+		ranges[i] 		= IR_MAX_RANGE;
+	}
+
+	//other robots are discs, and only the ones in nearby grid cells can be in range
+	findNearbyRobots(r.x, r.y);
+	for(j=0; j<nearbyRobots.size(); j++)
+	{
+		const headless_robot_t &other = robots[nearbyRobots[j]];
+		if(nearbyRobots[j] == robot) continue;
+
+		//the sensors are on the edge of the robot, so robots further than this can't be seen by any of them
+		double cx = other.x - r.x, cy = other.y - r.y;
+		if(cx*cx + cy*cy > ROBOT_GRID_SIZE*ROBOT_GRID_SIZE) continue;
+
+		for(i=0; i<NUMBER_OF_IRS; i++)
+		{
+			double ox = other.x - originX[i];
+			double oy = other.y - originY[i];
+			double along = ox*directionX[i] + oy*directionY[i];
+			double inside = ROBOT_RADIUS*ROBOT_RADIUS - (ox*ox + oy*oy - along*along);
+			double t = along - sqrt(inside > 0 ? inside : 0);
+			if(t < 0) t = 0;
+
+			if(along >= 0 && inside >= 0 && t < ranges[i]) ranges[i] = t;
+		}
+	}
+
+	//walls
+	for(i=0; i<NUMBER_OF_IRS; i++)
+	{
+		ranges[i] = castRay(originX[i], originY[i], directionX[i], directionY[i], ranges[i]);
+		if(ranges[i] < IR_MIN_RANGE) ranges[i] = IR_MIN_RANGE;
+	}
+	return;
+}
+
+/**
+ * Finds how far along a ray the first wall is. Must be called with worldMutex held.
+ * In open space the ray jumps forward by the distance to the nearest wall, less a cell diagonal so it can't jump into a wall.
+ * Near walls it goes from cell to cell, to where it leaves the cell it is in, so that it doesn't miss the corner of a wall.
+ * @param x x coordinate of the start of the ray
+ * @param y y coordinate of the start of the ray
+ * @param dx x component of the direction of the ray, which must be a unit vector
+ * @param dy y component of the direction of the ray
+ * @param maxRange how far to look
+ * @returns the distance to the first wall the ray hits, or maxRange if it doesn't hit one.
+ * */
+double HeadlessWorld::castRay(double x, double y, double dx, double dy, double maxRange)
+{
+	//a nudge to get over a cell boundary
+	const double epsilon = 1e-9;
+	double mapRight = mapLeft + mapWidth*cellWidth;
+	double mapTop = mapBottom + mapHeight*cellHeight;
+	double t = 0, step, exitX, exitY;
+	int cellX, cellY, cell;
+
+	if(wallDistance.empty()) return maxRange;
+
+	//rays starting outside the floorplan jump to where they go into it, the edge of the floorplan is a wall so they can't come out again
+	if(x < mapLeft || x >= mapRight || y < mapBottom || y >= mapTop)
+	{
+		double enter = 0, leave = maxRange;
+		double t1, t2;
+
+		if(dx == 0 && (x < mapLeft || x >= mapRight)) return maxRange;
+		if(dy == 0 && (y < mapBottom || y >= mapTop)) return maxRange;
+		if(dx != 0)
+		{
+			t1 = (mapLeft - x)/dx;
+			t2 = (mapRight - x)/dx;
+			enter = std::max(enter, std::min(t1, t2));
+			leave = std::min(leave, std::max(t1, t2));
+		}
+		if(dy != 0)
+		{
+			t1 = (mapBottom - y)/dy;
+			t2 = (mapTop - y)/dy;
+			enter = std::max(enter, std::min(t1, t2));
+			leave = std::min(leave, std::max(t1, t2));
+		}
+		if(enter > leave) return maxRange;
+		t = enter + epsilon;
+	}
+
+	while(t < maxRange)
+	{
+		double px = x + t*dx;
+		double py = y + t*dy;
+
+		cellX = (int)floor((px - mapLeft)/cellWidth);
+		cellY = (int)floor((py - mapBottom)/cellHeight);
+		if(cellX < 0) cellX = 0;
+		if(cellY < 0) cellY = 0;
+		if(cellX >= mapWidth) cellX = mapWidth-1;
+		if(cellY >= mapHeight) cellY = mapHeight-1;
+
+		cell = cellY*mapWidth + cellX;
+		if(occupancy[cell]) return t;
+
+		step = wallDistance[cell] - cellDiagonal;
+		if(step < cellDiagonal)
+		{
+			//close to a wall, so go to the next cell along the ray
+			exitX = (dx > 0) ? (mapLeft + (cellX+1)*cellWidth - px)/dx : (dx < 0) ? (mapLeft + cellX*cellWidth - px)/dx : HUGE_VAL;
+			exitY = (dy > 0) ? (mapBottom + (cellY+1)*cellHeight - py)/dy : (dy < 0) ? (mapBottom + cellY*cellHeight - py)/dy : HUGE_VAL;
+			step = std::min(exitX, exitY) + epsilon;
+		}
+		t += step;
+	}
+	return maxRange;
+}
+
+/**
+ * @returns the angle wrapped into the range -pi to pi.
+ * */
+double HeadlessWorld::normaliseAngle(double angle)
+{
+	angle = fmod(angle, 2*M_PI);
+	while(angle > M_PI) angle -= 2*M_PI;
+	while(angle < -M_PI) angle += 2*M_PI;
+	return angle;
+}
@@ -0,0 +1,137 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <sys/time.h>
+#include <vector>
+#include "HeadlessWorld.h"
+#include "LatencyHistogram.h"
+
+/**
+Benchmark for the IR rangers of HeadlessWorld.
+Fills a world with robots driving about at random and times, for every step, step() itself, getAllIRReadings() for the
+whole swarm and getIRReadings() for each robot in turn. It also checks that the two ways of reading the IRs agree.
+
+<code>HeadlessWorldBenchmark [worldfile robots steps size]</code>, by default worlds/cave.world 1000 200 16. The robots are
+put at random places in a size by size metre square round the origin, away from the walls and each other, so size should
+match the floorplan.
+*/
+
+//as in HeadlessWorld
+static const double ROBOT_RADIUS = 0.035;
+static const double IR_MAX_RANGE = 0.1;
+
+static double getRealTime(void)
+{
+	struct timeval now;
+	gettimeofday(&now, NULL);
+	return (double)now.tv_sec + (double)now.tv_usec/1000000;
+}
+
+static double randomBetween(double low, double high)
+{
+	return low + (high-low)*rand()/RAND_MAX;
+}
+
+/**
+@returns true if a robot at x, y would be clear of the walls and of the robots already placed.
+*/
+static bool isClear(HeadlessWorld &world, double x, double y, const std::vector<double> &placedX, const std::vector<double> &placedY)
+{
+	unsigned int i;
+	int a;
+
+	for(a=0; a<8; a++)
+	{
+		if(world.isOccupied(x + 2*ROBOT_RADIUS*cos(a*M_PI/4), y + 2*ROBOT_RADIUS*sin(a*M_PI/4))) return false;
+	}
+	for(i=0; i<placedX.size(); i++)
+	{
+		if(fabs(placedX[i] - x) < 3*ROBOT_RADIUS && fabs(placedY[i] - y) < 3*ROBOT_RADIUS) return false;
+	}
+	return true;
+}
+
+static void printTimes(const char *name, LatencyHistogram &times)
+{
+	printf("%-26s mean %.3f ms, p50 %.3f ms, p99 %.3f ms, max %.3f ms\n", name, times.getMean()/1000000,
+			times.getPercentile(50)/1000000.0, times.getPercentile(99)/1000000.0, times.getMax()/1000000.0);
+	return;
+}
+
+int main(int argc, char** argv)
+{
+	const char *worldfile 	= "worlds/cave.world";
+	int numberRobots 		= 1000;
+	int steps 				= 200;
+	double size 			= 16;
+	LatencyHistogram stepTime, allIRTime, eachIRTime;
+	std::vector<double> placedX, placedY, allRanges, eachRanges;
+	double x, y, start, inRange = 0;
+	int i, j, s, tries, mismatches = 0;
+	char name[32];
+
+	if(argc > 1) worldfile 		= argv[1];
+	if(argc > 2) numberRobots 	= atoi(argv[2]);
+	if(argc > 3) steps 			= atoi(argv[3]);
+	if(argc > 4) size 			= atof(argv[4]);
+
+	HeadlessWorld world(worldfile);
+
+	srand(1);
+	for(i=0; i<numberRobots; i++)
+	{
+		tries = 0;
+		do
+		{
+			x = randomBetween(-size/2, size/2);
+			y = randomBetween(-size/2, size/2);
+			tries++;
+		}while(!isClear(world, x, y, placedX, placedY) && tries < 10000);
+
+		if(tries == 10000)
+		{
+			printf("only room for %d robots\n", i);
+			break;
+		}
+		placedX.push_back(x);
+		placedY.push_back(y);
+
+		snprintf(name, sizeof(name), "robot%d", i+1);
+		world.addRobot(name, x, y, randomBetween(-M_PI, M_PI));
+		world.setSpeed(i, randomBetween(0, EPuck::MAX_WHEEL_SPEED), randomBetween(-1, 1));
+	}
+	numberRobots = world.getNumberOfRobots();
+	eachRanges.resize(numberRobots*HeadlessWorld::NUMBER_OF_IRS);
+
+	for(s=0; s<steps; s++)
+	{
+		start = getRealTime();
+		world.step();
+		stepTime.record((uint64_t)((getRealTime() - start)*1000000000));
+
+		start = getRealTime();
+		world.getAllIRReadings(allRanges);
+		allIRTime.record((uint64_t)((getRealTime() - start)*1000000000));
+
+		start = getRealTime();
+		for(i=0; i<numberRobots; i++)
+		{
+			world.getIRReadings(i, &eachRanges[i*HeadlessWorld::NUMBER_OF_IRS]);
+		}
+		eachIRTime.record((uint64_t)((getRealTime() - start)*1000000000));
+
+		for(j=0; j<(int)allRanges.size(); j++)
+		{
+			if(allRanges[j] != eachRanges[j]) mismatches++;
+			if(allRanges[j] < IR_MAX_RANGE) inRange++;
+		}
+	}
+
+	printf("%d robots in %s, %d steps\n", numberRobots, worldfile, steps);
+	printTimes("step()", stepTime);
+	printTimes("getAllIRReadings()", allIRTime);
+	printTimes("getIRReadings() each robot", eachIRTime);
+	printf("%.1f%% of IR readings saw something, %d readings differed between the two\n",
+			100*inRange/((double)steps*numberRobots*HeadlessWorld::NUMBER_OF_IRS), mismatches);
+	return mismatches != 0;
+}
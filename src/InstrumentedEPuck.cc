@@ -0,0 +1,309 @@
+#include <string.h>
+#include <time.h>
+#include "InstrumentedEPuck.h"
+
+
+const char* InstrumentedEPuck::METHOD_NAMES[InstrumentedEPuck::NUMBER_OF_METHODS] =
+{
+	"readSensors", "getTime", "getBatteryVolts", "getSensorFrame", "waitForSensorFrame",
+	"getIRReadings", "getIRReading", "getNumberOfIRs",
+	"getCameraWidth", "getCameraHeight", "getNumberBlobs", "getBlob", "getBlobs",
+	"setMotors", "setDifferentialMotors",
+	"setAllLEDsOn", "setAllLEDsOff", "toggleAllLEDs", "setLED", "flashLEDs", "stopFlashLEDs",
+	"initaliseAudio", "playTone", "listenForTones", "listenForTones(vector)"
+};
+
+
+/*====================================================================
+			CONSTRUCTOR/DESTRUCTOR
+====================================================================*/
+
+/**
+Starts timing the calls made to a robot.
+@param wrappedRobot the robot. It still belongs to whoever made it, so isn't deleted with the InstrumentedEPuck.
+@param robotName what to call the robot when the statistics are printed. Maximum 32 chars.
+*/
+InstrumentedEPuck::InstrumentedEPuck(EPuck *wrappedRobot, const char *robotName)
+{
+	robot = wrappedRobot;
+	strncpy(name, robotName, 31);
+	name[31] = '\0';
+	return;
+}
+
+InstrumentedEPuck::~InstrumentedEPuck(void)
+{
+	return;
+}
+
+
+/*====================================================================
+			STATISTICS
+====================================================================*/
+
+/**
+@returns the robot whose calls are being timed.
+*/
+EPuck* InstrumentedEPuck::getRobot(void)
+{
+	return robot;
+}
+
+/**
+@returns the histogram of how long one of the methods took.
+*/
+LatencyHistogram* InstrumentedEPuck::getHistogram(epuck_method_t method)
+{
+	return &histograms[method];
+}
+
+void InstrumentedEPuck::resetStatistics(void)
+{
+	int i;
+
+	for(i=0; i<NUMBER_OF_METHODS; i++) histograms[i].reset();
+	return;
+}
+
+/**
+Prints a table of how many times each method has been called and how long the calls took, in microseconds.
+Methods that haven't been called are left out.
+@param file where to print it, eg stdout.
+*/
+void InstrumentedEPuck::printStatistics(FILE *file)
+{
+	int i;
+
+	fprintf(file, "%s\n", name);
+	fprintf(file, "%-24s%10s%12s%12s%12s%12s%12s\n", "method", "calls", "mean (us)", "p50 (us)", "p99 (us)", "p99.9 (us)", "max (us)");
+	for(i=0; i<NUMBER_OF_METHODS; i++)
+	{
+		LatencyHistogram &histogram = histograms[i];
+		if(histogram.getCount() == 0) continue;
+
+		fprintf(file, "%-24s%10llu%12.2f%12.2f%12.2f%12.2f%12.2f\n", METHOD_NAMES[i], (unsigned long long)histogram.getCount(),
+				histogram.getMean()/1000, histogram.getPercentile(50)/1000.0, histogram.getPercentile(99)/1000.0,
+				histogram.getPercentile(99.9)/1000.0, histogram.getMax()/1000.0);
+	}
+	return;
+}
+
+/**
+Prints the same statistics as printStatistics as a JSON object, on one line, so that the statistics from a lot of robots can be
+collected and compared. Times are in microseconds.
+@param file where to print it, eg stdout.
+*/
+void InstrumentedEPuck::printStatisticsJSON(FILE *file)
+{
+	bool first = true;
+	int i;
+
+	//robot names come from world files so shouldn't have anything in them that needs escaping
+	fprintf(file, "{\"robot\":\"%s\",\"methods\":{", name);
+	for(i=0; i<NUMBER_OF_METHODS; i++)
+	{
+		LatencyHistogram &histogram = histograms[i];
+		if(histogram.getCount() == 0) continue;
+
+		fprintf(file, "%s\"%s\":{\"calls\":%llu,\"mean\":%.3f,\"min\":%.3f,\"p50\":%.3f,\"p90\":%.3f,\"p99\":%.3f,\"p99.9\":%.3f,\"max\":%.3f}",
+				first ? "" : ",", METHOD_NAMES[i], (unsigned long long)histogram.getCount(), histogram.getMean()/1000,
+				histogram.getMin()/1000.0, histogram.getPercentile(50)/1000.0, histogram.getPercentile(90)/1000.0,
+				histogram.getPercentile(99)/1000.0, histogram.getPercentile(99.9)/1000.0, histogram.getMax()/1000.0);
+		first = false;
+	}
+	fprintf(file, "}}\n");
+	return;
+}
+
+
+/*====================================================================
+			TIMED CALLS
+====================================================================*/
+
+void InstrumentedEPuck::readSensors(void)
+{
+	CallTimer timer(histograms[READ_SENSORS]);
+	robot->readSensors();
+	return;
+}
+
+double InstrumentedEPuck::getTime(void)
+{
+	CallTimer timer(histograms[GET_TIME]);
+	return robot->getTime();
+}
+
+double InstrumentedEPuck::getBatteryVolts(void)
+{
+	CallTimer timer(histograms[GET_BATTERY_VOLTS]);
+	return robot->getBatteryVolts();
+}
+
+void InstrumentedEPuck::getSensorFrame(SensorFrame &frame)
+{
+	CallTimer timer(histograms[GET_SENSOR_FRAME]);
+	robot->getSensorFrame(frame);
+	return;
+}
+
+void InstrumentedEPuck::waitForSensorFrame(SensorFrame &frame)
+{
+	CallTimer timer(histograms[WAIT_FOR_SENSOR_FRAME]);
+	robot->waitForSensorFrame(frame);
+	return;
+}
+
+double* InstrumentedEPuck::getIRReadings(void)
+{
+	CallTimer timer(histograms[GET_IR_READINGS]);
+	return robot->getIRReadings();
+}
+
+double InstrumentedEPuck::getIRReading(int index)
+{
+	CallTimer timer(histograms[GET_IR_READING]);
+	return robot->getIRReading(index);
+}
+
+int InstrumentedEPuck::getNumberOfIRs(void)
+{
+	CallTimer timer(histograms[GET_NUMBER_OF_IRS]);
+	return robot->getNumberOfIRs();
+}
+
+int InstrumentedEPuck::getCameraWidth(void)
+{
+	CallTimer timer(histograms[GET_CAMERA_WIDTH]);
+	return robot->getCameraWidth();
+}
+
+int InstrumentedEPuck::getCameraHeight(void)
+{
+	CallTimer timer(histograms[GET_CAMERA_HEIGHT]);
+	return robot->getCameraHeight();
+}
+
+int InstrumentedEPuck::getNumberBlobs(void)
+{
+	CallTimer timer(histograms[GET_NUMBER_BLOBS]);
+	return robot->getNumberBlobs();
+}
+
+EPuck::Blob InstrumentedEPuck::getBlob(int index)
+{
+	CallTimer timer(histograms[GET_BLOB]);
+	return robot->getBlob(index);
+}
+
+int InstrumentedEPuck::getBlobs(std::vector<Blob> &blobs, const BlobFilter &filter)
+{
+	CallTimer timer(histograms[GET_BLOBS]);
+	return robot->getBlobs(blobs, filter);
+}
+
+void InstrumentedEPuck::setMotors(double forward, double turnrate)
+{
+	CallTimer timer(histograms[SET_MOTORS]);
+	robot->setMotors(forward, turnrate);
+	return;
+}
+
+void InstrumentedEPuck::setDifferentialMotors(double left, double right)
+{
+	CallTimer timer(histograms[SET_DIFFERENTIAL_MOTORS]);
+	robot->setDifferentialMotors(left, right);
+	return;
+}
+
+void InstrumentedEPuck::setAllLEDsOn(void)
+{
+	CallTimer timer(histograms[SET_ALL_LEDS_ON]);
+	robot->setAllLEDsOn();
+	return;
+}
+
+void InstrumentedEPuck::setAllLEDsOff(void)
+{
+	CallTimer timer(histograms[SET_ALL_LEDS_OFF]);
+	robot->setAllLEDsOff();
+	return;
+}
+
+void InstrumentedEPuck::toggleAllLEDs(void)
+{
+	CallTimer timer(histograms[TOGGLE_ALL_LEDS]);
+	robot->toggleAllLEDs();
+	return;
+}
+
+void InstrumentedEPuck::setLED(int index, int state)
+{
+	CallTimer timer(histograms[SET_LED]);
+	robot->setLED(index, state);
+	return;
+}
+
+void InstrumentedEPuck::flashLEDs(double frequency)
+{
+	CallTimer timer(histograms[FLASH_LEDS]);
+	robot->flashLEDs(frequency);
+	return;
+}
+
+void InstrumentedEPuck::stopFlashLEDs(void)
+{
+	CallTimer timer(histograms[STOP_FLASH_LEDS]);
+	robot->stopFlashLEDs();
+	return;
+}
+
+int InstrumentedEPuck::initaliseAudio(void)
+{
+	CallTimer timer(histograms[INITIALISE_AUDIO]);
+	return robot->initaliseAudio();
+}
+
+int InstrumentedEPuck::playTone(int frequency, double duration)
+{
+	CallTimer timer(histograms[PLAY_TONE]);
+	return robot->playTone(frequency, duration);
+}
+
+std::vector<EPuck::Tone> InstrumentedEPuck::listenForTones(void)
+{
+	CallTimer timer(histograms[LISTEN_FOR_TONES]);
+	return robot->listenForTones();
+}
+
+int InstrumentedEPuck::listenForTones(std::vector<Tone> &tones)
+{
+	CallTimer timer(histograms[LISTEN_FOR_TONES_VECTOR]);
+	return robot->listenForTones(tones);
+}
+
+
+/*====================================================================
+			PRIVATE FUNCTIONS
+====================================================================*/
+
+InstrumentedEPuck::CallTimer::CallTimer(LatencyHistogram &histogram) : histogram(histogram)
+{
+	start = getNanoseconds();
+	return;
+}
+
+InstrumentedEPuck::CallTimer::~CallTimer(void)
+{
+	histogram.record(getNanoseconds() - start);
+	return;
+}
+
+/**
+@returns the time from a clock that never goes backwards, in nanoseconds.
+*/
+uint64_t InstrumentedEPuck::getNanoseconds(void)
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (uint64_t)now.tv_sec*1000000000 + now.tv_nsec;
+}
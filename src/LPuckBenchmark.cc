@@ -0,0 +1,108 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/time.h>
+#include "libplayerc++/playerc++.h"
+#include "LatencyHistogram.h"
+
+/**
+Benchmark for the lpuck driver, run against a Player server using the driver with an emulated dsPIC, so it needs no robot:
+<code>player worlds/lpuck-emulated.cfg</code> then <code>LPuckBenchmark [host port seconds trials]</code>, by default localhost
+6665 10 100.
+
+For the first half of the time it reads the IR, power and position2d data as fast as the driver sends it, and prints how many
+updates a second got through. Then it times how long a motor command takes to come back as odometry, from the client through
+the driver's message handling, the SPI exchange and the emulated wheels, back to the client.
+The driver prints how fast its SPI loop ran and how long each part took, every spi_stats_interval seconds and when it shuts
+down, which is the figure to compare between versions of the driver.
+*/
+
+static double getRealTime(void)
+{
+	struct timeval now;
+	gettimeofday(&now, NULL);
+	return (double)now.tv_sec + (double)now.tv_usec/1000000;
+}
+
+int main(int argc, char** argv)
+{
+	const char *host 	= "localhost";
+	int port 			= 6665;
+	double seconds 		= 10;
+	int trials 			= 100;
+	LatencyHistogram commandLatency;
+	unsigned long reads = 0, irUpdates = 0, powerUpdates = 0, positionUpdates = 0;
+	double start, now, elapsed, x;
+	int i, timeouts = 0;
+
+	if(argc > 1) host 		= argv[1];
+	if(argc > 2) port 		= atoi(argv[2]);
+	if(argc > 3) seconds 	= atof(argv[3]);
+	if(argc > 4) trials 	= atoi(argv[4]);
+
+	PlayerCc::PlayerClient client(host, port);
+	PlayerCc::IrProxy ir(&client, 0);
+	PlayerCc::PowerProxy power(&client, 0);
+	PlayerCc::Position2dProxy position(&client, 0);
+
+	//only the newest of each message is kept for us, so we see how often new data arrives rather than a backlog
+	client.SetDataMode(PLAYER_DATAMODE_PUSH);
+	client.SetReplaceRule(true);
+
+	//sensor updates
+	start = getRealTime();
+	do
+	{
+		client.Read();
+		reads++;
+		if(ir.IsFresh())
+		{
+			irUpdates++;
+			ir.NotFresh();
+		}
+		if(power.IsFresh())
+		{
+			powerUpdates++;
+			power.NotFresh();
+		}
+		if(position.IsFresh())
+		{
+			positionUpdates++;
+			position.NotFresh();
+		}
+		elapsed = getRealTime() - start;
+	}while(elapsed < seconds/2);
+
+	printf("%lu reads in %.1f s\n", reads, elapsed);
+	printf("updates a second: ir %.1f, power %.1f, position2d %.1f\n", irUpdates/elapsed, powerUpdates/elapsed,
+			positionUpdates/elapsed);
+	printf("last readings: ir[0] %.0f, battery %.0f\n", ir.GetRange(0), power.GetJoules());
+
+	//motor command to odometry
+	for(i=0; i<trials; i++)
+	{
+		//let it stop
+		position.SetSpeed(0, 0);
+		start = getRealTime();
+		while(getRealTime() - start < 0.1) client.Read();
+
+		x = position.GetXPos();
+		position.SetSpeed(0.1, 0);
+		start = getRealTime();
+		do
+		{
+			client.Read();
+			now = getRealTime();
+		}while(position.GetXPos() == x && now - start < 1);
+
+		if(position.GetXPos() == x) timeouts++;
+		else commandLatency.record((uint64_t)((now - start)*1000000000));
+	}
+	position.SetSpeed(0, 0);
+
+	printf("motor command to odometry over %d trials (ms): mean %.3f, p50 %.3f, p99 %.3f, max %.3f, %d never moved\n",
+			trials, commandLatency.getMean()/1000000, commandLatency.getPercentile(50)/1000000.0,
+			commandLatency.getPercentile(99)/1000000.0, commandLatency.getMax()/1000000.0, timeouts);
+	printf("odometry after the trials: x %.3f m, y %.3f m, yaw %.3f rad\n", position.GetXPos(), position.GetYPos(),
+			position.GetYaw());
+	return timeouts != 0;
+}
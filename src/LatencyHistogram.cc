@@ -0,0 +1,168 @@
+/*
+ * LatencyHistogram.cc
+ *
+ */
+
+#include <math.h>
+#include "LatencyHistogram.h"
+
+
+LatencyHistogram::LatencyHistogram(void)
+{
+	reset();
+	return;
+}
+
+LatencyHistogram::~LatencyHistogram()
+{
+	return;
+}
+
+/**
+ * Counts one time. Safe to call from any number of threads at once.
+ * @param nanoseconds how long it took.
+ * */
+void LatencyHistogram::record(uint64_t nanoseconds)
+{
+	uint64_t current;
+
+	__sync_fetch_and_add(&counts[getBucket(nanoseconds)], 1);
+	__sync_fetch_and_add(&totalCount, 1);
+	__sync_fetch_and_add(&totalNanoseconds, nanoseconds);
+
+	//another thread can change them between reading and swapping, in which case try again
+	current = minNanoseconds;
+	while(nanoseconds < current)
+	{
+		current = __sync_val_compare_and_swap(&minNanoseconds, current, nanoseconds);
+	}
+	current = maxNanoseconds;
+	while(nanoseconds > current)
+	{
+		current = __sync_val_compare_and_swap(&maxNanoseconds, current, nanoseconds);
+	}
+	return;
+}
+
+/**
+ * Empties the histogram. Times recorded while this is running may be lost.
+ * */
+void LatencyHistogram::reset(void)
+{
+	int i;
+
+	for(i=0; i<NUMBER_OF_BUCKETS; i++) counts[i] = 0;
+	totalCount 			= 0;
+	totalNanoseconds 	= 0;
+	minNanoseconds 		= ~(uint64_t)0;
+	maxNanoseconds 		= 0;
+	__sync_synchronize();
+	return;
+}
+
+/**
+ * @returns how many times have been recorded.
+ * */
+uint64_t LatencyHistogram::getCount(void)
+{
+	return totalCount;
+}
+
+/**
+ * @returns the mean time in nanoseconds, or 0 if nothing has been recorded.
+ * */
+double LatencyHistogram::getMean(void)
+{
+	uint64_t count = totalCount;
+
+	if(count == 0) return 0;
+	return (double)totalNanoseconds/count;
+}
+
+/**
+ * @returns the shortest time recorded in nanoseconds, or 0 if nothing has been recorded.
+ * */
+uint64_t LatencyHistogram::getMin(void)
+{
+	if(totalCount == 0) return 0;
+	return minNanoseconds;
+}
+
+/**
+ * @returns the longest time recorded in nanoseconds.
+ * */
+uint64_t LatencyHistogram::getMax(void)
+{
+	return maxNanoseconds;
+}
+
+/**
+ * Finds the time that the given percentage of calls took no longer than, eg 99 for the 99th percentile.
+ * @param percentile between 0 and 100.
+ * @returns the time in nanoseconds, rounded up to the top of its bucket. 0 if nothing has been recorded.
+ * */
+uint64_t LatencyHistogram::getPercentile(double percentile)
+{
+	uint64_t bucketCounts[NUMBER_OF_BUCKETS];
+	uint64_t total = 0, seen = 0, wanted;
+	int i;
+
+	//copy the counts first so they add up even if times are being recorded
+	for(i=0; i<NUMBER_OF_BUCKETS; i++)
+	{
+		bucketCounts[i] = counts[i];
+		total += bucketCounts[i];
+	}
+	if(total == 0) return 0;
+
+	if(percentile < 0) percentile = 0;
+	if(percentile > 100) percentile = 100;
+	wanted = (uint64_t)ceil(percentile/100*total);
+	if(wanted < 1) wanted = 1;
+
+	for(i=0; i<NUMBER_OF_BUCKETS; i++)
+	{
+		seen += bucketCounts[i];
+		if(seen >= wanted) break;
+	}
+
+	//the top of the last bucket can be higher than anything that was recorded
+	if(getBucketTop(i) > maxNanoseconds) return maxNanoseconds;
+	return getBucketTop(i);
+}
+
+
+/*====================================================================
+			PRIVATE FUNCTIONS
+====================================================================*/
+
+/**
+ * @returns which bucket a time is counted in.
+ * */
+int LatencyHistogram::getBucket(uint64_t nanoseconds)
+{
+	int highestBit, shift;
+
+	if(nanoseconds >= ((uint64_t)1 << MAX_BITS)) nanoseconds = ((uint64_t)1 << MAX_BITS) - 1;
+	if(nanoseconds < (uint64_t)SUB_BUCKETS) return (int)nanoseconds;
+
+	//keep the top SUB_BUCKET_BITS bits, the highest of which is always set
+	highestBit 	= 63 - __builtin_clzll(nanoseconds);
+	shift 		= highestBit - (SUB_BUCKET_BITS - 1);
+	return shift*(SUB_BUCKETS/2) + (int)(nanoseconds >> shift);
+}
+
+/**
+ * @returns the longest time that is counted in a bucket.
+ * */
+uint64_t LatencyHistogram::getBucketTop(int bucket)
+{
+	int shift;
+	uint64_t subBucket;
+
+	if(bucket < SUB_BUCKETS) return bucket;
+
+	shift 		= bucket/(SUB_BUCKETS/2) - 1;
+	subBucket 	= bucket - shift*(SUB_BUCKETS/2);
+	return ((subBucket + 1) << shift) - 1;
+}
@@ -0,0 +1,195 @@
+/*
+ * PoseCache.cc
+ *
+ */
+
+#include <vector>
+#include "PoseCache.h"
+
+
+std::map<PlayerCc::SimulationProxy*, PoseCache*> PoseCache::instances;
+boost::mutex PoseCache::instanceMutex;
+
+
+/**
+ * Creates the pose cache and starts the thread that keeps it up to date.
+ * @param sim the simulationProxy attached to the playerclient handling this simulation. NULL if the simulation runs in this process.
+ * @param simClock the clock for this simulation. The cache is refreshed each time the clock ticks.
+ * */
+PoseCache::PoseCache(PlayerCc::SimulationProxy *sim, SimulationClock *simClock)
+{
+	simProxy = sim;
+	clock = simClock;
+
+	//without a simulation to ask, the poses are put in by whatever is running the simulation
+	if(simProxy != NULL)
+	{
+		updatePosesThread = boost::thread(&PoseCache::updatePosesThreaded, this);
+	}
+
+	printf("PoseCache initialised\n");
+	return;
+}
+
+/**
+ * Gets the cache for a simulation, making it if this is the first time the simulation has been asked for.
+ * Use this to construct the PoseCache object.
+ * @param sim the simulationProxy attached to the playerclient handling this simulation. NULL for the simulation running in this process.
+ * @param simClock the clock for this simulation.
+ * */
+PoseCache* PoseCache::GetPoseCache(PlayerCc::SimulationProxy *sim, SimulationClock *simClock)
+{
+	boost::mutex::scoped_lock lock(instanceMutex);
+
+	std::map<PlayerCc::SimulationProxy*, PoseCache*>::iterator it = instances.find(sim);
+	if(it != instances.end()) return it->second;
+
+	PoseCache *cache = new PoseCache(sim, simClock);
+	instances[sim] = cache;
+	return cache;
+}
+
+PoseCache::~PoseCache()
+{
+	//close thread
+	updatePosesThread.interrupt();
+	updatePosesThread.join();
+
+	printf("PoseCache destroyed.\n");
+	return;
+}
+
+/**
+ * Adds a model to the cache, so that its pose is refreshed every simulation step. Does nothing if it is already in the cache.
+ * @param name the name of the model in the worldfile.
+ * */
+void PoseCache::registerModel(char* name)
+{
+	double x, y, yaw;
+	getPose(name, x, y, yaw);
+	return;
+}
+
+/**
+ * Gets the pose of a model from the cache. If the model isn't in the cache yet then its pose is read from the simulation
+ * and it is added to the cache.
+ * @param name the name of the model in the worldfile.
+ * @param x where the x coordinate will be stored.
+ * @param y where the y coordinate will be stored.
+ * @param yaw where the yaw angle will be stored.
+ * @returns the simulated time, in seconds, that the pose was read at.
+ * */
+double PoseCache::getPose(char* name, double &x, double &y, double &yaw)
+{
+	model_pose_t pose;
+
+	{
+		boost::mutex::scoped_lock lock(poseMutex);
+		std::map<std::string, model_pose_t>::iterator it = poses.find(name);
+
+		if(it != poses.end())
+		{
+			x 	= it->second.x;
+			y 	= it->second.y;
+			yaw = it->second.yaw;
+			return it->second.time;
+		}
+	}
+
+	//first time this model has been asked for, so have to ask the simulation
+	pose.time = clock->getTime();
+	pose.x = pose.y = pose.yaw = 0;
+	pose.version = 0;
+	if(simProxy != NULL) simProxy->GetPose2d(name, pose.x, pose.y, pose.yaw);
+
+	//if setPose() got in first while we were asking then its pose is the newer one
+	boost::mutex::scoped_lock lock(poseMutex);
+	std::map<std::string, model_pose_t>::iterator it = poses.insert(std::make_pair(std::string(name), pose)).first;
+
+	x 	= it->second.x;
+	y 	= it->second.y;
+	yaw = it->second.yaw;
+	return it->second.time;
+}
+
+/**
+ * Moves a model in the simulation and updates its pose in the cache, so that anything reading the cache sees the new pose straight away.
+ * @param name the name of the model in the worldfile.
+ * @param x x coordinate to put the model at.
+ * @param y y coordinate to put the model at.
+ * @param yaw yaw angle to give the model.
+ * */
+void PoseCache::setPose(char* name, double x, double y, double yaw)
+{
+	model_pose_t pose;
+
+	if(simProxy != NULL) simProxy->SetPose2d(name, x, y, yaw);
+
+	pose.x 		= x;
+	pose.y 		= y;
+	pose.yaw 	= yaw;
+	pose.time 	= clock->getTime();
+
+	boost::mutex::scoped_lock lock(poseMutex);
+	std::map<std::string, model_pose_t>::iterator it = poses.find(name);
+	pose.version = (it != poses.end()) ? it->second.version + 1 : 1;
+	poses[name] = pose;
+	return;
+}
+
+
+//==================================================================================================
+//							PRIVATE FUNCTIONS
+//==================================================================================================
+
+
+/**
+ * Reads the pose of every model in the cache from the simulation once per simulation step.
+ * The cache is only locked to copy the list of names and to store the new poses, not while waiting for the simulation.
+ * A model moved by setPose() in the meantime keeps the pose it was given, as the simulation may not have moved it yet
+ * when it was read.
+ * This function is intended to be threaded, so contains a loop which does not terminate.
+ * */
+void PoseCache::updatePosesThreaded(void)
+{
+	std::vector<std::string> names;
+	std::vector<unsigned long> versions;
+	std::vector<model_pose_t> newPoses;
+	std::map<std::string, model_pose_t>::iterator it;
+	double lastTime = clock->getTime();
+	unsigned int i;
+
+	while(true)
+	{
+		lastTime = clock->waitForNextStep(lastTime);
+
+		{
+			boost::mutex::scoped_lock lock(poseMutex);
+			names.clear();
+			versions.clear();
+			for(it = poses.begin(); it != poses.end(); it++)
+			{
+				names.push_back(it->first);
+				versions.push_back(it->second.version);
+			}
+		}
+
+		newPoses.resize(names.size());
+		for(i=0; i<names.size(); i++)
+		{
+			newPoses[i].time = lastTime;
+			newPoses[i].version = versions[i];
+			simProxy->GetPose2d(const_cast<char*>(names[i].c_str()), newPoses[i].x, newPoses[i].y, newPoses[i].yaw);
+		}
+
+		boost::mutex::scoped_lock lock(poseMutex);
+		for(i=0; i<names.size(); i++)
+		{
+			it = poses.find(names[i]);
+			if(it->second.version != versions[i]) continue;
+			it->second = newPoses[i];
+		}
+	}
+
+	return;
+}
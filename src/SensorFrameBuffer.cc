@@ -0,0 +1,105 @@
+/*
+ * SensorFrameBuffer.cc
+ *
+ */
+
+#include <string.h>
+#include "SensorFrameBuffer.h"
+
+
+SensorFrameBuffer::SensorFrameBuffer(void)
+{
+	//until something is published readers get an empty frame with sequence 0
+	memset(frames, 0, sizeof(frames));
+	frameVersions[0] 	= 0;
+	frameVersions[1] 	= 0;
+	published 			= 0;
+	return;
+}
+
+SensorFrameBuffer::~SensorFrameBuffer()
+{
+	return;
+}
+
+/**
+ * Makes a frame the latest one. The frame's sequence number is set here.
+ * @param frame the sensor readings to publish. Its sequence is changed to the number of the frame.
+ * */
+void SensorFrameBuffer::publish(EPuck::SensorFrame &frame)
+{
+	{
+		boost::mutex::scoped_lock lock(writeMutex);
+		int next = (published + 1) % 2;
+
+		frame.sequence = published + 1;
+
+		//readers that see an odd version, or a different version after they copy, try again
+		frameVersions[next]++;
+		__sync_synchronize();
+		frames[next] = frame;
+		__sync_synchronize();
+		frameVersions[next]++;
+		__sync_synchronize();
+		published = published + 1;
+	}
+
+	//taking the lock means a waiter can't miss the new frame between checking for it and starting to wait
+	{
+		boost::mutex::scoped_lock lock(waitMutex);
+	}
+	frameArrived.notify_all();
+
+	return;
+}
+
+/**
+ * Copies the latest frame. Doesn't lock, so never waits for the writer unless the writer publishes two frames while this
+ * is copying one, in which case it copies again.
+ * @param frame where the frame is copied.
+ * */
+void SensorFrameBuffer::read(EPuck::SensorFrame &frame)
+{
+	unsigned long version, latest;
+
+	while(true)
+	{
+		latest = published;
+		__sync_synchronize();
+		version = frameVersions[latest % 2];
+		if(version % 2 == 1) continue;
+		__sync_synchronize();
+
+		frame = frames[latest % 2];
+
+		//if the writer has been all the way round, the frame may be torn or newer than the latest one, which would
+		//make the next read look like it went back in time
+		__sync_synchronize();
+		if(frameVersions[latest % 2] == version && frame.sequence == latest) break;
+	}
+	return;
+}
+
+/**
+ * @returns the number of frames that have been published.
+ * */
+unsigned long SensorFrameBuffer::getSequence(void)
+{
+	return published;
+}
+
+/**
+ * BLOCKS until a frame newer than the given one has been published.
+ * @param lastSequence the sequence number of the last frame the caller saw, 0 if it hasn't seen one.
+ * @returns the sequence number of the latest frame.
+ * */
+unsigned long SensorFrameBuffer::waitForFrame(unsigned long lastSequence)
+{
+	boost::mutex::scoped_lock lock(waitMutex);
+
+	while(published <= lastSequence)
+	{
+		frameArrived.wait(lock);
+	}
+	return published;
+}
@@ -0,0 +1,240 @@
+/*
+ * SimulationClock.cc
+ *
+ */
+
+#include <math.h>
+#include "SimulationClock.h"
+
+
+std::map<PlayerCc::SimulationProxy*, SimulationClock*> SimulationClock::instances;
+boost::mutex SimulationClock::instanceMutex;
+
+
+/**
+ * Creates the clock, reads the time from the simulation and starts the thread that keeps it up to date.
+ * @param sim the simulationProxy attached to the playerclient handling this simulation. NULL if the simulation runs in this process.
+ * @param name the name of a robot in the simulation.
+ * This is used for accessing data from the simulation proxy, as you need the name of a model to get simulation time information.
+ * */
+SimulationClock::SimulationClock(PlayerCc::SimulationProxy *sim, char* name)
+{
+	simProxy = sim;
+	strncpy(aRobotName, name, 32);
+	pollInterval = defaultPollInterval;
+	stepInterval = 0;
+	realTimePerStep = 0;
+	currentTime = 0;
+
+	//without a simulation to ask, the time is set by whatever is running the simulation
+	if(simProxy != NULL)
+	{
+		currentTime = readSimulationTime();
+		updateTimeThread = boost::thread(&SimulationClock::updateTimeThreaded, this);
+	}
+
+	printf("SimulationClock initialised\n");
+	return;
+}
+
+/**
+ * Gets the clock for a simulation, making it if this is the first time the simulation has been asked for.
+ * Use this to construct the SimulationClock object.
+ * @param sim the simulationProxy attached to the playerclient handling this simulation. NULL for the simulation running in this process.
+ * @param name the name of the robot that initialises the clock.
+ * This is used for accessing data from the simulation proxy, as you need the name of a model to get simulation time information.
+ * */
+SimulationClock* SimulationClock::GetSimulationClock(PlayerCc::SimulationProxy *sim, char* name)
+{
+	boost::mutex::scoped_lock lock(instanceMutex);
+
+	std::map<PlayerCc::SimulationProxy*, SimulationClock*>::iterator it = instances.find(sim);
+	if(it != instances.end()) return it->second;
+
+	SimulationClock *clock = new SimulationClock(sim, name);
+	instances[sim] = clock;
+	return clock;
+}
+
+SimulationClock::~SimulationClock()
+{
+	//close thread
+	updateTimeThread.interrupt();
+	updateTimeThread.join();
+
+	printf("SimulationClock destroyed.\n");
+	return;
+}
+
+/**
+ * Returns the simulated time. This is read from memory so doesn't wait for the simulation.
+ * @returns the simulated time in seconds, as of the last time the clock asked the simulation.
+ * */
+double SimulationClock::getTime(void)
+{
+	boost::mutex::scoped_lock lock(timeMutex);
+	return currentTime;
+}
+
+/**
+ * BLOCKS until the simulated time reaches the time given.
+ * @param simTime the simulated time to wait for, in seconds.
+ * */
+void SimulationClock::waitUntil(double simTime)
+{
+	boost::mutex::scoped_lock lock(timeMutex);
+
+	while(currentTime < simTime)
+	{
+		timeChanged.wait(lock);
+	}
+	return;
+}
+
+/**
+ * BLOCKS until the simulated time moves on from the time given, ie until the simulation has taken another step.
+ * @param lastTime the simulated time, in seconds, that the caller last saw.
+ * @returns the new simulated time in seconds.
+ * */
+double SimulationClock::waitForNextStep(double lastTime)
+{
+	boost::mutex::scoped_lock lock(timeMutex);
+
+	while(currentTime <= lastTime)
+	{
+		timeChanged.wait(lock);
+	}
+	return currentTime;
+}
+
+/**
+ * BLOCKS for the given number of seconds of simulated time.
+ * @param seconds how long to wait for
+ * */
+void SimulationClock::waitSeconds(double seconds)
+{
+	waitUntil(getTime() + seconds);
+	return;
+}
+
+/**
+ * Sets the longest the clock waits between asking the simulation for the time. This is how often it asks until it has
+ * learnt how long a simulation step takes, and while the simulation is paused.
+ * @param milliseconds the poll interval in milliseconds of real time. Must be at least 1.
+ * */
+void SimulationClock::setPollInterval(int milliseconds)
+{
+	boost::mutex::scoped_lock lock(timeMutex);
+
+	if(milliseconds < 1) milliseconds = 1;
+	pollInterval = milliseconds;
+	return;
+}
+
+/**
+ * Moves the clock on, for simulations that run in this process rather than in Player/Stage.
+ * Wakes up anything waiting for the time to change.
+ * @param simTime the new simulated time in seconds.
+ * */
+void SimulationClock::setTime(double simTime)
+{
+	boost::mutex::scoped_lock lock(timeMutex);
+
+	currentTime = simTime;
+	timeChanged.notify_all();
+	return;
+}
+
+
+//==================================================================================================
+//							PRIVATE FUNCTIONS
+//==================================================================================================
+
+
+/**
+ * Asks the simulation for the time when the next step is due and wakes up anything waiting for the time to change.
+ * This function is intended to be threaded, so contains a loop which does not terminate.
+ * */
+void SimulationClock::updateTimeThreaded(void)
+{
+	double lastStep = -1; //real time the last step was seen, -1 until one has been
+	double newTime, now, steps, sample;
+	int wait, retry = minPollInterval;
+
+	while(true)
+	{
+		{
+			boost::mutex::scoped_lock lock(timeMutex);
+			if(retry > pollInterval) retry = pollInterval;
+
+			//sleep until the next step is due, then keep asking with a growing back off until it comes
+			wait = pollInterval;
+			if(realTimePerStep > 0)
+			{
+				wait = (int)((lastStep + realTimePerStep - getRealTime()) * 1000);
+				if(wait < retry) wait = retry;
+			}
+		}
+		boost::this_thread::sleep(boost::posix_time::milliseconds(wait));
+
+		newTime = readSimulationTime();
+		now = getRealTime();
+
+		boost::mutex::scoped_lock lock(timeMutex);
+		if(newTime == currentTime)
+		{
+			retry *= 2;
+			continue;
+		}
+
+		//learn how long a step is, and how long it takes in real time. A pause only stretches the average a little at a time.
+		if(newTime > currentTime)
+		{
+			if(stepInterval == 0 || newTime - currentTime < stepInterval) stepInterval = newTime - currentTime;
+			if(lastStep >= 0)
+			{
+				steps = floor((newTime - currentTime)/stepInterval + 0.5);
+				sample = (now - lastStep)/steps;
+				if(realTimePerStep == 0) realTimePerStep = sample;
+				else
+				{
+					if(sample > 2*realTimePerStep) sample = 2*realTimePerStep;
+					realTimePerStep = 0.8*realTimePerStep + 0.2*sample;
+				}
+			}
+		}
+		lastStep = now;
+		retry = minPollInterval;
+
+		currentTime = newTime;
+		timeChanged.notify_all();
+	}
+
+	return;
+}
+
+/**
+ * Asks the simulation what the time is. This is a blocking request to the Player server.
+ * @returns the simulated time in seconds.
+ * */
+double SimulationClock::readSimulationTime(void)
+{
+	uint64_t timeData;
+	double time;
+	char simproxFlag[] = "time";
+
+	simProxy->GetProperty(aRobotName, simproxFlag, &timeData, sizeof(uint64_t));
+	time = (double)timeData;
+	time = time/1000000;
+
+	return time;
+}
+
+/**
+ * @returns the real time in seconds.
+ * */
+double SimulationClock::getRealTime(void)
+{
+	boost::posix_time::time_duration sinceEpoch = boost::get_system_time() - boost::posix_time::ptime(boost::gregorian::date(1970, 1, 1));
+	return (double)sinceEpoch.total_microseconds()/1000000;
+}
@@ -0,0 +1,293 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <vector>
+#include "HeadlessWorld.h"
+#include "EPuckHeadless.h"
+#include "RobotController.h"
+#include "SwarmScheduler.h"
+
+/**
+The phonotaxis program written as a RobotController and run on a swarm of headless robots by a SwarmScheduler.
+One robot is a beacon that plays a tone every few seconds, the rest move towards it and avoid obstacles the same way as in
+phonotaxis.cc.
+
+The same swarm is run with 1 to 8 threads in turn, and each controller checks that it was stepped exactly once per tick and
+in order. The program returns non-zero if any of them weren't.
+
+<code>SwarmPhonotaxis [worldfile robots ticks size]</code>, by default worlds/cave.world 200 100 16. The robots are put at
+random places in a size by size metre square round the origin, away from the walls and each other.
+*/
+
+//as in HeadlessWorld
+static const double ROBOT_RADIUS = 0.035;
+
+/**
+Moves a robot towards the loudest tone it can hear, or random walks if it can't hear one. Everything phonotaxis.cc keeps in
+static variables is kept in the controller instead, so each robot has its own.
+*/
+class PhonotaxisController : public RobotController
+{
+public:
+	/**Number of times step() has been called since reset().*/
+	int steps;
+	/**Number of times step() was called with a tick other than the one after the last.*/
+	int ticksOutOfOrder;
+
+	PhonotaxisController(void)
+	{
+		statusCounter 	= 0;
+		isTurning 		= false;
+		left 			= EPuck::MAX_WHEEL_SPEED;
+		right 			= EPuck::MAX_WHEEL_SPEED;
+		reset();
+	}
+
+	void reset(void)
+	{
+		steps 			= 0;
+		ticksOutOfOrder = 0;
+		nextTick 		= 0;
+		return;
+	}
+
+	void step(EPuck *robot, int tick)
+	{
+		double leftWheel, rightWheel;
+
+		if(tick != nextTick) ticksOutOfOrder++;
+		nextTick = tick+1;
+		steps++;
+
+		phonotaxis(robot, &leftWheel, &rightWheel);
+		avoidObjects(robot, &leftWheel, &rightWheel);
+		robot->setDifferentialMotors(leftWheel, rightWheel);
+		return;
+	}
+
+protected:
+	int nextTick;
+
+	//random walk state
+	int statusCounter;
+	bool isTurning;
+	double left, right;
+
+	//kept between steps so listening doesn't allocate memory every time
+	std::vector<EPuck::Tone> tones;
+
+	/**
+	Same as avoidObjects() in phonotaxis.cc.
+	@returns true if avoiding an obstacle, false otherwise.
+	*/
+	bool avoidObjects(EPuck *bot, double *leftWheel, double *rightWheel)
+	{
+		const double tooClose = 0.04;
+		double leftIR, rightIR;
+
+		leftIR  = bot->getIRReading(2);
+		rightIR = bot->getIRReading(7);
+
+		if( (leftIR > tooClose) && (rightIR > tooClose) ) return false;
+
+		if(leftIR < tooClose)
+		{
+			//object to the left, move right
+			*leftWheel 	= EPuck::MAX_WHEEL_SPEED/2;
+			*rightWheel = -EPuck::MAX_WHEEL_SPEED/2;
+		}
+		else
+		{
+			//object to the right, move left
+			*leftWheel 	= -EPuck::MAX_WHEEL_SPEED/2;
+			*rightWheel = EPuck::MAX_WHEEL_SPEED/2;
+		}
+		return true;
+	}
+
+	/**
+	Same as randomWalk() in phonotaxis.cc: goes forward for 50 steps then turns for 20.
+	*/
+	void randomWalk(double *leftWheel, double *rightWheel)
+	{
+		const int forwardCount = 50;
+		const int turnCount = 20;
+
+		statusCounter++;
+
+		if((statusCounter > forwardCount) && !isTurning)
+		{
+			//random turn, each wheel between -maxspeed and +maxspeed to 1dp
+			left 	= EPuck::MAX_WHEEL_SPEED*((rand() % 11)-5)/5;
+			right 	= EPuck::MAX_WHEEL_SPEED*((rand() % 11)-5)/5;
+			statusCounter = 0;
+			isTurning = true;
+		}
+		else if((statusCounter > turnCount) && isTurning)
+		{
+			left 	= EPuck::MAX_WHEEL_SPEED*0.8;
+			right 	= EPuck::MAX_WHEEL_SPEED*0.8;
+			statusCounter = 0;
+			isTurning = false;
+		}
+
+		*leftWheel 	= left;
+		*rightWheel = right;
+		return;
+	}
+
+	/**
+	Same as phonotaxis() in phonotaxis.cc.
+	*/
+	void phonotaxis(EPuck *bot, double *leftWheel, double *rightWheel)
+	{
+		double rads;
+
+		if(bot->listenForTones(tones) <= 0 || tones[0].distance <= 0)
+		{
+			randomWalk(leftWheel, rightWheel);
+			return;
+		}
+
+		//slow the wheel on the side the tone is coming from, by how far round it is
+		rads = (tones[0].bearing*M_PI)/180;
+		if(tones[0].bearing < 180)
+		{
+			*rightWheel = EPuck::MAX_WHEEL_SPEED;
+			*leftWheel 	= EPuck::MAX_WHEEL_SPEED*cos(rads);
+		}
+		else
+		{
+			*leftWheel 	= EPuck::MAX_WHEEL_SPEED;
+			*rightWheel = EPuck::MAX_WHEEL_SPEED*cos(rads);
+		}
+		return;
+	}
+};
+
+/**
+Stands still and plays a tone every 50 ticks, like playBeacon() in phonotaxis.cc.
+*/
+class BeaconController : public RobotController
+{
+public:
+	void step(EPuck *robot, int tick)
+	{
+		if(tick % 50 == 0) robot->playTone(500, 5000);
+		return;
+	}
+};
+
+static double randomBetween(double low, double high)
+{
+	return low + (high-low)*rand()/RAND_MAX;
+}
+
+/**
+@returns true if a robot at x, y would be clear of the walls and of the robots already placed.
+*/
+static bool isClear(HeadlessWorld &world, double x, double y, const std::vector<double> &placedX, const std::vector<double> &placedY)
+{
+	unsigned int i;
+	int a;
+
+	for(a=0; a<8; a++)
+	{
+		if(world.isOccupied(x + 2*ROBOT_RADIUS*cos(a*M_PI/4), y + 2*ROBOT_RADIUS*sin(a*M_PI/4))) return false;
+	}
+	for(i=0; i<placedX.size(); i++)
+	{
+		if(fabs(placedX[i] - x) < 3*ROBOT_RADIUS && fabs(placedY[i] - y) < 3*ROBOT_RADIUS) return false;
+	}
+	return true;
+}
+
+int main(int argc, char** argv)
+{
+	const char *worldfile 	= "worlds/cave.world";
+	int numberRobots 		= 200;
+	int ticks 				= 100;
+	double size 			= 16;
+	std::vector<double> placedX, placedY;
+	std::vector<EPuckHeadless*> robots;
+	std::vector<PhonotaxisController*> controllers;
+	BeaconController beacon;
+	double x, y;
+	int i, t, threads, tries, failures = 0;
+	char name[32];
+
+	if(argc > 1) worldfile 		= argv[1];
+	if(argc > 2) numberRobots 	= atoi(argv[2]);
+	if(argc > 3) ticks 			= atoi(argv[3]);
+	if(argc > 4) size 			= atof(argv[4]);
+
+	HeadlessWorld world(worldfile);
+
+	srand(1);
+	for(i=0; i<numberRobots; i++)
+	{
+		tries = 0;
+		do
+		{
+			x = randomBetween(-size/2, size/2);
+			y = randomBetween(-size/2, size/2);
+			tries++;
+		}while(!isClear(world, x, y, placedX, placedY) && tries < 10000);
+
+		if(tries == 10000)
+		{
+			printf("only room for %d robots\n", i);
+			break;
+		}
+		placedX.push_back(x);
+		placedY.push_back(y);
+
+		snprintf(name, sizeof(name), "swarm%d", i+1);
+		world.addRobot(name, x, y, randomBetween(-M_PI, M_PI));
+		robots.push_back(new EPuckHeadless(&world, name));
+		robots.back()->initaliseAudio();
+	}
+	if(robots.size() < 2)
+	{
+		printf("need at least 2 robots\n");
+		return 1;
+	}
+
+	//robot 0 is the beacon, the rest look for it
+	for(i=1; i<(int)robots.size(); i++) controllers.push_back(new PhonotaxisController());
+
+	for(threads=1; threads<=8; threads++)
+	{
+		SwarmScheduler scheduler(threads);
+
+		scheduler.addRobot(robots[0], &beacon);
+		for(i=0; i<(int)controllers.size(); i++)
+		{
+			controllers[i]->reset();
+			scheduler.addRobot(robots[i+1], controllers[i]);
+		}
+
+		for(t=0; t<ticks; t++)
+		{
+			scheduler.tick();
+			world.step();
+		}
+		scheduler.printStatistics();
+
+		for(i=0; i<(int)controllers.size(); i++)
+		{
+			if(controllers[i]->steps != ticks || controllers[i]->ticksOutOfOrder != 0)
+			{
+				printf("robot %d was stepped %d times in %d ticks, %d out of order\n", i+2, controllers[i]->steps, ticks,
+						controllers[i]->ticksOutOfOrder);
+				failures++;
+			}
+		}
+	}
+
+	for(i=0; i<(int)controllers.size(); i++) delete controllers[i];
+	for(i=0; i<(int)robots.size(); i++) delete robots[i];
+
+	printf("%d controllers not stepped once per tick\n", failures);
+	return failures != 0;
+}
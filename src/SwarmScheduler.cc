@@ -0,0 +1,412 @@
+/*
+ * SwarmScheduler.cc
+ *
+ */
+
+#include <math.h>
+#include <exception>
+#include <iostream>
+#include <boost/date_time/posix_time/posix_time.hpp>
+#include <boost/thread/thread_time.hpp>
+#include "SwarmScheduler.h"
+
+
+/*====================================================================
+			CONSTRUCTOR/DESTRUCTOR
+====================================================================*/
+
+/**
+ * Makes a scheduler with one thread per core.
+ * */
+SwarmScheduler::SwarmScheduler(void)
+{
+	initialise(boost::thread::hardware_concurrency());
+	return;
+}
+
+/**
+ * Makes a scheduler with the given number of threads.
+ * @param numberThreads how many threads to run the robots on. If this is less than 1 there is one thread per core.
+ * */
+SwarmScheduler::SwarmScheduler(int numberThreads)
+{
+	if(numberThreads < 1) numberThreads = boost::thread::hardware_concurrency();
+	initialise(numberThreads);
+	return;
+}
+
+/**
+ * Stops the threads. The robots and controllers belong to whoever added them so are not deleted.
+ * */
+SwarmScheduler::~SwarmScheduler()
+{
+	unsigned int i;
+
+	{
+		boost::mutex::scoped_lock lock(phaseMutex);
+		shuttingDown = true;
+		phaseStarted.notify_all();
+	}
+	workers.join_all();
+
+	for(i=0; i<queues.size(); i++) delete queues[i];
+	return;
+}
+
+void SwarmScheduler::initialise(int numberThreads)
+{
+	int i;
+
+	if(numberThreads < 1) numberThreads = 1;
+
+	phase 			= SENSE_PHASE;
+	tickNumber 		= 0;
+	phaseGeneration = 0;
+	finishedWorkers = 0;
+	shuttingDown 	= false;
+	stopRequested 	= false;
+	resetStatistics();
+
+	for(i=0; i<numberThreads; i++)
+	{
+		worker_queue_t *queue = new worker_queue_t;
+		queue->next = 0;
+		queue->end 	= 0;
+		queues.push_back(queue);
+	}
+	for(i=0; i<numberThreads; i++)
+	{
+		workers.add_thread(new boost::thread(&SwarmScheduler::workerThread, this, i));
+	}
+	return;
+}
+
+
+/*====================================================================
+			PUBLIC FUNCTIONS
+====================================================================*/
+
+/**
+ * Gives the scheduler a robot to run. Don't call this while a tick is running.
+ * @param robot the robot
+ * @param controller the controller that drives the robot. The same controller can be given more than one robot if its step() is thread safe.
+ * @returns the number of robots the scheduler has.
+ * */
+int SwarmScheduler::addRobot(EPuck *robot, RobotController *controller)
+{
+	robot_task_t task;
+
+	task.robot 		= robot;
+	task.controller = controller;
+	tasks.push_back(task);
+
+	return tasks.size();
+}
+
+int SwarmScheduler::getNumberOfRobots(void)
+{
+	return tasks.size();
+}
+
+int SwarmScheduler::getNumberOfThreads(void)
+{
+	return queues.size();
+}
+
+/**
+ * Runs one tick: reads every robot's sensors, then runs every controller. Returns when they have all finished.
+ * */
+void SwarmScheduler::tick(void)
+{
+	double start = getRealTime();
+
+	runPhase(SENSE_PHASE);
+	runPhase(CONTROL_PHASE);
+	tickNumber++;
+
+	recordTick(getRealTime() - start, 0, false);
+	return;
+}
+
+/**
+ * Runs ticks one after another, starting one every period seconds of real time. If a tick takes longer than the period the
+ * next one starts straight away, and the ticks after that are still meant to start on the original schedule.
+ * @param numberTicks how many ticks to run. If this is less than 1 the scheduler runs until stop() is called.
+ * @param period how often to start a tick, in seconds. If this is 0 the ticks are run as fast as they can be.
+ * */
+void SwarmScheduler::run(int numberTicks, double period)
+{
+	double firstTick = getRealTime();
+	double scheduled, start;
+	int i;
+
+	{
+		boost::mutex::scoped_lock lock(stopMutex);
+		stopRequested = false;
+	}
+
+	for(i=0; numberTicks < 1 || i < numberTicks; i++)
+	{
+		{
+			boost::mutex::scoped_lock lock(stopMutex);
+			if(stopRequested) break;
+		}
+
+		scheduled = firstTick + i*period;
+		start = getRealTime();
+		if(start < scheduled)
+		{
+			boost::this_thread::sleep(boost::posix_time::microseconds((long)((scheduled - start)*1000000)));
+			start = getRealTime();
+		}
+
+		runPhase(SENSE_PHASE);
+		runPhase(CONTROL_PHASE);
+		tickNumber++;
+
+		recordTick(getRealTime() - start, start - scheduled, period > 0);
+	}
+	return;
+}
+
+/**
+ * Makes run() return at the end of the tick it is on. Can be called from a controller or another thread.
+ * */
+void SwarmScheduler::stop(void)
+{
+	boost::mutex::scoped_lock lock(stopMutex);
+	stopRequested = true;
+	return;
+}
+
+SwarmScheduler::scheduler_statistics_t SwarmScheduler::getStatistics(void)
+{
+	scheduler_statistics_t stats;
+	boost::mutex::scoped_lock lock(statisticsMutex);
+
+	stats.ticks 	= tickCount;
+	stats.meanLatency 	= 0;
+	stats.maxLatency 	= latencyMax;
+	stats.latencyStandardDeviation = 0;
+	stats.meanJitter 	= 0;
+	stats.maxJitter 	= jitterMax;
+
+	if(tickCount > 0)
+	{
+		stats.meanLatency = latencySum/tickCount;
+		double variance = latencySquaredSum/tickCount - stats.meanLatency*stats.meanLatency;
+		if(variance > 0) stats.latencyStandardDeviation = sqrt(variance);
+	}
+	if(jitterTicks > 0) stats.meanJitter = jitterSum/jitterTicks;
+
+	return stats;
+}
+
+void SwarmScheduler::resetStatistics(void)
+{
+	boost::mutex::scoped_lock lock(statisticsMutex);
+
+	tickCount 			= 0;
+	jitterTicks 		= 0;
+	latencySum 			= 0;
+	latencySquaredSum 	= 0;
+	latencyMax 			= 0;
+	jitterSum 			= 0;
+	jitterMax 			= 0;
+	return;
+}
+
+/**
+ * Prints the tick latency and jitter in milliseconds.
+ * */
+void SwarmScheduler::printStatistics(void)
+{
+	scheduler_statistics_t stats = getStatistics();
+
+	printf("%d robots on %d threads, %d ticks\n", getNumberOfRobots(), getNumberOfThreads(), stats.ticks);
+	printf("tick latency (ms): mean %f, max %f, standard deviation %f\n",
+			1000*stats.meanLatency, 1000*stats.maxLatency, 1000*stats.latencyStandardDeviation);
+	printf("tick jitter (ms): mean %f, max %f\n", 1000*stats.meanJitter, 1000*stats.maxJitter);
+	return;
+}
+
+
+/*====================================================================
+			PRIVATE FUNCTIONS
+====================================================================*/
+
+/**
+ * Shares the robots out between the threads, starts them on one half of a tick and waits for them all to finish.
+ * */
+void SwarmScheduler::runPhase(tick_phase tickPhase)
+{
+	int numberThreads = queues.size();
+	int numberTasks = tasks.size();
+	int i;
+
+	if(numberTasks == 0) return;
+
+	//each thread starts with a block of robots next to each other
+	for(i=0; i<numberThreads; i++)
+	{
+		boost::mutex::scoped_lock lock(queues[i]->queueMutex);
+		queues[i]->next = (numberTasks*i)/numberThreads;
+		queues[i]->end 	= (numberTasks*(i+1))/numberThreads;
+	}
+
+	boost::mutex::scoped_lock lock(phaseMutex);
+	phase 			= tickPhase;
+	finishedWorkers = 0;
+	phaseGeneration++;
+	phaseStarted.notify_all();
+
+	while(finishedWorkers < numberThreads)
+	{
+		phaseFinished.wait(lock);
+	}
+	return;
+}
+
+/**
+ * Function run by each of the threads in the pool. Waits for a phase to start, runs robots until there are none left, then
+ * waits for the next phase.
+ * @param worker which thread this is, used to find its queue.
+ * */
+void SwarmScheduler::workerThread(int worker)
+{
+	int lastGeneration = 0;
+	int task;
+
+	while(true)
+	{
+		{
+			boost::mutex::scoped_lock lock(phaseMutex);
+			while(phaseGeneration == lastGeneration && !shuttingDown)
+			{
+				phaseStarted.wait(lock);
+			}
+			if(shuttingDown) return;
+			lastGeneration = phaseGeneration;
+		}
+
+		while(takeTask(worker, task))
+		{
+			runTask(task);
+		}
+
+		{
+			boost::mutex::scoped_lock lock(phaseMutex);
+			finishedWorkers++;
+			if(finishedWorkers == (int)queues.size()) phaseFinished.notify_one();
+		}
+	}
+	return;
+}
+
+/**
+ * Gets the next robot for a thread to run. If the thread has run all of its own robots it takes the top half of the robots
+ * another thread has left.
+ * @param worker the thread
+ * @param task where the index of the robot is stored
+ * @returns false if there are no robots left in this phase.
+ * */
+bool SwarmScheduler::takeTask(int worker, int &task)
+{
+	int numberThreads = queues.size();
+	int i, victim, first, last;
+
+	{
+		boost::mutex::scoped_lock lock(queues[worker]->queueMutex);
+		if(queues[worker]->next < queues[worker]->end)
+		{
+			task = queues[worker]->next++;
+			return true;
+		}
+	}
+
+	//steal, looking at the other threads in turn starting with the next one
+	for(i=1; i<numberThreads; i++)
+	{
+		victim = (worker + i) % numberThreads;
+		{
+			boost::mutex::scoped_lock lock(queues[victim]->queueMutex);
+			int left = queues[victim]->end - queues[victim]->next;
+			if(left <= 0) continue;
+
+			last 	= queues[victim]->end;
+			first 	= last - (left+1)/2;
+			queues[victim]->end = first;
+		}
+
+		//do the first of the stolen robots now and keep the rest, which other threads can steal in turn
+		task = first;
+		boost::mutex::scoped_lock lock(queues[worker]->queueMutex);
+		queues[worker]->next 	= first+1;
+		queues[worker]->end 	= last;
+		return true;
+	}
+
+	return false;
+}
+
+/**
+ * Runs one robot's half of the current phase. Anything the robot or controller throws is caught here, so the thread always
+ * goes on to the next robot and is counted as finished at the end of the phase.
+ * */
+void SwarmScheduler::runTask(int task)
+{
+	//the phase can't change until every thread has finished with it, so it is safe to read here
+	try
+	{
+		if(phase == SENSE_PHASE) tasks[task].robot->readSensors();
+		else
+		{
+			tasks[task].controller->step(tasks[task].robot, tickNumber);
+			//the end of the robot's tick, so send any commands it has been holding back
+			tasks[task].robot->flushCommands();
+		}
+	}
+	//a robot that fails shouldn't stop the others
+	catch(PlayerCc::PlayerError &e)
+	{
+		//PlayerError isn't a std::exception
+		std::cerr << "SwarmScheduler: robot " << task << " threw a PlayerError: " << e << std::endl;
+	}
+	catch(std::exception &e)
+	{
+		printf("SwarmScheduler: robot %d threw an exception: %s\n", task, e.what());
+	}
+	catch(...)
+	{
+		printf("SwarmScheduler: robot %d threw an unknown exception\n", task);
+	}
+	return;
+}
+
+void SwarmScheduler::recordTick(double latency, double jitter, bool timed)
+{
+	boost::mutex::scoped_lock lock(statisticsMutex);
+
+	tickCount++;
+	latencySum 			+= latency;
+	latencySquaredSum 	+= latency*latency;
+	if(latency > latencyMax) latencyMax = latency;
+
+	if(timed)
+	{
+		if(jitter < 0) jitter = 0;
+		jitterTicks++;
+		jitterSum += jitter;
+		if(jitter > jitterMax) jitterMax = jitter;
+	}
+	return;
+}
+
+/**
+ * @returns the real time in seconds.
+ * */
+double SwarmScheduler::getRealTime(void)
+{
+	boost::posix_time::time_duration sinceEpoch = boost::get_system_time() - boost::posix_time::ptime(boost::gregorian::date(1970, 1, 1));
+	return (double)sinceEpoch.total_microseconds()/1000000;
+}
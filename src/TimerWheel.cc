@@ -0,0 +1,298 @@
+/*
+ * TimerWheel.cc
+ *
+ */
+
+#include <math.h>
+#include <algorithm>
+#include <boost/thread/thread_time.hpp>
+#include "TimerWheel.h"
+
+
+TimerWheel* TimerWheel::_realTimeInstance = 0;
+std::map<SimulationClock*, TimerWheel*> TimerWheel::simulationInstances;
+boost::mutex TimerWheel::instanceMutex;
+
+
+TimerWheel::TimerWheel(SimulationClock *simulationClock)
+{
+	clock 			= simulationClock;
+	currentTick 	= 0;
+	nextTaskNumber 	= 0;
+	runningTask 	= -1;
+	startTime 		= boost::get_system_time();
+	slots.resize(NUMBER_OF_LEVELS*SLOTS_PER_LEVEL);
+
+	//the simulated time doesn't start at 0 if the simulation was already running
+	if(clock != NULL) currentTick = toTicks(clock->getTime());
+
+	wheelThread = boost::thread(&TimerWheel::wheelThreaded, this);
+
+	printf("TimerWheel initialised\n");
+	return;
+}
+
+/**
+ * Gets the wheel that follows real time, making it the first time it is asked for.
+ * */
+TimerWheel* TimerWheel::GetRealTimeWheel(void)
+{
+	boost::mutex::scoped_lock lock(instanceMutex);
+
+	if(_realTimeInstance == 0)
+	{
+		_realTimeInstance = new TimerWheel(NULL);
+	}
+	return _realTimeInstance;
+}
+
+/**
+ * Gets the wheel that follows a simulation's time, making it the first time the simulation's clock is given.
+ * @param clock the simulation clock.
+ * */
+TimerWheel* TimerWheel::GetSimulationWheel(SimulationClock *clock)
+{
+	boost::mutex::scoped_lock lock(instanceMutex);
+
+	std::map<SimulationClock*, TimerWheel*>::iterator it = simulationInstances.find(clock);
+	if(it != simulationInstances.end()) return it->second;
+
+	TimerWheel *wheel = new TimerWheel(clock);
+	simulationInstances[clock] = wheel;
+	return wheel;
+}
+
+TimerWheel::~TimerWheel()
+{
+	wheelThread.interrupt();
+	wheelThread.join();
+
+	printf("TimerWheel destroyed.\n");
+	return;
+}
+
+/**
+ * Runs a task every period seconds, starting period seconds from now.
+ * @param action the task, eg boost::bind(&EPuckSim::toggleAllLEDs, robot)
+ * @param period how often to run it in seconds. If this is 0 the task is only run once.
+ * @returns a number for the task which can be given to cancel().
+ * */
+int TimerWheel::schedule(timer_action_t action, double period)
+{
+	return schedule(action, period, period);
+}
+
+/**
+ * Runs a task every period seconds, starting after the given delay.
+ * @param action the task, eg boost::bind(&EPuckSim::toggleAllLEDs, robot)
+ * @param period how often to run it in seconds. If this is 0 the task is only run once.
+ * @param delay how long to wait before running it the first time, in seconds. If this is 0 it is run on the next tick.
+ * @returns a number for the task which can be given to cancel().
+ * */
+int TimerWheel::schedule(timer_action_t action, double period, double delay)
+{
+	timer_task_t task;
+	int number;
+	boost::mutex::scoped_lock lock(wheelMutex);
+
+	task.action = action;
+	task.period = 0;
+	if(period > 0) task.period = std::max((int64_t)1, toTicks(period));
+	task.due 	= currentTick + std::max((int64_t)1, toTicks(delay));
+
+	number = nextTaskNumber++;
+	tasks[number] = task;
+	insertTask(number, task.due);
+
+	return number;
+}
+
+/**
+ * Stops a task. If the task is running at the time this waits for it to finish, so once this has returned the task won't run
+ * again and anything it uses can be deleted. Cancelling a task that has already finished or been cancelled, or -1, does nothing.
+ * @param task the number schedule() gave the task.
+ * */
+void TimerWheel::cancel(int task)
+{
+	boost::mutex::scoped_lock lock(wheelMutex);
+
+	//the task is left in its slot, and skipped when the slot comes round
+	tasks.erase(task);
+
+	//a task can cancel itself, which mustn't wait for itself to finish. -1 is never a task.
+	while(task >= 0 && runningTask == task && boost::this_thread::get_id() != wheelThread.get_id())
+	{
+		taskFinished.wait(lock);
+	}
+	return;
+}
+
+/**
+ * @returns the time the wheel is following, in seconds. For the real time wheel this is the time since the wheel was made.
+ * */
+double TimerWheel::getTime(void)
+{
+	if(clock != NULL) return clock->getTime();
+	return (double)(boost::get_system_time() - startTime).total_microseconds()/1000000;
+}
+
+int TimerWheel::getNumberOfTasks(void)
+{
+	boost::mutex::scoped_lock lock(wheelMutex);
+	return tasks.size();
+}
+
+
+/*====================================================================
+			PRIVATE FUNCTIONS
+====================================================================*/
+
+/**
+ * Function run by the wheel's thread. Moves the wheel on each tick of real time, or each step of the simulation.
+ * */
+void TimerWheel::wheelThreaded(void)
+{
+	int64_t tick = 0;
+	double time;
+
+	if(clock != NULL)
+	{
+		//a simulation step is usually several ticks, which are all run at once
+		time = clock->getTime();
+		while(true)
+		{
+			time = clock->waitForNextStep(time);
+			advanceTo(toTicks(time));
+			boost::this_thread::interruption_point();
+		}
+	}
+	else
+	{
+		while(true)
+		{
+			tick++;
+			boost::this_thread::sleep(startTime + boost::posix_time::microseconds((int64_t)(tick*RESOLUTION*1000000)));
+			advanceTo(tick);
+		}
+	}
+	return;
+}
+
+/**
+ * Runs the ticks up to and including the given one, and the tasks that are due on them.
+ * */
+void TimerWheel::advanceTo(int64_t tick)
+{
+	std::vector<int> dueTasks;
+	std::map<int, timer_task_t>::iterator it;
+	unsigned int i;
+	int level;
+	boost::mutex::scoped_lock lock(wheelMutex);
+
+	while(currentTick < tick)
+	{
+		currentTick++;
+
+		//when a level has been all the way round move the next slot of the level above down
+		for(level=1; level<NUMBER_OF_LEVELS; level++)
+		{
+			if((currentTick & (((int64_t)1 << (LEVEL_BITS*level)) - 1)) != 0) break;
+			cascade(level);
+		}
+
+		dueTasks.swap(slots[currentTick & (SLOTS_PER_LEVEL-1)]);
+		for(i=0; i<dueTasks.size(); i++)
+		{
+			it = tasks.find(dueTasks[i]);
+			if(it == tasks.end()) continue;
+
+			//the task may be in the top level for more than one turn of it
+			if(it->second.due > currentTick)
+			{
+				insertTask(it->first, it->second.due);
+				continue;
+			}
+
+			//the task is copied because it can be cancelled while it runs
+			timer_action_t action = it->second.action;
+			runningTask = dueTasks[i];
+			lock.unlock();
+
+			action();
+
+			lock.lock();
+			runningTask = -1;
+			taskFinished.notify_all();
+
+			//start the next period from when the task was due, so it doesn't drift
+			it = tasks.find(dueTasks[i]);
+			if(it == tasks.end()) continue;
+			if(it->second.period > 0)
+			{
+				it->second.due += it->second.period;
+				insertTask(it->first, it->second.due);
+			}
+			else tasks.erase(it);
+		}
+		dueTasks.clear();
+	}
+	return;
+}
+
+/**
+ * Puts a task in the slot for the tick it is due on. Must be called with wheelMutex held.
+ * @param task the task number
+ * @param due the tick the task is due on. If this has already gone the task is put in the next tick.
+ * */
+void TimerWheel::insertTask(int task, int64_t due)
+{
+	int64_t ticksToGo = due - currentTick;
+	int level;
+
+	if(ticksToGo < 1)
+	{
+		due = currentTick + 1;
+		ticksToGo = 1;
+	}
+
+	//the lowest level whose slots reach far enough
+	for(level=0; level<NUMBER_OF_LEVELS-1; level++)
+	{
+		if(ticksToGo < ((int64_t)1 << (LEVEL_BITS*(level+1)))) break;
+	}
+
+	//further off than the top level reaches, so it goes as far as it can and is looked at again when that slot comes round
+	if(ticksToGo >= ((int64_t)1 << (LEVEL_BITS*NUMBER_OF_LEVELS)))
+	{
+		due = currentTick + ((int64_t)1 << (LEVEL_BITS*NUMBER_OF_LEVELS)) - 1;
+	}
+
+	slots[level*SLOTS_PER_LEVEL + ((due >> (LEVEL_BITS*level)) & (SLOTS_PER_LEVEL-1))].push_back(task);
+	return;
+}
+
+/**
+ * Moves the tasks in the current slot of a level down into the levels below. Must be called with wheelMutex held.
+ * */
+void TimerWheel::cascade(int level)
+{
+	std::vector<int> moving;
+	std::map<int, timer_task_t>::iterator it;
+	unsigned int i;
+
+	moving.swap(slots[level*SLOTS_PER_LEVEL + ((currentTick >> (LEVEL_BITS*level)) & (SLOTS_PER_LEVEL-1))]);
+	for(i=0; i<moving.size(); i++)
+	{
+		it = tasks.find(moving[i]);
+		if(it != tasks.end()) insertTask(it->first, it->second.due);
+	}
+	return;
+}
+
+/**
+ * @returns the number of whole ticks in the given number of seconds.
+ * */
+int64_t TimerWheel::toTicks(double seconds)
+{
+	return (int64_t)floor(seconds/RESOLUTION + 0.5);
+}
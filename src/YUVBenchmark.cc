@@ -0,0 +1,137 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include "yuv422.h"
+
+/**
+Benchmark and check for the colour conversion in the lpuck driver.
+First checks that yuv422_to_rgb gives exactly the same bytes as yuv422_to_rgb_scalar for every possible U, V and Y, for
+random frames, and for lengths and alignments that don't fit the vector code. Then times both on frames the size of the
+camera's and prints how many frames a second each could do.
+
+Build it with the same flags as the driver, eg -O2 -mfpu=neon on the robot, so that it tests the version the driver uses.
+<code>YUVBenchmark [width height frames]</code>, by default 640 480 200.
+*/
+
+static double getRealTime(void)
+{
+	struct timeval now;
+	gettimeofday(&now, NULL);
+	return (double)now.tv_sec + (double)now.tv_usec/1000000;
+}
+
+static void randomFrame(unsigned char *buf, unsigned int size)
+{
+	unsigned int i;
+	for(i=0; i<size; i++) buf[i] = rand() & 0xff;
+	return;
+}
+
+/**
+@returns the number of bytes that differ between the scalar and vector conversions.
+*/
+static int compare(const unsigned char *src, unsigned int pixels, unsigned char *scalar, unsigned char *vector)
+{
+	unsigned int i;
+	int bad = 0;
+
+	//anything written past the end shows up as a difference
+	memset(scalar, 0xa5, pixels*3 + 64);
+	memset(vector, 0xa5, pixels*3 + 64);
+	yuv422_to_rgb_scalar(src, scalar, pixels);
+	yuv422_to_rgb(src, vector, pixels);
+
+	for(i=0; i<pixels*3 + 64; i++)
+	{
+		if(scalar[i] != vector[i]) bad++;
+	}
+	return bad;
+}
+
+int main(int argc, char** argv)
+{
+	unsigned int width 	= 640;
+	unsigned int height = 480;
+	int frames 			= 200;
+	unsigned int pixels, u, v, y, i, length, offset;
+	unsigned char *src, *scalar, *vector;
+	int f, bad = 0;
+	double start, scalarTime, vectorTime;
+
+	if(argc > 3)
+	{
+		width 	= atoi(argv[1]);
+		height 	= atoi(argv[2]);
+		frames 	= atoi(argv[3]);
+	}
+	pixels = width*height;
+	if(pixels < 65536*2) pixels = 65536*2;
+
+	src 	= (unsigned char*)malloc(pixels*2 + 64);
+	scalar 	= (unsigned char*)malloc(pixels*3 + 64);
+	vector 	= (unsigned char*)malloc(pixels*3 + 64);
+
+#if defined(__ARM_NEON__) || defined(__ARM_NEON)
+	printf("Checking the NEON conversion\n");
+#elif defined(__SSE2__)
+	printf("Checking the SSE2 conversion\n");
+#else
+	printf("No vector conversion for this CPU, checking the scalar one against itself\n");
+#endif
+
+	//every U, V and Y, with the second Y of each pair going the other way
+	for(u=0; u<256; u++)
+	{
+		i = 0;
+		for(v=0; v<256; v++)
+		{
+			for(y=0; y<256; y++)
+			{
+				src[i++] = u;
+				src[i++] = y;
+				src[i++] = v;
+				src[i++] = 255 - y;
+			}
+		}
+		bad += compare(src, 65536*2, scalar, vector);
+	}
+	printf("every YUV value: %d bytes differ\n", bad);
+
+	//random frames, and the lengths and alignments the vector code can't do in one go
+	bad = 0;
+	for(f=0; f<20; f++)
+	{
+		randomFrame(src, width*height*2);
+		bad += compare(src, width*height, scalar, vector);
+	}
+	for(length=0; length<=80; length+=2)
+	{
+		for(offset=0; offset<4; offset++)
+		{
+			randomFrame(src, 256);
+			bad += compare(src + offset, length, scalar + offset, vector + offset);
+		}
+	}
+	printf("random frames and odd lengths: %d bytes differ\n", bad);
+
+	//timing
+	randomFrame(src, width*height*2);
+	start = getRealTime();
+	for(f=0; f<frames; f++) yuv422_to_rgb_scalar(src, scalar, width*height);
+	scalarTime = (getRealTime() - start)/frames;
+
+	start = getRealTime();
+	for(f=0; f<frames; f++) yuv422_to_rgb(src, vector, width*height);
+	vectorTime = (getRealTime() - start)/frames;
+
+	printf("%dx%d frame\tms per frame\tframes per second\n", width, height);
+	printf("scalar\t\t%f\t%f\n", 1000*scalarTime, 1/scalarTime);
+	printf("vector\t\t%f\t%f\n", 1000*vectorTime, 1/vectorTime);
+	printf("speed up %.2fx\n", scalarTime/vectorTime);
+
+	free(src);
+	free(scalar);
+	free(vector);
+	return bad != 0;
+}
@@ -6,7 +6,33 @@
  * 20/09/2008: added SPI communication
  * 18/10/2008: added power infterface
  * 01/07/2009: add options "load_gps" "batt_factor"
+ * 17/10/2026: add options "capture_mode" "capture_buffers", streaming capture from mmap'd buffers
+ * 17/10/2026: add options "spi_rate_hz" "spi_stats_interval", SPI loop runs on fixed deadlines
+ * 17/10/2026: spi_device "emulated" for running without a robot, position2d odometry from tacl/tacr
  *
+ * capture_mode is "auto" (stream if the camera can, otherwise read()), "mmap" or "read". When
+ * streaming, each grab takes every frame the camera has ready and keeps only the newest.
+ * If camera_device is a regular file it is read as raw UYVY frames of image_size, over and over,
+ * so the driver can be tried out without a camera.
+ *
+ * The camera runs in its own threads so a slow frame doesn't hold up the SPI loop, and with it the
+ * motors and IR. One thread grabs and converts frames, another publishes them (and saves them if
+ * save_frame is set). Between them is a queue of camera_queue frames; if the publisher falls
+ * behind the oldest frame is dropped. The capture thread never waits more than CAMERA_POLL_TIMEOUT
+ * for a frame, so stopping the camera doesn't hang on one that never comes.
+ *
+ * The SPI loop exchanges a message with the dsPIC spi_rate_hz times a second (10 by default). Each
+ * cycle is due a fixed period after the one before, and the thread sleeps until then with
+ * clock_nanosleep, so time spent in the loop doesn't make it drift. A cycle that finishes after the
+ * next one was due is an overrun; the next cycle runs straight away, and any whole periods that
+ * were missed are skipped rather than run back to back. The time taken by each SPI_IOC_MESSAGE, by
+ * each cycle, and how late each cycle started are kept in histograms, and printed with the achieved
+ * rate and overruns at shutdown, and every spi_stats_interval seconds if that is set. The driver
+ * needs src/LatencyHistogram.cc built into liblpuck for this. spi_rate_hz 0 runs the loop flat out.
+ *
+ * The dsPIC is reached through an SPITransport (lpuck_spi.h, src/lpuck_spi.cc is built into liblpuck
+ * too). With spi_device "emulated" a software dsPIC stands in for the robot, so the whole driver can
+ * run on any Linux box; see worlds/lpuck-emulated.cfg and LPuckBenchmark.
  *
  *
  *-----------------------------------------------------------------
@@ -19,6 +45,11 @@
  *    batt_factor 3.0
  *    camera_device "/dev/video0"
  *    image_size [640 480]
+ *    capture_mode "auto"
+ *    capture_buffers 4
+ *    camera_queue 2
+ *    spi_rate_hz 100
+ *    spi_stats_interval 10
  *    save_frame 1
  *   )
  *
@@ -42,17 +73,25 @@
 #include <string.h>
 #include <unistd.h>
 
+#include <errno.h>
+#include <math.h>
+#include <pthread.h>
+#include <time.h>
+#include <poll.h>
 #include <sys/ioctl.h>
+#include <sys/mman.h>
 #include <sys/stat.h>
 
 #include <linux/videodev2.h>
 #include <linux/types.h>
-#include <linux/spi/spidev.h>
 
 #include <libplayercore/playercore.h>
 #include <libplayerxdr/playerxdr.h>
 
 #include "lpuck.h"
+#include "lpuck_spi.h"
+#include "yuv422.h"
+#include "LatencyHistogram.h"
 //#include "gps_client.h"
 
 #ifndef V4L2_PIX_FMT_UYVY
@@ -60,9 +99,11 @@
 #endif
 
 #define  WHEEL_SEP   0.052
+#define STEP_LENGTH 0.000125 //metres a wheel goes for each step counted by the dsPIC
 #define IR_COUNT 8
 #define AMB_COUNT 8
 #define MIC_COUNT 3
+#define CAMERA_POLL_TIMEOUT 100 //ms grabFrame waits for a frame before giving up, so the camera can be stopped
 
 
 //#define TEST 1
@@ -80,42 +121,6 @@ struct ir_pose_t ir_pose[] =
 };
 
 
-static unsigned char clip(int value)
-{
-  if (value < 0)
-    value = 0;
-  else if (value > 255)
-    value = 255;
-  return value;
-}
-
-static void yuv422_to_rgb(unsigned char *src, unsigned char *dst,
-                          unsigned int nr_pixels)
-{
-  unsigned int i;
-  int y1, y2, u, v;
-
-  for (i = 0; i < nr_pixels; i += 2)
-  {
-    /* Input format is Cb(i)Y(i)Cr(i)Y(i+1) */
-    u = *src++;
-    y1 = *src++;
-    v = *src++;
-    y2 = *src++;
-    y1 -= 16;
-    u -= 128;
-    v -= 128;
-    y2 -= 16;
-
-    *dst++ = clip(( 298 * y1           + 409 * v + 128) >> 8);
-    *dst++ = clip(( 298 * y1 - 100 * u - 208 * v + 128) >> 8);
-    *dst++ = clip(( 298 * y1 + 516 * u           + 128) >> 8);
-
-    *dst++ = clip(( 298 * y2           + 409 * v + 128) >> 8);
-    *dst++ = clip(( 298 * y2 - 100 * u - 208 * v + 128) >> 8);
-    *dst++ = clip(( 298 * y2 + 516 * u           + 128) >> 8);
-  }
-}
 ////////////////////////////////////////////////////////////////////////////////
 // The class for the driver
 class LPuck : public Driver
@@ -142,11 +147,22 @@ private:
   virtual void Main();
 
   int initCamera();
+  int initStreaming();
+  void closeStreaming();
   int closeCamera();
 
   int grabFrame();
 
-  void refreshCameraData();
+  // camera pipeline, see the top of the file
+  int startCamera();
+  void stopCamera();
+  static void *CaptureThread(void *driver);
+  static void *PublishThread(void *driver);
+  void captureLoop();
+  void publishLoop();
+  player_camera_data_t *captureFrame();
+  void publishFrame(player_camera_data_t *data);
+
   void refreshIRData();
   void refreshPowerData();
   void refreshPosData();
@@ -159,9 +175,10 @@ private:
   int initSPI();
   int closeSPI();
   const char *spi_device;
-  int spi_fd;
+  SPITransport *spi;
 
   void doMSG(int16_t *txbuf, int16_t *rxbuf, int16_t len);
+  void printSPIStats();
   struct txbuf_t msgTX; //data to dsPIC
   struct rxbuf_t msgRX; //data from dsPIC
 
@@ -187,6 +204,11 @@ private:
 
   int camera_fd;
   struct image_t imageFrame;
+  enum capture_mode_t capture_mode;
+  const char *capture_mode_name; //"auto", "mmap" or "read"
+  int capture_count; //number of mmap'd buffers
+  struct capture_buffer_t *capture_buffers;
+  int capture_index; //buffer imageFrame.buf points into, -1 if none
   int width;  //image width
   int height;  //image height
   int save;  //save frame to *.ppm
@@ -197,6 +219,37 @@ private:
   int frameno;
   char filename[64];
 
+  // converted frames waiting to be published, a ring of camera_queue_length starting at camera_queue_head
+  player_camera_data_t **camera_queue;
+  int camera_queue_length;
+  int camera_queue_head;
+  int camera_queue_count;
+  pthread_mutex_t camera_mutex; //protects the queue and camera_running
+  pthread_cond_t camera_cond; //signalled when a frame is queued or the camera is stopped
+  pthread_t capture_thread;
+  pthread_t publish_thread;
+  volatile int camera_running;
+  unsigned long frames_captured;
+  unsigned long frames_dropped;
+
+  // the SPI loop runs every spi_period_ns on deadlines from the monotonic clock
+  double spi_rate; //Hz
+  int64_t spi_period_ns;
+  int spi_stats_interval; //seconds between printing the statistics, 0 for only at shutdown
+  struct timespec spi_start;
+  unsigned long spi_cycles;
+  unsigned long spi_overruns; //cycles that finished after the next one was due
+  unsigned long spi_missed; //whole periods skipped after overruns
+  unsigned long spi_errors; //failed SPI_IOC_MESSAGEs
+  LatencyHistogram spi_transfer_time; //each SPI_IOC_MESSAGE
+  LatencyHistogram spi_cycle_time; //from a cycle's deadline to the end of its work
+  LatencyHistogram spi_wakeup_late; //how long after its deadline each cycle started
+
+  // odometry from the wheel step counts
+  volatile int odom_reset; //start again from 0 at the next reading
+  int16_t odom_tacl, odom_tacr;
+  double odom_x, odom_y, odom_yaw;
+
   int publish_interval;
 
   // Capture timestamp
@@ -321,8 +374,22 @@ LPuck::LPuck(ConfigFile* cf, int section)
 
   this->save = cf->ReadInt(section, "save_frame", 0);
   this->cam_device = cf->ReadString(section, "camera_device", "/dev/video0");
+  this->capture_mode_name = cf->ReadString(section, "capture_mode", "auto");
+  this->capture_count = cf->ReadInt(section, "capture_buffers", 4);
+  this->camera_queue_length = cf->ReadInt(section, "camera_queue", 2);
+  if (this->camera_queue_length < 1)
+    this->camera_queue_length = 1;
 
   this->spi_device = cf->ReadString(section, "spi_device", "/dev/spidev1.0");
+  this->spi_rate = cf->ReadFloat(section, "spi_rate_hz", 10);
+  if (this->spi_rate < 0)
+  {
+    PLAYER_WARN1("spi_rate_hz %f is below 0, using 10", this->spi_rate);
+    this->spi_rate = 10;
+  }
+  // 0 is as fast as it will go
+  this->spi_period_ns = this->spi_rate > 0 ? (int64_t)(1e9 / this->spi_rate) : 0;
+  this->spi_stats_interval = cf->ReadInt(section, "spi_stats_interval", 0);
 
   this->load_gps = cf->ReadInt(section, "load_gps", 0);
 
@@ -331,8 +398,14 @@ LPuck::LPuck(ConfigFile* cf, int section)
 
   this->camera_fd = -1;
   this->imageFrame.buf = NULL;
+  this->capture_mode = CAPTURE_READ;
+  this->capture_buffers = NULL;
+  this->capture_index = -1;
+  this->camera_queue = NULL;
+  this->camera_running = 0;
 
-  this->spi_fd = -1;
+  this->spi = NULL;
+  this->odom_reset = 1;
 
   initSPI();
 
@@ -347,9 +420,18 @@ int LPuck::Setup()
 
   if (this->camera_id.interf)
   {
-    initCamera();
+    if (initCamera() == 0)
+      startCamera();
   }
 
+  this->spi_cycles = 0;
+  this->spi_overruns = 0;
+  this->spi_missed = 0;
+  this->spi_errors = 0;
+  this->spi_transfer_time.reset();
+  this->spi_cycle_time.reset();
+  this->spi_wakeup_late.reset();
+
   // Start the device thread; spawns a new thread and executes
   // LPuck::Main(), which contains the main loop for the driver.
   StartThread();
@@ -369,8 +451,11 @@ int LPuck::Shutdown()
 
   // Here you would shut the device down by, for example, closing a
   // serial port.
+  stopCamera();
   closeCamera();
 
+  printSPIStats();
+
   puts("LPuck driver has been shutdown");
 
   return(0);
@@ -477,29 +562,65 @@ int LPuck::ProcessMessage(QueuePointer & resp_queue,
 
 
 
+////////////////////////////////////////////////////////////////////////////////
+// Times for the SPI loop, on the monotonic clock
+
+// a - b in nanoseconds, or 0 if b is after a
+static uint64_t timespec_diff_ns(const struct timespec *a, const struct timespec *b)
+{
+  int64_t ns = (int64_t)(a->tv_sec - b->tv_sec) * 1000000000 + (a->tv_nsec - b->tv_nsec);
+  return ns > 0 ? ns : 0;
+}
+
+static void timespec_add_ns(struct timespec *t, int64_t ns)
+{
+  ns += t->tv_nsec;
+  t->tv_sec += ns / 1000000000;
+  t->tv_nsec = ns % 1000000000;
+}
+
+static void printHistogram(const char *name, LatencyHistogram &histogram)
+{
+  printf("%s (us): mean %.1f, p50 %.1f, p99 %.1f, p99.9 %.1f, max %.1f\n", name,
+         histogram.getMean() / 1000, histogram.getPercentile(50) / 1000.0, histogram.getPercentile(99) / 1000.0,
+         histogram.getPercentile(99.9) / 1000.0, histogram.getMax() / 1000.0);
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 // Main function for device thread
 void LPuck::Main()
 {
   int last_position_subscrcount = 0;
-  this->publish_time = 0;
-  this->frameno = 0;
 
 
+  struct timespec deadline, now, stats_due;
+  uint64_t late;
+  int64_t missed;
+
+  clock_gettime(CLOCK_MONOTONIC, &deadline);
+  this->spi_start = deadline;
+  stats_due = deadline;
+  timespec_add_ns(&stats_due, (int64_t)this->spi_stats_interval * 1000000000);
+
   // The main loop; interact with the device here
   for (;;)
   {
-
+    // Sleep until this cycle is due. A signal can wake us early, so go back to sleep
+    if (this->spi_period_ns > 0)
+    {
+      while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &deadline, NULL) == EINTR)
+        ;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    this->spi_wakeup_late.record(timespec_diff_ns(&now, &deadline));
+    this->spi_cycles++;
 
     // Process incoming messages.  LPuck::ProcessMessage() is
     // called on each message.
     ProcessMessages();
 
     // Interact with the device, and push out the resulting data, using
-    // Driver::Publish()
-    if (camera_id.interf)
-      refreshCameraData();
-
+    // Driver::Publish(). The camera has its own threads.
     if (ir_id.interf && ir_subscriptions > 0)
     {
       refreshIRData();
@@ -545,8 +666,33 @@ void LPuck::Main()
     // test if we are supposed to cancel
     pthread_testcancel();
 
-    // Sleep (you might, for example, block on a read() instead)
-    usleep(100000);
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    this->spi_cycle_time.record(timespec_diff_ns(&now, &deadline));
+
+    // The next cycle is due a period after this one was, not after now. If that has already
+    // gone by it runs straight away, and any whole periods since are skipped
+    if (this->spi_period_ns == 0)
+    {
+      deadline = now;
+    }
+    else
+    {
+      timespec_add_ns(&deadline, this->spi_period_ns);
+      late = timespec_diff_ns(&now, &deadline);
+      if (late > 0)
+      {
+        this->spi_overruns++;
+        missed = late / this->spi_period_ns;
+        this->spi_missed += missed;
+        timespec_add_ns(&deadline, missed * this->spi_period_ns);
+      }
+    }
+
+    if (this->spi_stats_interval > 0 && timespec_diff_ns(&now, &stats_due) > 0)
+    {
+      printSPIStats();
+      timespec_add_ns(&stats_due, (int64_t)this->spi_stats_interval * 1000000000);
+    }
 
 
   }
@@ -564,7 +710,8 @@ int LPuck::Subscribe(player_devaddr_t addr)
     switch (addr.interf)
     {
       case PLAYER_POSITION2D_CODE:
-        this->position_subscriptions++;;
+        if (this->position_subscriptions++ == 0)
+          this->odom_reset = 1;
         printf("Subscribe to Position2D interface, total %d\n", this->position_subscriptions);
         break;
       case PLAYER_IR_CODE:
@@ -628,8 +775,12 @@ int LPuck::initCamera()
 
   struct v4l2_capability cap;
   struct v4l2_format fmt;
+  struct stat st;
 
-  this->camera_fd = open(this->cam_device, O_RDONLY);
+  // mmap'd buffers need the device opened for writing too, but read() and files don't
+  this->camera_fd = open(this->cam_device, O_RDWR);
+  if (this->camera_fd < 0)
+    this->camera_fd = open(this->cam_device, O_RDONLY);
 
   if (this->camera_fd < 0)
   {
@@ -637,6 +788,23 @@ int LPuck::initCamera()
     return -1;
   }
 
+  // a file of raw frames standing in for the camera
+  if (fstat(this->camera_fd, &st) == 0 && S_ISREG(st.st_mode))
+  {
+    this->capture_mode = CAPTURE_FILE;
+    this->imageFrame.width = this->width;
+    this->imageFrame.height = this->height;
+    this->imageFrame.bytes_per_line = this->width * 2;
+    this->imageFrame.size = this->width * this->height * 2;
+    this->imageFrame.buf = malloc(this->imageFrame.size);
+    if (!this->imageFrame.buf)
+    {
+      fprintf(stderr, "Out of memory\n");
+      return (-1);
+    }
+    printf("Reading camera frames from file %s\n", this->cam_device);
+    return 0;
+  }
 
   if (ioctl(this->camera_fd, VIDIOC_QUERYCAP, &cap) < 0)
     return (-1);
@@ -646,11 +814,6 @@ int LPuck::initCamera()
     fprintf(stderr, "No video capture capability present\n");
     return (-1);
   }
-  if (!(cap.capabilities & V4L2_CAP_READWRITE))
-  {
-    fprintf(stderr, "read() interface not supported by driver\n");
-    return (-1);
-  }
 
   /* Select video format */
   memset(&fmt, 0, sizeof(fmt));
@@ -665,10 +828,37 @@ int LPuck::initCamera()
     return (-1);
   }
 
+  // the driver may not do the size asked for, and the rest of the driver uses width and height
+  this->width = fmt.fmt.pix.width;
+  this->height = fmt.fmt.pix.height;
   this->imageFrame.width = fmt.fmt.pix.width;
   this->imageFrame.height = fmt.fmt.pix.height;
   this->imageFrame.bytes_per_line = fmt.fmt.pix.bytesperline;
   this->imageFrame.size = fmt.fmt.pix.sizeimage;
+
+  // stream if we can, frames are then converted straight out of the driver's buffers
+  if (strcmp(this->capture_mode_name, "read") != 0 && (cap.capabilities & V4L2_CAP_STREAMING))
+  {
+    if (initStreaming() == 0)
+    {
+      printf("Camera streaming into %d mmap'd buffers\n", this->capture_count);
+      return 0;
+    }
+    fprintf(stderr, "Streaming capture failed, trying read()\n");
+  }
+  if (strcmp(this->capture_mode_name, "mmap") == 0)
+  {
+    fprintf(stderr, "Streaming capture not supported by driver\n");
+    return (-1);
+  }
+
+  if (!(cap.capabilities & V4L2_CAP_READWRITE))
+  {
+    fprintf(stderr, "read() interface not supported by driver\n");
+    return (-1);
+  }
+
+  this->capture_mode = CAPTURE_READ;
   this->imageFrame.buf = malloc(this->imageFrame.size);
   if (!this->imageFrame.buf)
   {
@@ -679,78 +869,130 @@ int LPuck::initCamera()
   return 0;
 }
 
-int LPuck::initSPI()
+// Ask the driver for a ring of buffers, map them and start capturing into them.
+// Returns 0 if streaming started, otherwise -1 with nothing left mapped.
+int LPuck::initStreaming()
 {
-  static uint8_t mode = 1;
-  static uint8_t bits = 16;
-  static uint32_t speed = 20000000;
-  this->spi_fd = open(this->spi_device, O_RDWR);
-  if (this->spi_fd < 0)
-  {
-    fprintf(stderr, "can't open device");
-    return -1;
-  }
+  struct v4l2_requestbuffers req;
+  struct v4l2_buffer buf;
+  enum v4l2_buf_type type;
+  int i;
 
-  /*
-  *          * spi mode
-  *                   */
-  int ret;
-  ret = ioctl(this->spi_fd, SPI_IOC_WR_MODE, &mode);
-  if (ret == -1)
+  memset(&req, 0, sizeof(req));
+  req.count = this->capture_count;
+  req.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+  req.memory = V4L2_MEMORY_MMAP;
+
+  if (ioctl(this->camera_fd, VIDIOC_REQBUFS, &req) < 0)
+    return (-1);
+
+  // one buffer is held while it is converted, so with fewer than 2 the camera would have nowhere to capture into
+  if (req.count < 2)
   {
-    fprintf(stderr, "can't set spi mode");
+    fprintf(stderr, "Not enough capture buffers\n");
+    req.count = 0;
+    ioctl(this->camera_fd, VIDIOC_REQBUFS, &req);
+    return (-1);
   }
 
-  ret = ioctl(this->spi_fd, SPI_IOC_RD_MODE, &mode);
-  if (ret == -1)
+  this->capture_buffers = (struct capture_buffer_t *)calloc(req.count, sizeof(struct capture_buffer_t));
+  if (!this->capture_buffers)
   {
-    fprintf(stderr, "can't get spi mode");
-    return -1;
+    fprintf(stderr, "Out of memory\n");
+    return (-1);
   }
+  this->capture_count = req.count;
+  this->capture_mode = CAPTURE_STREAMING;
 
-  /*
-  *          * bits per word
-  *                   */
-  ret = ioctl(this->spi_fd, SPI_IOC_WR_BITS_PER_WORD, &bits);
-  if (ret == -1)
+  for (i = 0; i < this->capture_count; i++)
   {
-    fprintf(stderr, "can't set bits per word");
-    return -1;
+    this->capture_buffers[i].start = MAP_FAILED;
+
+    memset(&buf, 0, sizeof(buf));
+    buf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    buf.memory = V4L2_MEMORY_MMAP;
+    buf.index = i;
+
+    if (ioctl(this->camera_fd, VIDIOC_QUERYBUF, &buf) < 0)
+    {
+      closeStreaming();
+      return (-1);
+    }
+
+    this->capture_buffers[i].length = buf.length;
+    this->capture_buffers[i].start = mmap(NULL, buf.length, PROT_READ | PROT_WRITE, MAP_SHARED,
+                                          this->camera_fd, buf.m.offset);
+    if (this->capture_buffers[i].start == MAP_FAILED || ioctl(this->camera_fd, VIDIOC_QBUF, &buf) < 0)
+    {
+      closeStreaming();
+      return (-1);
+    }
   }
 
-  ret = ioctl(this->spi_fd, SPI_IOC_RD_BITS_PER_WORD, &bits);
-  if (ret == -1)
+  type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+  if (ioctl(this->camera_fd, VIDIOC_STREAMON, &type) < 0)
   {
-    fprintf(stderr, "can't get bits per word");
-    return -1;
+    closeStreaming();
+    return (-1);
   }
 
-  /*
-   *          * max speed hz
-   *                   */
-  ret = ioctl(this->spi_fd, SPI_IOC_WR_MAX_SPEED_HZ, &speed);
-  if (ret == -1)
-  {
-    fprintf(stderr, "can't set max speed hz");
+  // so that grabFrame can take frames until there are none left, and wait for one with poll()
+  fcntl(this->camera_fd, F_SETFL, fcntl(this->camera_fd, F_GETFL) | O_NONBLOCK);
+
+  return 0;
+}
+
+int LPuck::initSPI()
+{
+  this->spi = openSPITransport(this->spi_device);
+  if (!this->spi)
     return -1;
-  }
+  return 0;
+}
+
 
-  ret = ioctl(this->spi_fd, SPI_IOC_RD_MAX_SPEED_HZ, &speed);
-  if (ret == -1)
+// Stop streaming and give the capture buffers back to the driver. The camera is left open.
+void LPuck::closeStreaming()
+{
+  struct v4l2_requestbuffers req;
+  enum v4l2_buf_type type;
+  int i;
+
+  if (!this->capture_buffers)
+    return;
+
+  type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+  ioctl(this->camera_fd, VIDIOC_STREAMOFF, &type);
+  fcntl(this->camera_fd, F_SETFL, fcntl(this->camera_fd, F_GETFL) & ~O_NONBLOCK);
+
+  for (i = 0; i < this->capture_count; i++)
   {
-    fprintf(stderr, "can't get max speed hz");
-    return -1;
+    if (this->capture_buffers[i].start != MAP_FAILED)
+      munmap(this->capture_buffers[i].start, this->capture_buffers[i].length);
   }
+  free(this->capture_buffers);
+  this->capture_buffers = NULL;
+  this->capture_index = -1;
 
-  return 0;
-}
+  memset(&req, 0, sizeof(req));
+  req.count = 0;
+  req.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+  req.memory = V4L2_MEMORY_MMAP;
+  ioctl(this->camera_fd, VIDIOC_REQBUFS, &req);
 
+  // imageFrame.buf pointed into one of the buffers
+  this->imageFrame.buf = NULL;
+  this->capture_mode = CAPTURE_READ;
+}
 
 int LPuck::closeCamera()
 {
+  closeStreaming();
+
   if (this->camera_fd > 0)
   {
     close(this->camera_fd);
+    this->camera_fd = -1;
   }
 
   if (this->imageFrame.buf)
@@ -763,23 +1005,115 @@ int LPuck::closeCamera()
 
 int LPuck::closeSPI()
 {
-  if (this->spi_fd > 0)
-  {
-    close(this->spi_fd);
-  }
+  delete this->spi;
+  this->spi = NULL;
   return 0;
 }
 
+// Get the newest frame from the camera into imageFrame.buf. Returns 0 if there is a frame, 1 if
+// none came within CAMERA_POLL_TIMEOUT, and -1 if the camera failed.
+// When streaming imageFrame.buf points straight into the driver's buffer, which is given back
+// on the next call, so the frame must be used before then.
 int LPuck::grabFrame()
 {
+  struct v4l2_buffer buf;
+  struct pollfd pfd;
   unsigned int nbytes = this->imageFrame.size;
+  bool rewound = false;
   ssize_t ret;
 
+  if (this->capture_mode == CAPTURE_STREAMING)
+  {
+    memset(&buf, 0, sizeof(buf));
+    buf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    buf.memory = V4L2_MEMORY_MMAP;
+
+    // give the last frame's buffer back to the driver to capture into again
+    if (this->capture_index >= 0)
+    {
+      buf.index = this->capture_index;
+      this->capture_index = -1;
+      this->imageFrame.buf = NULL;
+      if (ioctl(this->camera_fd, VIDIOC_QBUF, &buf) < 0)
+        return -1;
+    }
+
+    // take every frame that is ready, giving each back as soon as a newer one turns up, so the
+    // frame used is the newest one rather than the oldest one waiting
+    for (;;)
+    {
+      if (ioctl(this->camera_fd, VIDIOC_DQBUF, &buf) == 0)
+      {
+        if (this->capture_index >= 0)
+        {
+          struct v4l2_buffer older = buf;
+          older.index = this->capture_index;
+          if (ioctl(this->camera_fd, VIDIOC_QBUF, &older) < 0)
+            return -1;
+        }
+        this->capture_index = buf.index;
+        this->tsec = buf.timestamp.tv_sec;
+        this->tusec = buf.timestamp.tv_usec;
+        continue;
+      }
+
+      if (errno == EINTR)
+        continue;
+      if (errno != EAGAIN)
+        break;
+      if (this->capture_index >= 0)
+        break;
+
+      // nothing ready yet, wait for the camera
+      pfd.fd = this->camera_fd;
+      pfd.events = POLLIN;
+      ret = poll(&pfd, 1, CAMERA_POLL_TIMEOUT);
+      if (ret == 0)
+        return 1;
+      if (ret < 0 && errno != EINTR)
+        break;
+    }
+
+    if (this->capture_index < 0)
+      return -1;
+    this->imageFrame.buf = this->capture_buffers[this->capture_index].start;
+    return 0;
+  }
+
+  if (!this->imageFrame.buf)
+    return -1;
+
+  // a file always has data ready, but the camera may not
+  if (this->capture_mode == CAPTURE_READ)
+  {
+    pfd.fd = this->camera_fd;
+    pfd.events = POLLIN;
+    ret = poll(&pfd, 1, CAMERA_POLL_TIMEOUT);
+    if (ret == 0)
+      return 1;
+    if (ret < 0 && errno != EINTR)
+      return -1;
+  }
+
   while (nbytes > 0)
   {
-    ret = read(this->camera_fd, this->imageFrame.buf, nbytes);
+    ret = read(this->camera_fd, (char *)this->imageFrame.buf + (this->imageFrame.size - nbytes), nbytes);
     if (ret < 0)
+    {
+      if (errno == EINTR)
+        continue;
       return -1;
+    }
+    if (ret == 0)
+    {
+      // end of the file of frames, go back to the start. A short frame at the end is thrown away,
+      // and a file without a whole frame in it is an error.
+      if (this->capture_mode != CAPTURE_FILE || rewound || lseek(this->camera_fd, 0, SEEK_SET) < 0)
+        return -1;
+      rewound = true;
+      nbytes = this->imageFrame.size;
+      continue;
+    }
     nbytes -= ret;
   }
 
@@ -821,6 +1155,43 @@ void LPuck::refreshPowerData()
 
 }
 
+// Update position2d data from the wheel step counts. The counts are 16 bits and wrap, so only the
+// change since the last reading is used.
+void LPuck::refreshPosData()
+{
+  player_position2d_data_t posdata;
+  int16_t left, right;
+  double dist, turn;
+
+  if (this->odom_reset)
+  {
+    this->odom_reset = 0;
+    this->odom_tacl = msgRX.tacl;
+    this->odom_tacr = msgRX.tacr;
+    this->odom_x = 0;
+    this->odom_y = 0;
+    this->odom_yaw = 0;
+  }
+
+  left = (int16_t)(uint16_t)(msgRX.tacl - this->odom_tacl);
+  right = (int16_t)(uint16_t)(msgRX.tacr - this->odom_tacr);
+  this->odom_tacl = msgRX.tacl;
+  this->odom_tacr = msgRX.tacr;
+
+  dist = (left + right) / 2.0 * STEP_LENGTH;
+  turn = (right - left) * STEP_LENGTH / WHEEL_SEP;
+  this->odom_x += dist * cos(this->odom_yaw + turn / 2);
+  this->odom_y += dist * sin(this->odom_yaw + turn / 2);
+  this->odom_yaw = atan2(sin(this->odom_yaw + turn), cos(this->odom_yaw + turn));
+
+  memset(&posdata, 0, sizeof(posdata));
+  posdata.pos.px = this->odom_x;
+  posdata.pos.py = this->odom_y;
+  posdata.pos.pa = this->odom_yaw;
+
+  this->Publish(this->position_id, PLAYER_MSGTYPE_DATA, PLAYER_POSITION2D_DATA_STATE, (void*)&posdata, sizeof(posdata), NULL);
+}
+
 // Update position2d data from VICON gps system
 // accelerometer added in as velocities.
 /*void LPuck::refreshPosData()
@@ -897,7 +1268,147 @@ void LPuck::refreshLEDData()
 }
 ///////////////////////////////////////////////////////////////////////////////////////////////////////////
 
-void LPuck::refreshCameraData()
+static void freeCameraData(player_camera_data_t *data)
+{
+  free(data->image);
+  free(data);
+}
+
+// Start the threads that capture and publish camera frames.
+int LPuck::startCamera()
+{
+  this->camera_queue = reinterpret_cast<player_camera_data_t **>(calloc(this->camera_queue_length, sizeof(player_camera_data_t *)));
+  if (!this->camera_queue)
+  {
+    PLAYER_ERROR("Out of memory!");
+    return -1;
+  }
+  this->camera_queue_head = 0;
+  this->camera_queue_count = 0;
+  this->frames_captured = 0;
+  this->frames_dropped = 0;
+  this->frameno = 0;
+  this->publish_time = 0;
+
+  pthread_mutex_init(&this->camera_mutex, NULL);
+  pthread_cond_init(&this->camera_cond, NULL);
+  this->camera_running = 1;
+
+  pthread_create(&this->capture_thread, NULL, CaptureThread, this);
+  pthread_create(&this->publish_thread, NULL, PublishThread, this);
+  return 0;
+}
+
+// Stop the camera threads. The capture thread finishes the frame it is grabbing first, which takes
+// at most CAMERA_POLL_TIMEOUT if the camera has nothing for it.
+void LPuck::stopCamera()
+{
+  if (!this->camera_running)
+    return;
+
+  pthread_mutex_lock(&this->camera_mutex);
+  this->camera_running = 0;
+  pthread_cond_broadcast(&this->camera_cond);
+  pthread_mutex_unlock(&this->camera_mutex);
+
+  pthread_join(this->capture_thread, NULL);
+  pthread_join(this->publish_thread, NULL);
+
+  while (this->camera_queue_count > 0)
+  {
+    freeCameraData(this->camera_queue[this->camera_queue_head]);
+    this->camera_queue_head = (this->camera_queue_head + 1) % this->camera_queue_length;
+    this->camera_queue_count--;
+  }
+  free(this->camera_queue);
+  this->camera_queue = NULL;
+  pthread_cond_destroy(&this->camera_cond);
+  pthread_mutex_destroy(&this->camera_mutex);
+
+  printf("Camera: %lu frames captured, %lu dropped because the publisher was behind\n",
+         this->frames_captured, this->frames_dropped);
+}
+
+void *LPuck::CaptureThread(void *driver)
+{
+  reinterpret_cast<LPuck *>(driver)->captureLoop();
+  return NULL;
+}
+
+void *LPuck::PublishThread(void *driver)
+{
+  reinterpret_cast<LPuck *>(driver)->publishLoop();
+  return NULL;
+}
+
+// Grab and convert frames and queue them for the publisher, as fast as the camera gives them.
+void LPuck::captureLoop()
+{
+  player_camera_data_t *data;
+  int ret;
+
+  while (this->camera_running)
+  {
+    // no frame yet, go round to check whether the camera has been stopped
+    ret = grabFrame();
+    if (ret > 0)
+      continue;
+
+    if (ret < 0)
+      PLAYER_ERROR("Failed to grab a camera frame");
+    data = (ret == 0) ? captureFrame() : NULL;
+    if (!data)
+    {
+      // don't spin if the camera has gone
+      usleep(10000);
+      continue;
+    }
+
+    pthread_mutex_lock(&this->camera_mutex);
+    // a newer frame is more use than an old one, so if the queue is full the oldest goes
+    if (this->camera_queue_count == this->camera_queue_length)
+    {
+      freeCameraData(this->camera_queue[this->camera_queue_head]);
+      this->camera_queue_head = (this->camera_queue_head + 1) % this->camera_queue_length;
+      this->camera_queue_count--;
+      this->frames_dropped++;
+    }
+    this->camera_queue[(this->camera_queue_head + this->camera_queue_count) % this->camera_queue_length] = data;
+    this->camera_queue_count++;
+    this->frames_captured++;
+    pthread_cond_signal(&this->camera_cond);
+    pthread_mutex_unlock(&this->camera_mutex);
+  }
+}
+
+// Publish frames as they are queued.
+void LPuck::publishLoop()
+{
+  player_camera_data_t *data;
+
+  for (;;)
+  {
+    pthread_mutex_lock(&this->camera_mutex);
+    while (this->camera_queue_count == 0 && this->camera_running)
+      pthread_cond_wait(&this->camera_cond, &this->camera_mutex);
+
+    if (!this->camera_running)
+    {
+      pthread_mutex_unlock(&this->camera_mutex);
+      return;
+    }
+
+    data = this->camera_queue[this->camera_queue_head];
+    this->camera_queue_head = (this->camera_queue_head + 1) % this->camera_queue_length;
+    this->camera_queue_count--;
+    pthread_mutex_unlock(&this->camera_mutex);
+
+    publishFrame(data);
+  }
+}
+
+// Convert the frame grabFrame got to RGB. Returns NULL if there is no memory for it.
+player_camera_data_t *LPuck::captureFrame()
 {
 
   player_camera_data_t * data = reinterpret_cast<player_camera_data_t *>(malloc(sizeof(player_camera_data_t)));
@@ -905,7 +1416,7 @@ void LPuck::refreshCameraData()
   if (!data)
   {
     PLAYER_ERROR("Out of memory!");
-    return;
+    return NULL;
   }
 
   // Set the image properties
@@ -926,16 +1437,29 @@ void LPuck::refreshCameraData()
     PLAYER_ERROR("Out of memory!");
     free(data);
 
-    return;
+    return NULL;
   }
 
-  //grab the frame
-  grabFrame();
+  //convert data to data->image, straight from the capture buffer when streaming. The driver may pad
+  //the end of each line, in which case each line is converted on its own.
+  if (this->imageFrame.bytes_per_line <= (unsigned int)this->width * 2)
+  {
+    yuv422_to_rgb((unsigned char *)this->imageFrame.buf, data->image, this->width * this->height);
+  }
+  else
+  {
+    for (int row = 0; row < this->height; row++)
+      yuv422_to_rgb((unsigned char *)this->imageFrame.buf + row * this->imageFrame.bytes_per_line,
+                    data->image + row * this->width * 3, this->width);
+  }
 
-  this->frameno++;
+  return data;
+}
 
-  //convert and copy data to data->image
-  yuv422_to_rgb((unsigned char *)this->imageFrame.buf, data->image, this->width * this->height);
+// Save and publish a frame. The frame is handed to Player, which frees it.
+void LPuck::publishFrame(player_camera_data_t *data)
+{
+  this->frameno++;
 
   if (this->save)
   {
@@ -994,21 +1518,19 @@ int LPuck::saveFrame(const unsigned char * buf, const char * fname)
 
 void LPuck::doMSG(int16_t *txbuf, int16_t *rxbuf, int16_t len)
 {
-  struct spi_ioc_transfer xfer;
+  struct timespec start, end;
 
   int   status;
 
-  memset(&xfer, 0, sizeof xfer);
   memset(rxbuf, 0, sizeof rxbuf);
 
-  xfer.rx_buf = (__u64) rxbuf;
-  xfer.tx_buf = (__u64) txbuf;
-  xfer.len = 2 * len; //size in bytes
-
-
-  status = ioctl(this->spi_fd, SPI_IOC_MESSAGE(1), &xfer);
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  status = this->spi ? this->spi->transfer(txbuf, rxbuf, len) : -1;
+  clock_gettime(CLOCK_MONOTONIC, &end);
+  this->spi_transfer_time.record(timespec_diff_ns(&end, &start));
   if (status < 0)
   {
+    this->spi_errors++;
     fprintf(stderr, "SPI_IOC_MESSAGE");
     memset(rxbuf, 0, sizeof rxbuf);
     return;
@@ -1032,6 +1554,29 @@ void LPuck::doMSG(int16_t *txbuf, int16_t *rxbuf, int16_t len)
   memset(txbuf, 0, sizeof(txbuf));
 }
 
+// Print how fast the SPI loop has actually run and how long its parts took, in microseconds
+void LPuck::printSPIStats()
+{
+  struct timespec now;
+  double elapsed;
+
+  if (this->spi_cycles == 0)
+    return;
+
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  elapsed = timespec_diff_ns(&now, &this->spi_start) / 1e9;
+  if (this->spi_period_ns > 0)
+    printf("SPI loop: %lu cycles in %.1f s, %.1f Hz of %.1f Hz, %lu overruns, %lu periods skipped, %lu errors\n",
+           this->spi_cycles, elapsed, this->spi_cycles / elapsed, this->spi_rate,
+           this->spi_overruns, this->spi_missed, this->spi_errors);
+  else
+    printf("SPI loop: %lu cycles in %.1f s, %.1f Hz flat out, %lu errors\n",
+           this->spi_cycles, elapsed, this->spi_cycles / elapsed, this->spi_errors);
+  printHistogram("  transfer", this->spi_transfer_time);
+  printHistogram("  cycle", this->spi_cycle_time);
+  printHistogram("  wakeup late", this->spi_wakeup_late);
+}
+
 void LPuck::setSpeedCMD(int16_t leftspeed, int16_t rightspeed)
 {
   msgTX.cmd.set_motor = 1;
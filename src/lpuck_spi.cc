@@ -0,0 +1,251 @@
+/* SPI transports for the lpuck driver: the spidev bus to the dsPIC on the robot, and an emulated
+ * dsPIC for running the driver without one. See lpuck_spi.h.
+ */
+
+#include <fcntl.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+
+#include <linux/types.h>
+#include <linux/spi/spidev.h>
+
+#include "lpuck_spi.h"
+
+
+SPITransport *openSPITransport(const char *device)
+{
+  SpidevTransport *spidev;
+
+  if (strcmp(device, "emulated") == 0)
+  {
+    puts("LPuck: using an emulated dsPIC");
+    return new EmulatedDsPIC();
+  }
+
+  spidev = new SpidevTransport();
+  if (spidev->open(device) < 0)
+  {
+    delete spidev;
+    return NULL;
+  }
+  return spidev;
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+// spidev
+
+SpidevTransport::SpidevTransport()
+{
+  this->fd = -1;
+}
+
+SpidevTransport::~SpidevTransport()
+{
+  if (this->fd >= 0)
+    close(this->fd);
+}
+
+int SpidevTransport::open(const char *device)
+{
+  static uint8_t mode = 1;
+  static uint8_t bits = 16;
+  static uint32_t speed = 20000000;
+  int ret;
+
+  this->fd = ::open(device, O_RDWR);
+  if (this->fd < 0)
+  {
+    fprintf(stderr, "can't open device");
+    return -1;
+  }
+
+  /*
+   * spi mode
+   */
+  ret = ioctl(this->fd, SPI_IOC_WR_MODE, &mode);
+  if (ret == -1)
+  {
+    fprintf(stderr, "can't set spi mode");
+  }
+
+  ret = ioctl(this->fd, SPI_IOC_RD_MODE, &mode);
+  if (ret == -1)
+  {
+    fprintf(stderr, "can't get spi mode");
+    return -1;
+  }
+
+  /*
+   * bits per word
+   */
+  ret = ioctl(this->fd, SPI_IOC_WR_BITS_PER_WORD, &bits);
+  if (ret == -1)
+  {
+    fprintf(stderr, "can't set bits per word");
+    return -1;
+  }
+
+  ret = ioctl(this->fd, SPI_IOC_RD_BITS_PER_WORD, &bits);
+  if (ret == -1)
+  {
+    fprintf(stderr, "can't get bits per word");
+    return -1;
+  }
+
+  /*
+   * max speed hz
+   */
+  ret = ioctl(this->fd, SPI_IOC_WR_MAX_SPEED_HZ, &speed);
+  if (ret == -1)
+  {
+    fprintf(stderr, "can't set max speed hz");
+    return -1;
+  }
+
+  ret = ioctl(this->fd, SPI_IOC_RD_MAX_SPEED_HZ, &speed);
+  if (ret == -1)
+  {
+    fprintf(stderr, "can't get max speed hz");
+    return -1;
+  }
+
+  return 0;
+}
+
+int SpidevTransport::transfer(int16_t *txbuf, int16_t *rxbuf, int16_t len)
+{
+  struct spi_ioc_transfer xfer;
+
+  memset(&xfer, 0, sizeof xfer);
+  xfer.rx_buf = (__u64)(unsigned long)rxbuf;
+  xfer.tx_buf = (__u64)(unsigned long)txbuf;
+  xfer.len = 2 * len; //size in bytes
+
+  return ioctl(this->fd, SPI_IOC_MESSAGE(1), &xfer);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+// Emulated dsPIC
+
+EmulatedDsPIC::EmulatedDsPIC()
+{
+  memset(&this->state, 0, sizeof(this->state));
+  memset(&this->leds, 0, sizeof(this->leds));
+  this->left_speed = 0;
+  this->right_speed = 0;
+  this->left_steps = 0;
+  this->right_steps = 0;
+  this->seed = 1;
+  this->transfers = 0;
+
+  clock_gettime(CLOCK_MONOTONIC, &this->start);
+  this->last = this->start;
+  update(&this->start);
+}
+
+EmulatedDsPIC::~EmulatedDsPIC()
+{
+}
+
+int EmulatedDsPIC::transfer(int16_t *txbuf, int16_t *rxbuf, int16_t len)
+{
+  struct txbuf_t tx;
+  struct timespec now;
+  size_t bytes = 2 * len;
+
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  update(&now);
+
+  // the reply was loaded before the command came in
+  memset(rxbuf, 0, bytes);
+  memcpy(rxbuf, &this->state, bytes < sizeof(this->state) ? bytes : sizeof(this->state));
+
+  memset(&tx, 0, sizeof(tx));
+  memcpy(&tx, txbuf, bytes < sizeof(tx) ? bytes : sizeof(tx));
+  command(&tx);
+
+  this->transfers++;
+  return bytes;
+}
+
+unsigned long EmulatedDsPIC::getTransfers()
+{
+  return this->transfers;
+}
+
+// Run the motors up to now and make up new sensor readings
+void EmulatedDsPIC::update(const struct timespec *now)
+{
+  double t, dt;
+  int i, whole;
+
+  t = (now->tv_sec - this->start.tv_sec) + (now->tv_nsec - this->start.tv_nsec) / 1e9;
+  dt = (now->tv_sec - this->last.tv_sec) + (now->tv_nsec - this->last.tv_nsec) / 1e9;
+  this->last = *now;
+
+  // the step counters are 16 bits and wrap, as on the dsPIC
+  this->left_steps += this->left_speed * dt;
+  whole = (int)this->left_steps;
+  this->left_steps -= whole;
+  this->state.tacl = (int16_t)(uint16_t)(this->state.tacl + whole);
+
+  this->right_steps += this->right_speed * dt;
+  whole = (int)this->right_steps;
+  this->right_steps -= whole;
+  this->state.tacr = (int16_t)(uint16_t)(this->state.tacr + whole);
+
+  // a wall drifting in and out of range of each sensor in turn
+  for (i = 0; i < 8; i++)
+  {
+    this->state.ir[i] = (int16_t)(500 + 400 * sin(0.5 * t + i * M_PI / 4) + noise(20));
+    this->state.amb[i] = (int16_t)(3800 + 100 * sin(0.2 * t + i) + noise(10));
+  }
+
+  // flat on the floor, in a quiet room
+  this->state.acc[0] = 2048 + noise(10);
+  this->state.acc[1] = 2048 + noise(10);
+  this->state.acc[2] = 2848 + noise(10);
+  for (i = 0; i < 3; i++)
+    this->state.mic[i] = 2048 + noise(50);
+
+  // the raw battery reading, dropping by one a minute
+  this->state.batt = (int16_t)(3900 - t / 60);
+}
+
+void EmulatedDsPIC::command(const struct txbuf_t *tx)
+{
+  if (tx->cmd.reset)
+  {
+    this->left_speed = 0;
+    this->right_speed = 0;
+    this->left_steps = 0;
+    this->right_steps = 0;
+    this->state.tacl = 0;
+    this->state.tacr = 0;
+  }
+
+  if (tx->cmd.set_motor)
+  {
+    this->left_speed = tx->left_motor;
+    this->right_speed = tx->right_motor;
+    if (this->left_speed > MAX_SPEED) this->left_speed = MAX_SPEED;
+    if (this->left_speed < -MAX_SPEED) this->left_speed = -MAX_SPEED;
+    if (this->right_speed > MAX_SPEED) this->right_speed = MAX_SPEED;
+    if (this->right_speed < -MAX_SPEED) this->right_speed = -MAX_SPEED;
+  }
+
+  if (tx->cmd.set_led)
+    this->leds = tx->led_cmd;
+}
+
+// a random number between -amplitude and amplitude
+int16_t EmulatedDsPIC::noise(int amplitude)
+{
+  return (int16_t)(rand_r(&this->seed) % (2 * amplitude + 1) - amplitude);
+}
@@ -6,12 +6,12 @@
  */
 
 #include <stdio.h>
-#include <pthread.h>
 #include <math.h>
 #include <unistd.h>	//for usleep
 #include "EPuck.h"
 #include "EPuckReal.h"
 #include "EPuckSim.h"
+#include "TimerWheel.h"
 
 /**
  * Checks the given robot for nearby obstacles and generates motor speeds to avoid them.
@@ -130,17 +130,19 @@ void randomWalk(EPuck *bot, double *leftWheel, double *rightWheel)
  * */
 void phonotaxis(EPuck *bot, double *leftWheel, double *rightWheel)
 {
+	//kept between calls so listening doesn't allocate memory every time
+	static std::vector<EPuck::Tone> tones;
 	int numberTones;
 	double left, right;
 
-	numberTones = bot->listenForTones();
+	numberTones = bot->listenForTones(tones);
 
 	if(numberTones > 0)
 	{
 		double rads;
 		EPuck::Tone t;
 
-		t = bot->getTone(0);
+		t = tones[0];
 
 		//if the robot can actually hear the tone
 		if(t.distance > 0)
@@ -188,29 +190,21 @@ void phonotaxis(EPuck *bot, double *leftWheel, double *rightWheel)
 
 
 /**
- * Function to make a robot's presence known.
- * @param the robot to flash and make a sound (cast to a void*)
+ * Function to make a robot's presence known. The TimerWheel calls this every 5 seconds.
+ * @param robot the robot to make a sound
  * */
-void *flashAndSound(void *bot)
+void playBeacon(EPuck *robot)
 {
-	EPuck *robot = (EPuck*)bot;
-	robot->setAllLEDsOn();
-	while(true)
-	{
-		printf("playing tone. Time is %f.\n", robot->getTime());
-		robot->playTone(500, 5000);
-		//robot->dumpAudio_TEST();
-		usleep(5000000);
-	}
-	pthread_exit(NULL);
-	return NULL;
+	printf("playing tone. Time is %f.\n", robot->getTime());
+	robot->playTone(500, 5000);
+	//robot->dumpAudio_TEST();
+	return;
 }
 
 
 int main(void)
 {
 	EPuckSim* robots[4];
-	pthread_t noisyBotThread1;
 
 //	EPuckReal *robot = new EPuckReal();
 
@@ -241,7 +235,8 @@ int main(void)
 	}
 
 	//set the bot flashing and noising
-	pthread_create(&noisyBotThread1, NULL, flashAndSound, (void *)robots[bot1]);
+	robots[bot1]->setAllLEDsOn();
+	TimerWheel::GetRealTimeWheel()->schedule(boost::bind(playBeacon, robots[bot1]), 5.0, 0);
 	usleep(100000);
 
 	double left, right;